@@ -0,0 +1,210 @@
+#ifndef AGGREGATING_CIRCULAR_BUFFER_H
+#define AGGREGATING_CIRCULAR_BUFFER_H
+
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "Circular_Buffer.h"
+
+// 滑动窗口上的近似分位数：对数分桶直方图(DDSketch 的分桶方式)
+// 值 v > 0 落在第 ceil(log_gamma(v)) 个桶，gamma = (1 + a) / (1 - a)，
+// 桶内任意值与桶代表值的相对误差不超过 a。计数可以加也可以减，因此能随窗口滑动而更新。
+// 小于等于 0 的值统一计入零桶
+class QuantileSketch
+{
+    public:
+        explicit QuantileSketch(double relative_accuracy = 0.01);
+
+        void add(double value) { update(value, 1); }
+        void remove(double value) { update(value, -1); }
+        void clear();
+
+        uint64_t count() const { return _count; }
+        // q 取 [0, 1]，为空时返回 0
+        double quantile(double q) const;
+
+    private:
+        void update(double value, int64_t delta);
+        int bucket_of(double value) const { return static_cast<int>(std::ceil(std::log(value) * _inv_log_gamma)); }
+        double value_of(int bucket) const { return 2.0 * std::pow(_gamma, bucket) / (_gamma + 1.0); }
+
+        double _gamma;
+        double _inv_log_gamma;
+        std::vector<uint64_t> _buckets;     // _buckets[i] 对应第 _offset + i 个桶
+        int _offset;
+        uint64_t _zero_count;
+        uint64_t _count;
+};
+
+inline QuantileSketch::QuantileSketch(double relative_accuracy)
+    : _gamma(0), _inv_log_gamma(0), _offset(0), _zero_count(0), _count(0)
+{
+    if (!(relative_accuracy > 0 && relative_accuracy < 1)) throw std::invalid_argument("Invalid relative accuracy");
+
+    _gamma = (1 + relative_accuracy) / (1 - relative_accuracy);
+    _inv_log_gamma = 1.0 / std::log(_gamma);
+}
+
+inline void QuantileSketch::clear()
+{
+    _buckets.clear();
+    _offset = 0;
+    _zero_count = 0;
+    _count = 0;
+}
+
+inline void QuantileSketch::update(double value, int64_t delta)
+{
+    _count += delta;
+    if (!(value > 0)) {
+        _zero_count += delta;
+        return;
+    }
+
+    int bucket = bucket_of(value);
+    if (_buckets.empty()) {
+        _offset = bucket;
+        _buckets.push_back(0);
+    } else if (bucket < _offset) {
+        _buckets.insert(_buckets.begin(), _offset - bucket, 0);
+        _offset = bucket;
+    } else if (bucket >= _offset + static_cast<int>(_buckets.size())) {
+        _buckets.resize(bucket - _offset + 1, 0);
+    }
+    _buckets[bucket - _offset] += delta;
+}
+
+inline double QuantileSketch::quantile(double q) const
+{
+    if (_count == 0) return 0;
+    if (q < 0) q = 0;
+    if (q > 1) q = 1;
+
+    uint64_t rank = static_cast<uint64_t>(q * (_count - 1));
+    if (rank < _zero_count) return 0;
+
+    uint64_t seen = _zero_count;
+    for (size_t i = 0; i < _buckets.size(); ++i) {
+        seen += _buckets[i];
+        if (seen > rank) return value_of(_offset + static_cast<int>(i));
+    }
+    return value_of(_offset + static_cast<int>(_buckets.size()) - 1);
+}
+
+// 在 CircularBuffer 之上增量维护最近 window 个样本的统计量：
+// sum/mean/variance 为 O(1)，min/max 用单调队列为均摊 O(1)，分位数由 QuantileSketch 近似给出。
+// 方差用滑动 Welford 公式更新，每滑过一整个窗口重新精确计算一次，避免浮点误差累积
+template <typename T>
+class AggregatingCircularBuffer
+{
+    public:
+        typedef size_t size_type;
+
+        explicit AggregatingCircularBuffer(size_type window, double relative_accuracy = 0.01);
+
+        void add(const T& value);
+
+        size_type size() const { return _samples.size(); }
+        size_type capacity() const { return _samples.capacity(); }
+        const CircularBuffer<T>& samples() const { return _samples; }
+
+        double sum() const { return _sum; }
+        double mean() const { return _mean; }
+        // 总体方差
+        double variance() const { return size() == 0 ? 0 : _m2 / size(); }
+        // 为空时行为未定义
+        const T& min() const { return _min.front().second; }
+        const T& max() const { return _max.front().second; }
+        double quantile(double q) const { return _sketch.quantile(q); }
+
+    private:
+        typedef std::deque<std::pair<uint64_t, T>> monotonic_queue;
+
+        template <typename Compare>
+        void push_monotonic(monotonic_queue& queue, const T& value, Compare keep);
+        void recompute();
+
+        CircularBuffer<T> _samples;
+        QuantileSketch _sketch;
+        monotonic_queue _min;       // 值单调递增，队首为窗口最小值
+        monotonic_queue _max;       // 值单调递减，队首为窗口最大值
+        uint64_t _seq;              // 已加入的样本总数
+        double _sum;
+        double _mean;
+        double _m2;
+};
+
+template<typename T>
+AggregatingCircularBuffer<T>::AggregatingCircularBuffer(size_type window, double relative_accuracy)
+    : _samples(window), _sketch(relative_accuracy), _seq(0), _sum(0), _mean(0), _m2(0)
+{
+}
+
+template<typename T>
+template<typename Compare>
+void AggregatingCircularBuffer<T>::push_monotonic(monotonic_queue& queue, const T& value, Compare keep)
+{
+    // 队首的样本滑出窗口则丢弃
+    if (!queue.empty() && queue.front().first + _samples.capacity() <= _seq) queue.pop_front();
+    // 队尾中不可能再成为最值的样本丢弃
+    while (!queue.empty() && !keep(queue.back().second, value)) queue.pop_back();
+    queue.emplace_back(_seq, value);
+}
+
+template<typename T>
+void AggregatingCircularBuffer<T>::add(const T& value)
+{
+    double x = static_cast<double>(value);
+
+    if (_samples.is_full()) {
+        double y = static_cast<double>(_samples.unchecked_at(0));
+        double n = static_cast<double>(_samples.size());
+        double old_mean = _mean;
+
+        _sketch.remove(y);
+        _sum += x - y;
+        _mean += (x - y) / n;
+        _m2 += (x - y) * (x - _mean + y - old_mean);
+    } else {
+        double n = static_cast<double>(_samples.size() + 1);
+        double delta = x - _mean;
+
+        _sum += x;
+        _mean += delta / n;
+        _m2 += delta * (x - _mean);
+    }
+
+    _samples.push_back(value);
+    _sketch.add(x);
+
+    push_monotonic(_min, value, [](const T& kept, const T& v) { return kept < v; });
+    push_monotonic(_max, value, [](const T& kept, const T& v) { return kept > v; });
+    ++_seq;
+
+    if (_seq % _samples.capacity() == 0) recompute();
+}
+
+template<typename T>
+void AggregatingCircularBuffer<T>::recompute()
+{
+    auto spans = _samples.as_spans();
+
+    double sum = 0;
+    for (const T& v : spans.first) sum += static_cast<double>(v);
+    for (const T& v : spans.second) sum += static_cast<double>(v);
+
+    double mean = sum / _samples.size();
+    double m2 = 0;
+    for (const T& v : spans.first) m2 += (static_cast<double>(v) - mean) * (static_cast<double>(v) - mean);
+    for (const T& v : spans.second) m2 += (static_cast<double>(v) - mean) * (static_cast<double>(v) - mean);
+
+    _sum = sum;
+    _mean = mean;
+    _m2 = m2;
+}
+
+#endif // AGGREGATING_CIRCULAR_BUFFER_H
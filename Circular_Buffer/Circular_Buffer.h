@@ -6,8 +6,66 @@
 #include <cassert>
 #include <stdexcept>
 #include <iostream>
+#include <new>
+#include <utility>
 
-template <typename T>
+namespace circular_buffer_detail
+{
+    inline size_t round_up_pow2(size_t n)
+    {
+        size_t cap = 1;
+        while (cap < n) cap <<= 1;
+        return cap;
+    }
+
+    // 只分配按 T 对齐的原始内存，不构造任何元素
+    template <typename T>
+    T* allocate_storage(size_t count)
+    {
+        if (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(alignof(T))));
+        }
+        return static_cast<T*>(::operator new(count * sizeof(T)));
+    }
+
+    template <typename T>
+    void deallocate_storage(T* p)
+    {
+        if (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            ::operator delete(p, std::align_val_t(alignof(T)));
+        } else {
+            ::operator delete(p);
+        }
+    }
+}
+
+// 容量策略：决定实际容量以及如何把逻辑位置折回到 [0, capacity)
+// 传入 wrap 的位置总是小于 2 * capacity，因此 exact_capacity 用一次减法代替取模
+struct exact_capacity
+{
+    static size_t round(size_t capacity) { return capacity; }
+    static size_t wrap(size_t pos, size_t capacity) { return pos >= capacity ? pos - capacity : pos; }
+};
+
+// 容量向上取整为2的幂，下标用掩码计算
+struct pow2_capacity
+{
+    static size_t round(size_t capacity) { return circular_buffer_detail::round_up_pow2(capacity); }
+    static size_t wrap(size_t pos, size_t capacity) { return pos & (capacity - 1); }
+};
+
+// 一段连续内存的视图，用于 as_spans()
+template <typename Pointer>
+struct CircularBufferSpan
+{
+    Pointer data;
+    size_t size;
+
+    Pointer begin() const { return data; }
+    Pointer end() const { return data + size; }
+};
+
+template <typename T, typename CapacityPolicy = exact_capacity>
 class CircularBuffer
 {
     public:
@@ -16,6 +74,8 @@ class CircularBuffer
         typedef const T& const_reference;
         typedef T* pointer;
         typedef const T* const_pointer;
+        typedef CircularBufferSpan<pointer> span;
+        typedef CircularBufferSpan<const_pointer> const_span;
 
     private:
         pointer _buffer;
@@ -25,11 +85,11 @@ class CircularBuffer
 
     public:
         explicit CircularBuffer(size_type capacity);
-        CircularBuffer(const CircularBuffer<T> &rhs);
-        CircularBuffer(CircularBuffer<T>&& rhs);
-        ~CircularBuffer() { if (_buffer) delete[] _buffer; }
+        CircularBuffer(const CircularBuffer &rhs);
+        CircularBuffer(CircularBuffer&& rhs);
+        ~CircularBuffer();
 
-        CircularBuffer<T>& operator=(CircularBuffer<T> rhs);
+        CircularBuffer& operator=(CircularBuffer rhs);
 
         size_type size() const { return (_full ? _capacity : _front); }
         size_type capacity() const { return _capacity; }
@@ -38,10 +98,25 @@ class CircularBuffer
         const_reference operator[](size_type index) const;
         reference operator[](size_type index);
 
-        void add(T item);
+        // 不做边界检查，调用者保证 index < size()
+        const_reference unchecked_at(size_type index) const { return _buffer[CapacityPolicy::wrap(oldest() + index, _capacity)]; }
+        reference unchecked_at(size_type index) { return _buffer[CapacityPolicy::wrap(oldest() + index, _capacity)]; }
+
+        // 按从旧到新的顺序，把有效数据表示为至多两段连续内存，便于调用者写可向量化的循环
+        std::pair<const_span, const_span> as_spans() const;
+        std::pair<span, span> as_spans();
+
+        // 写满之后新元素覆盖最旧的元素
+        void add(T item) { push_back(std::move(item)); }
+        void push_back(const T& item);
+        void push_back(T&& item);
+        template <typename... Args>
+        reference emplace_back(Args&&... args);
+
+        void clear();
         void resize(size_type new_capacity);
 
-        friend void swap(CircularBuffer<T> &a, CircularBuffer<T> &b)
+        friend void swap(CircularBuffer &a, CircularBuffer &b)
         {
             std::swap(a._buffer, b._buffer);
             std::swap(a._capacity, b._capacity);
@@ -51,80 +126,170 @@ class CircularBuffer
 
     private:
         CircularBuffer();
+
+        // 最旧元素所在位置：写满之后是 _front，否则是 0。写成掩码形式以免分支
+        size_type oldest() const { return _front & (size_type(0) - size_type(_full)); }
+
+        void advance();
 };
 
-template<typename T>
-CircularBuffer<T>::CircularBuffer()
+template<typename T, typename CapacityPolicy>
+CircularBuffer<T, CapacityPolicy>::CircularBuffer()
     : _buffer(nullptr) , _capacity(0) , _front(0) , _full(false)
 {
 }
 
-template<typename T>
-CircularBuffer<T>::CircularBuffer(size_type capacity)
+template<typename T, typename CapacityPolicy>
+CircularBuffer<T, CapacityPolicy>::CircularBuffer(size_type capacity)
     : CircularBuffer()
 {
     if (capacity < 1) throw std::length_error("Invalid capacity");
 
-    _buffer = new T[capacity];
+    capacity = CapacityPolicy::round(capacity);
+    _buffer = circular_buffer_detail::allocate_storage<T>(capacity);
     _capacity = capacity;
 }
 
-template<typename T>
-CircularBuffer<T>::CircularBuffer(const CircularBuffer<T> &rhs)
-    : _buffer(new T[rhs._capacity]), _capacity(rhs._capacity), _front(rhs._front) , _full(rhs._full)
+// 只拷贝有效元素，并保持它们原来的物理位置
+template<typename T, typename CapacityPolicy>
+CircularBuffer<T, CapacityPolicy>::CircularBuffer(const CircularBuffer &rhs)
+    : _buffer(circular_buffer_detail::allocate_storage<T>(rhs._capacity)), _capacity(rhs._capacity), _front(0) , _full(false)
 {
-    std::copy(rhs._buffer, rhs._buffer + _capacity, _buffer);
+    size_type live = rhs.size();
+    size_type constructed = 0;
+    try {
+        for (; constructed < live; ++constructed) {
+            new (_buffer + constructed) T(rhs._buffer[constructed]);
+        }
+    } catch (...) {
+        for (size_type i = 0; i < constructed; ++i) _buffer[i].~T();
+        circular_buffer_detail::deallocate_storage(_buffer);
+        throw;
+    }
+    _front = rhs._front;
+    _full = rhs._full;
 }
 
-template<typename T>
-CircularBuffer<T>::CircularBuffer(CircularBuffer<T>&& rhs)
+template<typename T, typename CapacityPolicy>
+CircularBuffer<T, CapacityPolicy>::CircularBuffer(CircularBuffer&& rhs)
     : CircularBuffer()
 {
     swap(*this, rhs);
 }
 
-template<typename T>
-typename CircularBuffer<T>::const_reference CircularBuffer<T>::operator[](size_type index) const
+template<typename T, typename CapacityPolicy>
+CircularBuffer<T, CapacityPolicy>::~CircularBuffer()
+{
+    if (_buffer) {
+        clear();
+        circular_buffer_detail::deallocate_storage(_buffer);
+    }
+}
+
+template<typename T, typename CapacityPolicy>
+typename CircularBuffer<T, CapacityPolicy>::const_reference CircularBuffer<T, CapacityPolicy>::operator[](size_type index) const
 {
     static const std::out_of_range ex("index out of range");
-    if (index < 0) throw ex;
+    if (index >= size()) throw ex;
 
-    if (_full) {
-        if (index >= _capacity) throw ex;
-        return _buffer[(_front + index) % _capacity];
-    } else {
-        if (index >= _front) throw ex;
-        return _buffer[index];
+    return unchecked_at(index);
+}
+
+template<typename T, typename CapacityPolicy>
+typename CircularBuffer<T, CapacityPolicy>::reference CircularBuffer<T, CapacityPolicy>::operator[](size_type index)
+{
+    return const_cast<reference>(static_cast<const CircularBuffer&>(*this)[index]);
+}
+
+template<typename T, typename CapacityPolicy>
+std::pair<typename CircularBuffer<T, CapacityPolicy>::const_span, typename CircularBuffer<T, CapacityPolicy>::const_span>
+CircularBuffer<T, CapacityPolicy>::as_spans() const
+{
+    if (!_full) {
+        return std::make_pair(const_span{_buffer, _front}, const_span{_buffer, 0});
     }
+    return std::make_pair(const_span{_buffer + _front, _capacity - _front}, const_span{_buffer, _front});
 }
 
-template<typename T>
-typename CircularBuffer<T>::reference  CircularBuffer<T>::operator[](size_type index)
+template<typename T, typename CapacityPolicy>
+std::pair<typename CircularBuffer<T, CapacityPolicy>::span, typename CircularBuffer<T, CapacityPolicy>::span>
+CircularBuffer<T, CapacityPolicy>::as_spans()
 {
-    return const_cast<reference>(static_cast<const CircularBuffer<T>&>(*this)[index]);
+    if (!_full) {
+        return std::make_pair(span{_buffer, _front}, span{_buffer, 0});
+    }
+    return std::make_pair(span{_buffer + _front, _capacity - _front}, span{_buffer, _front});
 }
 
-template<typename T>
-CircularBuffer<T>&  CircularBuffer<T>::operator=(CircularBuffer<T> rhs)
+template<typename T, typename CapacityPolicy>
+CircularBuffer<T, CapacityPolicy>& CircularBuffer<T, CapacityPolicy>::operator=(CircularBuffer rhs)
 {
     swap(*this, rhs);
     return *this;
 }
 
-template<typename T>
-void CircularBuffer<T>::add(T item)
+template<typename T, typename CapacityPolicy>
+void CircularBuffer<T, CapacityPolicy>::advance()
 {
-    _buffer[_front++] = item;
-    if (_front == _capacity) {
+    if (++_front == _capacity) {
         _front = 0;
         _full = true;
     }
 }
 
-template<typename T>
-void CircularBuffer<T>::resize(size_type new_capacity)
+// 未写满时在空槽上原地构造；写满之后对最旧的元素赋值，可以复用其已有的资源(比如 string 的内存)
+template<typename T, typename CapacityPolicy>
+void CircularBuffer<T, CapacityPolicy>::push_back(const T& item)
+{
+    if (_full) {
+        _buffer[_front] = item;
+    } else {
+        new (_buffer + _front) T(item);
+    }
+    advance();
+}
+
+template<typename T, typename CapacityPolicy>
+void CircularBuffer<T, CapacityPolicy>::push_back(T&& item)
+{
+    if (_full) {
+        _buffer[_front] = std::move(item);
+    } else {
+        new (_buffer + _front) T(std::move(item));
+    }
+    advance();
+}
+
+template<typename T, typename CapacityPolicy>
+template<typename... Args>
+typename CircularBuffer<T, CapacityPolicy>::reference CircularBuffer<T, CapacityPolicy>::emplace_back(Args&&... args)
+{
+    pointer slot = _buffer + _front;
+    if (_full) {
+        *slot = T(std::forward<Args>(args)...);
+    } else {
+        new (slot) T(std::forward<Args>(args)...);
+    }
+    advance();
+    return *slot;
+}
+
+template<typename T, typename CapacityPolicy>
+void CircularBuffer<T, CapacityPolicy>::clear()
+{
+    size_type live = size();
+    for (size_type i = 0; i < live; ++i) {
+        _buffer[i].~T();
+    }
+    _front = 0;
+    _full = false;
+}
+
+template<typename T, typename CapacityPolicy>
+void CircularBuffer<T, CapacityPolicy>::resize(size_type new_capacity)
 {
     if (new_capacity < 1) throw std::length_error("Invalid capacity");
+    new_capacity = CapacityPolicy::round(new_capacity);
     if (new_capacity == _capacity) return;
 
     size_type num_items = size();
@@ -134,19 +299,26 @@ void CircularBuffer<T>::resize(size_type new_capacity)
         num_items = new_capacity;
     }
 
-    pointer new_buffer = new T[new_capacity];
-    for (size_type item_no = 0; item_no < num_items; ++item_no) {
-        new_buffer[item_no] = (*this)[item_no + offset];
+    // 元素的移动构造不抛异常时按移动处理，否则退回拷贝，保证失败时原缓冲区不变
+    pointer new_buffer = circular_buffer_detail::allocate_storage<T>(new_capacity);
+    size_type constructed = 0;
+    try {
+        for (; constructed < num_items; ++constructed) {
+            new (new_buffer + constructed) T(std::move_if_noexcept(unchecked_at(constructed + offset)));
+        }
+    } catch (...) {
+        for (size_type i = 0; i < constructed; ++i) new_buffer[i].~T();
+        circular_buffer_detail::deallocate_storage(new_buffer);
+        throw;
     }
 
-    pointer old_buffer = _buffer;
+    clear();
+    circular_buffer_detail::deallocate_storage(_buffer);
 
     _buffer = new_buffer;
     _capacity = new_capacity;
     _front = (num_items % _capacity);
     _full = (num_items == _capacity);
-
-    delete[] old_buffer;
 }
 
-#endif // CIRCULAR_BUFFER_H
\ No newline at end of file
+#endif // CIRCULAR_BUFFER_H
@@ -0,0 +1,312 @@
+#ifndef CONCURRENT_CIRCULAR_BUFFER_H
+#define CONCURRENT_CIRCULAR_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "Circular_Buffer.h"
+
+#ifndef CIRCULAR_BUFFER_CACHE_LINE
+#define CIRCULAR_BUFFER_CACHE_LINE 64
+#endif
+
+// 单生产者/单消费者无锁环形队列
+// head 只由消费者写，tail 只由生产者写，两者放在不同的缓存行上避免伪共享；
+// 各自缓存一份对方的索引，只有在看起来满/空时才重新读取对方的原子变量
+template <typename T>
+class SpscCircularBuffer
+{
+    public:
+        typedef size_t size_type;
+        typedef T value_type;
+
+    private:
+        typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_type;
+
+        storage_type* _buffer;
+        size_type _capacity;
+        size_type _mask;
+
+        alignas(CIRCULAR_BUFFER_CACHE_LINE) std::atomic<size_type> _head;
+        size_type _cached_tail;
+
+        alignas(CIRCULAR_BUFFER_CACHE_LINE) std::atomic<size_type> _tail;
+        size_type _cached_head;
+
+    public:
+        // 容量向上取整为2的幂，下标用掩码计算
+        explicit SpscCircularBuffer(size_type capacity);
+        ~SpscCircularBuffer();
+
+        SpscCircularBuffer(const SpscCircularBuffer&) = delete;
+        SpscCircularBuffer& operator=(const SpscCircularBuffer&) = delete;
+
+        size_type capacity() const { return _capacity; }
+        // 并发使用时只是一个近似值
+        size_type size() const { return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire); }
+        bool empty() const { return size() == 0; }
+
+        // 只能在生产者线程调用
+        bool try_push(const T& item) { return emplace(item); }
+        bool try_push(T&& item) { return emplace(std::move(item)); }
+        template <typename... Args>
+        bool emplace(Args&&... args);
+        size_type try_push_n(const T* items, size_type count);
+
+        // 只能在消费者线程调用
+        bool try_pop(T& item);
+        size_type try_pop_n(T* items, size_type count);
+
+    private:
+        T* slot(size_type index) { return reinterpret_cast<T*>(&_buffer[index & _mask]); }
+};
+
+template<typename T>
+SpscCircularBuffer<T>::SpscCircularBuffer(size_type capacity)
+    : _buffer(nullptr), _capacity(0), _mask(0), _head(0), _cached_tail(0), _tail(0), _cached_head(0)
+{
+    if (capacity < 1) throw std::length_error("Invalid capacity");
+
+    _capacity = circular_buffer_detail::round_up_pow2(capacity);
+    _mask = _capacity - 1;
+    _buffer = new storage_type[_capacity];
+}
+
+template<typename T>
+SpscCircularBuffer<T>::~SpscCircularBuffer()
+{
+    size_type head = _head.load(std::memory_order_relaxed);
+    size_type tail = _tail.load(std::memory_order_relaxed);
+    for (; head != tail; ++head) {
+        slot(head)->~T();
+    }
+    delete[] _buffer;
+}
+
+template<typename T>
+template<typename... Args>
+bool SpscCircularBuffer<T>::emplace(Args&&... args)
+{
+    size_type tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _cached_head == _capacity) {
+        _cached_head = _head.load(std::memory_order_acquire);
+        if (tail - _cached_head == _capacity) return false;
+    }
+
+    new (slot(tail)) T(std::forward<Args>(args)...);
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+typename SpscCircularBuffer<T>::size_type SpscCircularBuffer<T>::try_push_n(const T* items, size_type count)
+{
+    size_type tail = _tail.load(std::memory_order_relaxed);
+    size_type free_slots = _capacity - (tail - _cached_head);
+    if (free_slots < count) {
+        _cached_head = _head.load(std::memory_order_acquire);
+        free_slots = _capacity - (tail - _cached_head);
+    }
+
+    size_type n = count < free_slots ? count : free_slots;
+    for (size_type i = 0; i < n; ++i) {
+        new (slot(tail + i)) T(items[i]);
+    }
+
+    // 整批只发布一次
+    if (n > 0) _tail.store(tail + n, std::memory_order_release);
+    return n;
+}
+
+template<typename T>
+bool SpscCircularBuffer<T>::try_pop(T& item)
+{
+    size_type head = _head.load(std::memory_order_relaxed);
+    if (head == _cached_tail) {
+        _cached_tail = _tail.load(std::memory_order_acquire);
+        if (head == _cached_tail) return false;
+    }
+
+    T* p = slot(head);
+    item = std::move(*p);
+    p->~T();
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+typename SpscCircularBuffer<T>::size_type SpscCircularBuffer<T>::try_pop_n(T* items, size_type count)
+{
+    size_type head = _head.load(std::memory_order_relaxed);
+    size_type available = _cached_tail - head;
+    if (available < count) {
+        _cached_tail = _tail.load(std::memory_order_acquire);
+        available = _cached_tail - head;
+    }
+
+    size_type n = count < available ? count : available;
+    for (size_type i = 0; i < n; ++i) {
+        T* p = slot(head + i);
+        items[i] = std::move(*p);
+        p->~T();
+    }
+
+    if (n > 0) _head.store(head + n, std::memory_order_release);
+    return n;
+}
+
+// 有界多生产者/多消费者无锁环形队列(每个槽位带序号)
+// 槽位序号等于 pos 表示可写，等于 pos + 1 表示可读；生产者/消费者各自用 CAS 抢占位置，
+// 抢到之后只和该槽位的序号同步，不同槽位上的读写互不干扰
+template <typename T>
+class MpmcCircularBuffer
+{
+    public:
+        typedef size_t size_type;
+        typedef T value_type;
+
+    private:
+        struct cell
+        {
+            std::atomic<size_type> sequence;
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+            T* value() { return reinterpret_cast<T*>(&storage); }
+        };
+
+        cell* _buffer;
+        size_type _capacity;
+        size_type _mask;
+
+        alignas(CIRCULAR_BUFFER_CACHE_LINE) std::atomic<size_type> _enqueue_pos;
+        alignas(CIRCULAR_BUFFER_CACHE_LINE) std::atomic<size_type> _dequeue_pos;
+        char _pad[CIRCULAR_BUFFER_CACHE_LINE - sizeof(std::atomic<size_type>)];
+
+    public:
+        // 容量向上取整为2的幂，且至少为2
+        explicit MpmcCircularBuffer(size_type capacity);
+        ~MpmcCircularBuffer();
+
+        MpmcCircularBuffer(const MpmcCircularBuffer&) = delete;
+        MpmcCircularBuffer& operator=(const MpmcCircularBuffer&) = delete;
+
+        size_type capacity() const { return _capacity; }
+        // 并发使用时只是一个近似值
+        size_type size() const;
+        bool empty() const { return size() == 0; }
+
+        bool try_push(const T& item) { return emplace(item); }
+        bool try_push(T&& item) { return emplace(std::move(item)); }
+        template <typename... Args>
+        bool emplace(Args&&... args);
+        size_type try_push_n(const T* items, size_type count);
+
+        bool try_pop(T& item);
+        size_type try_pop_n(T* items, size_type count);
+};
+
+template<typename T>
+MpmcCircularBuffer<T>::MpmcCircularBuffer(size_type capacity)
+    : _buffer(nullptr), _capacity(0), _mask(0), _enqueue_pos(0), _dequeue_pos(0)
+{
+    if (capacity < 1) throw std::length_error("Invalid capacity");
+
+    _capacity = circular_buffer_detail::round_up_pow2(capacity < 2 ? 2 : capacity);
+    _mask = _capacity - 1;
+    _buffer = new cell[_capacity];
+    for (size_type i = 0; i < _capacity; ++i) {
+        _buffer[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+template<typename T>
+MpmcCircularBuffer<T>::~MpmcCircularBuffer()
+{
+    size_type pos = _dequeue_pos.load(std::memory_order_relaxed);
+    size_type end = _enqueue_pos.load(std::memory_order_relaxed);
+    for (; pos != end; ++pos) {
+        _buffer[pos & _mask].value()->~T();
+    }
+    delete[] _buffer;
+}
+
+template<typename T>
+typename MpmcCircularBuffer<T>::size_type MpmcCircularBuffer<T>::size() const
+{
+    size_type head = _dequeue_pos.load(std::memory_order_acquire);
+    size_type tail = _enqueue_pos.load(std::memory_order_acquire);
+    return tail > head ? tail - head : 0;
+}
+
+template<typename T>
+template<typename... Args>
+bool MpmcCircularBuffer<T>::emplace(Args&&... args)
+{
+    cell* c;
+    size_type pos = _enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+        c = &_buffer[pos & _mask];
+        size_type seq = c->sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t dif = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+        if (dif == 0) {
+            if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            return false;   // 队列已满
+        } else {
+            pos = _enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    new (c->value()) T(std::forward<Args>(args)...);
+    c->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool MpmcCircularBuffer<T>::try_pop(T& item)
+{
+    cell* c;
+    size_type pos = _dequeue_pos.load(std::memory_order_relaxed);
+    while (true) {
+        c = &_buffer[pos & _mask];
+        size_type seq = c->sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t dif = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+        if (dif == 0) {
+            if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            return false;   // 队列为空
+        } else {
+            pos = _dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    T* p = c->value();
+    item = std::move(*p);
+    p->~T();
+    c->sequence.store(pos + _mask + 1, std::memory_order_release);
+    return true;
+}
+
+// MPMC 的批量操作逐个抢占槽位：一次 CAS 抢占连续多个槽位需要同时确认它们都已就绪，
+// 在有竞争时反而更容易失败
+template<typename T>
+typename MpmcCircularBuffer<T>::size_type MpmcCircularBuffer<T>::try_push_n(const T* items, size_type count)
+{
+    size_type n = 0;
+    while (n < count && try_push(items[n])) ++n;
+    return n;
+}
+
+template<typename T>
+typename MpmcCircularBuffer<T>::size_type MpmcCircularBuffer<T>::try_pop_n(T* items, size_type count)
+{
+    size_type n = 0;
+    while (n < count && try_pop(items[n])) ++n;
+    return n;
+}
+
+#endif // CONCURRENT_CIRCULAR_BUFFER_H
@@ -0,0 +1,177 @@
+#ifndef MIRRORED_BYTE_BUFFER_H
+#define MIRRORED_BYTE_BUFFER_H
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <utility>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "Circular_Buffer.h"
+
+// 字节环形缓冲区：把同一块物理内存(memfd)连续映射两次，
+// 从任意位置开始的至多 capacity 字节在虚拟地址上都是连续的，
+// 因此可读区和可写区永远各是一整段，可以直接交给 recv/send/writev，不需要在回绕点拆分或拷贝。
+// 与 CircularBuffer 一样只供单线程使用
+class MirroredByteBuffer
+{
+    public:
+        typedef size_t size_type;
+        typedef CircularBufferSpan<char*> span;
+        typedef CircularBufferSpan<const char*> const_span;
+
+    private:
+        char* _base;
+        size_type _capacity;
+        size_type _read;      // 单调递增的读位置
+        size_type _write;     // 单调递增的写位置
+
+    public:
+        // 容量向上取整为页大小的2的幂倍
+        explicit MirroredByteBuffer(size_type capacity);
+        MirroredByteBuffer(MirroredByteBuffer&& rhs);
+        ~MirroredByteBuffer();
+
+        MirroredByteBuffer(const MirroredByteBuffer&) = delete;
+        MirroredByteBuffer& operator=(const MirroredByteBuffer&) = delete;
+
+        size_type size() const { return _write - _read; }
+        size_type capacity() const { return _capacity; }
+        size_type free_space() const { return _capacity - size(); }
+        bool empty() const { return _write == _read; }
+        bool is_full() const { return size() == _capacity; }
+
+        // 可读区域：从最旧的字节开始的 size() 字节
+        const_span read_span() const { return const_span{_base + (_read & (_capacity - 1)), size()}; }
+        // 可写区域：紧接在最新字节之后的 free_space() 字节
+        span write_span() { return span{_base + (_write & (_capacity - 1)), free_space()}; }
+
+        // 直接写入 write_span() 之后，提交 n 个字节
+        void commit(size_type n) { _write += n; }
+        // 读取 read_span() 之后，丢弃 n 个字节
+        void consume(size_type n) { _read += n; }
+
+        // 拷贝写入/读出，返回实际处理的字节数
+        size_type write(const void* data, size_type n);
+        size_type read(void* data, size_type n);
+
+        // 把可读区域描述为一个 iovec，便于与其他内存块一起 writev
+        struct iovec read_iovec() const;
+
+        // 从 fd 读数据直接写入环中；返回值与 recv 相同，0 只表示对端关闭了连接。
+        // 缓冲区满时不调用 recv，返回 -1 且 errno 为 ENOBUFS，调用者应先 consume 再读
+        ssize_t recv_from(int fd, int flags = 0);
+        // 把环中的数据直接发送到 fd，成功发送的部分被丢弃；返回值与 send 相同
+        ssize_t send_to(int fd, int flags = MSG_NOSIGNAL);
+};
+
+inline MirroredByteBuffer::MirroredByteBuffer(size_type capacity)
+    : _base(nullptr), _capacity(0), _read(0), _write(0)
+{
+    if (capacity < 1) throw std::length_error("Invalid capacity");
+
+    size_type page = static_cast<size_type>(sysconf(_SC_PAGESIZE));
+    size_type pages = circular_buffer_detail::round_up_pow2((capacity + page - 1) / page);
+    _capacity = pages * page;
+
+    int fd = memfd_create("circular_buffer", MFD_CLOEXEC);
+    if (fd == -1) throw std::system_error(errno, std::generic_category(), "memfd_create");
+
+    if (ftruncate(fd, _capacity) == -1) {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), "ftruncate");
+    }
+
+    // 先保留 2 * capacity 的地址空间，再把同一个文件固定映射到前后两半
+    void* reserved = mmap(nullptr, 2 * _capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED) {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), "mmap");
+    }
+
+    char* base = static_cast<char*>(reserved);
+    void* first = mmap(base, _capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    void* second = first == MAP_FAILED ? MAP_FAILED :
+            mmap(base + _capacity, _capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    int err = errno;
+    close(fd);
+
+    if (second == MAP_FAILED) {
+        munmap(base, 2 * _capacity);
+        throw std::system_error(err, std::generic_category(), "mmap");
+    }
+
+    _base = base;
+}
+
+inline MirroredByteBuffer::MirroredByteBuffer(MirroredByteBuffer&& rhs)
+    : _base(rhs._base), _capacity(rhs._capacity), _read(rhs._read), _write(rhs._write)
+{
+    rhs._base = nullptr;
+    rhs._capacity = 0;
+    rhs._read = rhs._write = 0;
+}
+
+inline MirroredByteBuffer::~MirroredByteBuffer()
+{
+    if (_base) munmap(_base, 2 * _capacity);
+}
+
+inline MirroredByteBuffer::size_type MirroredByteBuffer::write(const void* data, size_type n)
+{
+    span w = write_span();
+    if (n > w.size) n = w.size;
+    memcpy(w.data, data, n);
+    commit(n);
+    return n;
+}
+
+inline MirroredByteBuffer::size_type MirroredByteBuffer::read(void* data, size_type n)
+{
+    const_span r = read_span();
+    if (n > r.size) n = r.size;
+    memcpy(data, r.data, n);
+    consume(n);
+    return n;
+}
+
+inline struct iovec MirroredByteBuffer::read_iovec() const
+{
+    const_span r = read_span();
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(r.data);
+    iov.iov_len = r.size;
+    return iov;
+}
+
+inline ssize_t MirroredByteBuffer::recv_from(int fd, int flags)
+{
+    span w = write_span();
+    if (w.size == 0) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    ssize_t n = recv(fd, w.data, w.size, flags);
+    if (n > 0) commit(static_cast<size_type>(n));
+    return n;
+}
+
+inline ssize_t MirroredByteBuffer::send_to(int fd, int flags)
+{
+    const_span r = read_span();
+    if (r.size == 0) return 0;
+
+    ssize_t n = send(fd, r.data, r.size, flags);
+    if (n > 0) consume(static_cast<size_type>(n));
+    return n;
+}
+
+#endif // MIRRORED_BYTE_BUFFER_H
@@ -0,0 +1,112 @@
+#ifndef TIME_BUCKETED_COUNTER_H
+#define TIME_BUCKETED_COUNTER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+
+#include "Circular_Buffer.h"
+
+// 按时间分桶的滑动窗口计数器，用于每秒/每分钟请求数统计和限流
+// 第 e 个时间片(e = 时钟读数 / bucket_width)落在第 e & (bucket_count - 1) 个桶。
+// 每个桶是一个 64 位原子变量，高 32 位是时间片编号，低 32 位是计数；
+// 不需要后台线程推进时间，写入时发现桶里的编号过期就地重置，读取时忽略编号不在窗口内的桶。
+// 写入用 CAS 循环，多个线程可以并发写，也可以与读并发
+// 时间片编号只保存低 32 位，同一个桶超过 2^32 个时间片不被写入时可能误判为未过期
+template <typename Clock = std::chrono::steady_clock>
+class TimeBucketedCounter
+{
+    public:
+        typedef size_t size_type;
+        typedef typename Clock::duration duration;
+        typedef typename Clock::time_point time_point;
+
+        // 桶数向上取整为2的幂
+        TimeBucketedCounter(duration bucket_width, size_type bucket_count);
+
+        TimeBucketedCounter(const TimeBucketedCounter&) = delete;
+        TimeBucketedCounter& operator=(const TimeBucketedCounter&) = delete;
+
+        duration bucket_width() const { return _bucket_width; }
+        size_type bucket_count() const { return _buckets.capacity(); }
+
+        void add(uint32_t n = 1) { add_at(Clock::now(), n); }
+        void add_at(time_point now, uint32_t n = 1);
+
+        // 最近 buckets 个时间片(含当前这个未结束的时间片)的计数之和，buckets 不超过 bucket_count()
+        uint64_t sum(size_type buckets) const { return sum_at(Clock::now(), buckets); }
+        uint64_t sum_at(time_point now, size_type buckets) const;
+
+    private:
+        // CircularBuffer 要求元素可拷贝，给原子变量包一层拷贝语义；只在构造时用到
+        struct cell
+        {
+            std::atomic<uint64_t> value;
+
+            explicit cell(uint64_t v) : value(v) {}
+            cell(const cell& rhs) : value(rhs.value.load(std::memory_order_relaxed)) {}
+            cell& operator=(const cell& rhs) { value.store(rhs.value.load(std::memory_order_relaxed), std::memory_order_relaxed); return *this; }
+        };
+
+        static uint64_t pack(uint32_t epoch, uint32_t count) { return (uint64_t(epoch) << 32) | count; }
+        static uint32_t epoch_of(uint64_t bucket) { return uint32_t(bucket >> 32); }
+        static uint32_t count_of(uint64_t bucket) { return uint32_t(bucket); }
+
+        uint32_t epoch_at(time_point now) const { return uint32_t(now.time_since_epoch() / _bucket_width); }
+        const std::atomic<uint64_t>& bucket(uint32_t epoch) const { return _buckets.unchecked_at(epoch & (bucket_count() - 1)).value; }
+        std::atomic<uint64_t>& bucket(uint32_t epoch) { return _buckets.unchecked_at(epoch & (bucket_count() - 1)).value; }
+
+        duration _bucket_width;
+        CircularBuffer<cell, pow2_capacity> _buckets;
+};
+
+template<typename Clock>
+TimeBucketedCounter<Clock>::TimeBucketedCounter(duration bucket_width, size_type bucket_count)
+    : _bucket_width(bucket_width), _buckets(bucket_count)
+{
+    if (bucket_width <= duration::zero()) throw std::invalid_argument("Invalid bucket width");
+
+    // 写满之后 unchecked_at(i) 就是第 i 个物理槽位
+    for (size_type i = 0; i < _buckets.capacity(); ++i) {
+        _buckets.emplace_back(pack(0, 0));
+    }
+}
+
+template<typename Clock>
+void TimeBucketedCounter<Clock>::add_at(time_point now, uint32_t n)
+{
+    uint32_t epoch = epoch_at(now);
+    std::atomic<uint64_t>& b = bucket(epoch);
+
+    uint64_t old = b.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+        uint32_t current = epoch_of(old);
+        // 编号更新的情况：本线程读时钟之后被调度出去，桶已经被后面的时间片占用，计入新的时间片；
+        // 计数为 0 的桶(包括刚构造的)不带任何信息，直接重置
+        if (count_of(old) != 0 && (current == epoch || int32_t(current - epoch) > 0)) {
+            // 计数饱和，不能进位到编号里
+            uint32_t count = count_of(old);
+            next = pack(current, count > UINT32_MAX - n ? UINT32_MAX : count + n);
+        } else {
+            next = pack(epoch, n);
+        }
+    } while (!b.compare_exchange_weak(old, next, std::memory_order_relaxed));
+}
+
+template<typename Clock>
+uint64_t TimeBucketedCounter<Clock>::sum_at(time_point now, size_type buckets) const
+{
+    if (buckets > bucket_count()) throw std::out_of_range("window longer than the ring");
+
+    uint32_t epoch = epoch_at(now);
+    uint64_t total = 0;
+    for (size_type i = 0; i < buckets; ++i) {
+        uint64_t b = bucket(epoch - uint32_t(i)).load(std::memory_order_relaxed);
+        if (epoch_of(b) == epoch - uint32_t(i)) total += count_of(b);
+    }
+    return total;
+}
+
+#endif // TIME_BUCKETED_COUNTER_H
@@ -0,0 +1,549 @@
+#include "Circular_Buffer.h"
+#include "Concurrent_Circular_Buffer.h"
+#include "Mirrored_Byte_Buffer.h"
+#include "Aggregating_Circular_Buffer.h"
+#include "Time_Bucketed_Counter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock clock_type;
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now().time_since_epoch()).count();
+}
+
+// 对照组：互斥锁保护的 std::deque
+template <typename T>
+class MutexDeque
+{
+    public:
+        explicit MutexDeque(size_t capacity) : _capacity(capacity) {}
+
+        bool try_push(const T& item)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_items.size() >= _capacity) return false;
+            _items.push_back(item);
+            return true;
+        }
+
+        bool try_pop(T& item)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_items.empty()) return false;
+            item = _items.front();
+            _items.pop_front();
+            return true;
+        }
+
+        size_t try_push_n(const T* items, size_t count)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            size_t n = std::min(count, _capacity - _items.size());
+            _items.insert(_items.end(), items, items + n);
+            return n;
+        }
+
+        size_t try_pop_n(T* items, size_t count)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            size_t n = std::min(count, _items.size());
+            std::copy(_items.begin(), _items.begin() + n, items);
+            _items.erase(_items.begin(), _items.begin() + n);
+            return n;
+        }
+
+    private:
+        size_t _capacity;
+        std::mutex _mutex;
+        std::deque<T> _items;
+};
+
+// 每个元素是入队时的时间戳，消费者据此统计排队延迟；batch 为 1 时使用单元素接口
+template <typename Queue>
+void run(const char* name, int producers, int consumers, size_t batch)
+{
+    const int64_t per_producer = 2000000;
+    const int64_t total = per_producer * producers;
+    Queue q(4096);
+    std::atomic<int64_t> consumed(0);
+    std::vector<std::vector<int64_t>> latencies(consumers);
+
+    int64_t start = now_ns();
+    std::vector<std::thread> threads;
+
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&] {
+            std::vector<int64_t> items(batch);
+            for (int64_t sent = 0; sent < per_producer; ) {
+                size_t want = (size_t)std::min<int64_t>(batch, per_producer - sent);
+                int64_t ts = now_ns();
+                size_t n;
+                if (batch == 1) {
+                    n = q.try_push(ts) ? 1 : 0;
+                } else {
+                    std::fill(items.begin(), items.begin() + want, ts);
+                    n = q.try_push_n(items.data(), want);
+                }
+                if (n == 0) std::this_thread::yield();
+                sent += n;
+            }
+        });
+    }
+
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back([&, c] {
+            std::vector<int64_t> items(batch);
+            std::vector<int64_t>& samples = latencies[c];
+            uint64_t seq = 0;
+            while (consumed.load(std::memory_order_relaxed) < total) {
+                size_t n = batch == 1 ? (q.try_pop(items[0]) ? 1 : 0) : q.try_pop_n(items.data(), batch);
+                if (n == 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                int64_t now = now_ns();
+                for (size_t i = 0; i < n; ++i) {
+                    if ((seq++ & 63) == 0) samples.push_back(now - items[i]);
+                }
+                consumed.fetch_add(n, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    for (auto& t : threads) t.join();
+    double seconds = (now_ns() - start) / 1e9;
+
+    std::vector<int64_t> all;
+    for (auto& l : latencies) all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+    int64_t p50 = all.empty() ? 0 : all[all.size() / 2];
+    int64_t p99 = all.empty() ? 0 : all[all.size() * 99 / 100];
+
+    printf("%-12s %dP/%dC batch=%-3zu %8.2f Mops/s  p50=%8lld ns  p99=%10lld ns\n",
+            name, producers, consumers, batch, total / seconds / 1e6, (long long)p50, (long long)p99);
+}
+
+// 滑动窗口场景：每来一个样本就对整个窗口求和
+template <typename Buffer, typename Scan>
+void run_window(const char* name, size_t window, Scan scan)
+{
+    Buffer cb(window);
+    for (size_t i = 0; i < cb.capacity(); ++i) cb.add(int(i));
+
+    const int samples = 2000;
+    int64_t sum = 0;
+    int64_t start = now_ns();
+    for (int i = 0; i < samples; ++i) {
+        cb.add(i);
+        sum += scan(cb);
+    }
+    double ns = double(now_ns() - start);
+
+    printf("%-26s window=%-8zu %8.3f ns/element  (checksum %lld)\n",
+            name, cb.capacity(), ns / (double(samples) * cb.size()), (long long)sum);
+}
+
+template <typename Buffer>
+int64_t scan_indexed(const Buffer& cb)
+{
+    int64_t sum = 0;
+    for (size_t i = 0; i < cb.size(); ++i) sum += cb[i];
+    return sum;
+}
+
+template <typename Buffer>
+int64_t scan_unchecked(const Buffer& cb)
+{
+    int64_t sum = 0;
+    for (size_t i = 0; i < cb.size(); ++i) sum += cb.unchecked_at(i);
+    return sum;
+}
+
+template <typename Buffer>
+int64_t scan_spans(const Buffer& cb)
+{
+    auto spans = cb.as_spans();
+    int64_t sum = 0;
+    for (int v : spans.first) sum += v;
+    for (int v : spans.second) sum += v;
+    return sum;
+}
+
+void run_windows()
+{
+    typedef CircularBuffer<int, exact_capacity> exact_buffer;
+    typedef CircularBuffer<int, pow2_capacity> pow2_buffer;
+
+    for (size_t window : {1024, 65536}) {
+        run_window<exact_buffer>("exact operator[]", window, scan_indexed<exact_buffer>);
+        run_window<pow2_buffer>("pow2 operator[]", window, scan_indexed<pow2_buffer>);
+        run_window<exact_buffer>("exact unchecked_at", window, scan_unchecked<exact_buffer>);
+        run_window<pow2_buffer>("pow2 unchecked_at", window, scan_unchecked<pow2_buffer>);
+        run_window<pow2_buffer>("as_spans", window, scan_spans<pow2_buffer>);
+    }
+}
+
+// socket 暂存区场景：另一个线程经 socketpair 发送数据，本线程收进环形缓冲区，再把可读数据整块取出
+template <typename Stage>
+void run_staging(const char* name, Stage stage)
+{
+    const size_t total = size_t(256) << 20;
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return;
+
+    std::thread writer([&] {
+        std::vector<char> chunk(64 * 1024, 'x');
+        for (size_t sent = 0; sent < total; ) {
+            ssize_t n = send(fds[0], chunk.data(), std::min(chunk.size(), total - sent), 0);
+            if (n <= 0) break;
+            sent += n;
+        }
+    });
+
+    int64_t start = now_ns();
+    size_t received = stage(fds[1], total);
+    double seconds = (now_ns() - start) / 1e9;
+    writer.join();
+    close(fds[0]);
+    close(fds[1]);
+
+    printf("%-26s %8.1f MB/s  (%zu bytes)\n", name, received / seconds / 1e6, received);
+}
+
+void run_stagings()
+{
+    const size_t ring_size = 64 * 1024;
+
+    // 现有做法：recv 到临时缓冲区，逐字节 add 进 CircularBuffer<char>，再按两段拷贝出来
+    run_staging("CircularBuffer<char>::add", [&](int fd, size_t total) {
+        CircularBuffer<char> ring(ring_size);
+        std::vector<char> tmp(ring_size), out(ring_size);
+        size_t received = 0;
+        while (received < total) {
+            ssize_t n = recv(fd, tmp.data(), tmp.size(), 0);
+            if (n <= 0) break;
+            for (ssize_t i = 0; i < n; ++i) ring.add(tmp[i]);
+            auto spans = ring.as_spans();
+            memcpy(out.data(), spans.first.data, spans.first.size);
+            memcpy(out.data() + spans.first.size, spans.second.data, spans.second.size);
+            received += n;
+        }
+        return received;
+    });
+
+    // 镜像环：直接 recv 进可写区，再整段读出
+    run_staging("MirroredByteBuffer", [&](int fd, size_t total) {
+        MirroredByteBuffer ring(ring_size);
+        std::vector<char> out(ring.capacity());
+        size_t received = 0;
+        while (received < total) {
+            ssize_t n = ring.recv_from(fd);
+            if (n <= 0) break;
+            received += n;
+            ring.read(out.data(), ring.size());
+        }
+        return received;
+    });
+}
+
+// 对照组：改造前的 CircularBuffer 存储方式，new T[capacity] 默认构造所有槽位，
+// add 按值传参再拷贝赋值，resize 逐个拷贝
+template <typename T>
+class LegacyCircularBuffer
+{
+    public:
+        explicit LegacyCircularBuffer(size_t capacity) : _buffer(new T[capacity]), _capacity(capacity), _front(0), _full(false) {}
+        ~LegacyCircularBuffer() { delete[] _buffer; }
+
+        size_t size() const { return _full ? _capacity : _front; }
+        const T& operator[](size_t index) const { return _buffer[((_full ? _front : 0) + index) % _capacity]; }
+
+        void add(T item)
+        {
+            _buffer[_front++] = item;
+            if (_front == _capacity) {
+                _front = 0;
+                _full = true;
+            }
+        }
+
+        void resize(size_t new_capacity)
+        {
+            size_t num_items = std::min(size(), new_capacity);
+            size_t offset = size() - num_items;
+            T* new_buffer = new T[new_capacity];
+            for (size_t i = 0; i < num_items; ++i) new_buffer[i] = (*this)[i + offset];
+            delete[] _buffer;
+            _buffer = new_buffer;
+            _capacity = new_capacity;
+            _front = num_items % _capacity;
+            _full = num_items == _capacity;
+        }
+
+    private:
+        T* _buffer;
+        size_t _capacity;
+        size_t _front;
+        bool _full;
+};
+
+struct Payload1K
+{
+    char data[1024];
+};
+
+// 构造缓冲区、写入 rounds 圈、最后扩容一次，统计每个元素的平均开销
+template <typename Buffer, typename Make, typename Push>
+void run_payload(const char* name, Make make, Push push)
+{
+    const size_t capacity = 4096;
+    const size_t rounds = 8;
+
+    int64_t start = now_ns();
+    {
+        Buffer cb(capacity);
+        for (size_t i = 0; i < capacity * rounds; ++i) push(cb, make(i));
+        cb.resize(capacity * 2);
+    }
+    double ns = double(now_ns() - start);
+
+    printf("%-34s %8.1f ns/element\n", name, ns / (capacity * rounds));
+}
+
+void run_payloads()
+{
+    auto make_string = [](size_t i) { return std::string(48, char('a' + i % 26)); };
+    auto make_payload = [](size_t i) { Payload1K p; memset(p.data, int(i), sizeof(p.data)); return p; };
+
+    run_payload<LegacyCircularBuffer<std::string>>("legacy add(std::string)", make_string,
+            [](LegacyCircularBuffer<std::string>& cb, std::string s) { cb.add(s); });
+    run_payload<CircularBuffer<std::string>>("push_back(std::string&&)", make_string,
+            [](CircularBuffer<std::string>& cb, std::string s) { cb.push_back(std::move(s)); });
+
+    run_payload<LegacyCircularBuffer<Payload1K>>("legacy add(Payload1K)", make_payload,
+            [](LegacyCircularBuffer<Payload1K>& cb, const Payload1K& p) { cb.add(p); });
+    run_payload<CircularBuffer<Payload1K>>("emplace_back(Payload1K)", make_payload,
+            [](CircularBuffer<Payload1K>& cb, const Payload1K& p) { cb.emplace_back(p); });
+}
+
+// 滚动指标场景：每来一个延迟样本，查询一次 sum/mean/variance/min/max/p50/p99
+struct WindowStats
+{
+    double sum, mean, variance, min, max, p50, p99;
+};
+
+// 对照组：每次查询都遍历整个窗口，分位数用 nth_element 求精确值
+static WindowStats recompute_stats(const CircularBuffer<double>& cb, std::vector<double>& scratch)
+{
+    auto spans = cb.as_spans();
+    scratch.assign(spans.first.begin(), spans.first.end());
+    scratch.insert(scratch.end(), spans.second.begin(), spans.second.end());
+
+    WindowStats s;
+    s.sum = 0;
+    s.min = s.max = scratch[0];
+    for (double v : scratch) {
+        s.sum += v;
+        s.min = std::min(s.min, v);
+        s.max = std::max(s.max, v);
+    }
+    s.mean = s.sum / scratch.size();
+    s.variance = 0;
+    for (double v : scratch) s.variance += (v - s.mean) * (v - s.mean);
+    s.variance /= scratch.size();
+
+    auto p50 = scratch.begin() + size_t(0.5 * (scratch.size() - 1));
+    std::nth_element(scratch.begin(), p50, scratch.end());
+    s.p50 = *p50;
+    auto p99 = scratch.begin() + size_t(0.99 * (scratch.size() - 1));
+    std::nth_element(p50, p99, scratch.end());
+    s.p99 = *p99;
+    return s;
+}
+
+static WindowStats query_stats(const AggregatingCircularBuffer<double>& window)
+{
+    return WindowStats{window.sum(), window.mean(), window.variance(), window.min(), window.max(),
+                       window.quantile(0.5), window.quantile(0.99)};
+}
+
+void run_aggregates()
+{
+    std::mt19937 rng(42);
+    std::lognormal_distribution<double> latency(10.0, 1.0);
+
+    for (size_t window : {size_t(1) << 10, size_t(1) << 16, size_t(1) << 20}) {
+        const int samples = int(std::max<size_t>(20, (size_t(1) << 24) / window));
+
+        CircularBuffer<double> plain(window);
+        AggregatingCircularBuffer<double> aggregating(window);
+        for (size_t i = 0; i < window; ++i) {
+            double v = latency(rng);
+            plain.add(v);
+            aggregating.add(v);
+        }
+
+        // 只更新：add 本身的开销
+        const int updates = 1 << 20;
+        int64_t start = now_ns();
+        for (int i = 0; i < updates; ++i) plain.add(latency(rng));
+        double plain_add = double(now_ns() - start) / updates;
+        start = now_ns();
+        for (int i = 0; i < updates; ++i) aggregating.add(latency(rng));
+        double aggregating_add = double(now_ns() - start) / updates;
+
+        // 更新 + 查询
+        std::vector<double> scratch;
+        double checksum = 0, max_error = 0;
+        start = now_ns();
+        for (int i = 0; i < samples; ++i) {
+            plain.add(latency(rng));
+            checksum += recompute_stats(plain, scratch).p99;
+        }
+        double recompute = double(now_ns() - start) / samples;
+
+        start = now_ns();
+        for (int i = 0; i < samples; ++i) {
+            aggregating.add(latency(rng));
+            checksum += query_stats(aggregating).p99;
+        }
+        double incremental = double(now_ns() - start) / samples;
+
+        // 两边喂同一段数据，比较近似分位数的相对误差
+        for (size_t i = 0; i < window; ++i) {
+            double v = latency(rng);
+            plain.add(v);
+            aggregating.add(v);
+        }
+        WindowStats exact = recompute_stats(plain, scratch);
+        WindowStats approx = query_stats(aggregating);
+        max_error = std::max(std::fabs(approx.p50 - exact.p50) / exact.p50, std::fabs(approx.p99 - exact.p99) / exact.p99);
+
+        printf("aggregates window=%-8zu add %6.1f -> %6.1f ns   add+query recompute %12.0f ns  incremental %8.0f ns  "
+                "(x%.0f, quantile err %.2f%%, checksum %.0f)\n",
+                window, plain_add, aggregating_add, recompute, incremental, recompute / incremental,
+                max_error * 100, checksum);
+    }
+}
+
+// 对照组：互斥锁保护的时间分桶计数器
+class MutexTimeBuckets
+{
+    public:
+        MutexTimeBuckets(clock_type::duration bucket_width, size_t bucket_count)
+            : _bucket_width(bucket_width), _epochs(bucket_count, -1), _counts(bucket_count, 0) {}
+
+        void add(uint32_t n = 1)
+        {
+            int64_t epoch = clock_type::now().time_since_epoch() / _bucket_width;
+            size_t i = size_t(epoch) % _counts.size();
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_epochs[i] != epoch) {
+                _epochs[i] = epoch;
+                _counts[i] = 0;
+            }
+            _counts[i] += n;
+        }
+
+        uint64_t sum(size_t buckets)
+        {
+            int64_t epoch = clock_type::now().time_since_epoch() / _bucket_width;
+            std::lock_guard<std::mutex> lock(_mutex);
+            uint64_t total = 0;
+            for (size_t k = 0; k < buckets; ++k) {
+                size_t i = size_t(epoch - int64_t(k)) % _counts.size();
+                if (_epochs[i] == epoch - int64_t(k)) total += _counts[i];
+            }
+            return total;
+        }
+
+    private:
+        clock_type::duration _bucket_width;
+        std::mutex _mutex;
+        std::vector<int64_t> _epochs;
+        std::vector<uint64_t> _counts;
+};
+
+// 多个线程同时计数，时间片 1ms，运行期间会不断跨越时间片
+template <typename Counter>
+void run_time_bucket(const char* name, int threads)
+{
+    Counter counter(std::chrono::milliseconds(1), 1024);
+    const int per_thread = 2000000 / threads;
+
+    std::vector<std::thread> workers;
+    int64_t start = now_ns();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            for (int i = 0; i < per_thread; ++i) counter.add();
+        });
+    }
+    for (auto& w : workers) w.join();
+    double seconds = double(now_ns() - start) / 1e9;
+
+    printf("%-24s threads=%d  %7.2f M increments/s\n", name, threads, double(per_thread) * threads / seconds / 1e6);
+}
+
+template <typename Counter>
+void run_time_bucket_query(const char* name, size_t buckets)
+{
+    Counter counter(std::chrono::seconds(1), 4096);
+    for (int i = 0; i < 1000; ++i) counter.add();
+
+    const int queries = 20000;
+    uint64_t checksum = 0;
+    int64_t start = now_ns();
+    for (int i = 0; i < queries; ++i) checksum += counter.sum(buckets);
+    double ns = double(now_ns() - start) / queries;
+
+    printf("%-24s window=%-5zu %8.1f ns/query  (checksum %llu)\n", name, buckets, ns, (unsigned long long)checksum);
+}
+
+void run_time_buckets()
+{
+    for (int threads : {1, 2, 4}) {
+        run_time_bucket<TimeBucketedCounter<clock_type>>("TimeBucketedCounter", threads);
+        run_time_bucket<MutexTimeBuckets>("mutex buckets", threads);
+    }
+    for (size_t buckets : {60, 1024, 4096}) {
+        run_time_bucket_query<TimeBucketedCounter<clock_type>>("TimeBucketedCounter", buckets);
+        run_time_bucket_query<MutexTimeBuckets>("mutex buckets", buckets);
+    }
+}
+
+int main()
+{
+    run_time_buckets();
+    run_aggregates();
+    run_payloads();
+    run_stagings();
+    run_windows();
+
+    for (size_t batch : {1, 32}) {
+        run<SpscCircularBuffer<int64_t>>("spsc", 1, 1, batch);
+        run<MpmcCircularBuffer<int64_t>>("mpmc", 1, 1, batch);
+        run<MutexDeque<int64_t>>("mutex_deque", 1, 1, batch);
+    }
+    for (int n : {2, 4}) {
+        run<MpmcCircularBuffer<int64_t>>("mpmc", n, n, 1);
+        run<MutexDeque<int64_t>>("mutex_deque", n, n, 1);
+    }
+    return 0;
+}
@@ -1,4 +1,16 @@
 #include "Circular_Buffer.h"
+#include "Concurrent_Circular_Buffer.h"
+#include "Mirrored_Byte_Buffer.h"
+#include "Aggregating_Circular_Buffer.h"
+#include "Time_Bucketed_Counter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
 
 void test_case_1() {
 
@@ -16,8 +28,338 @@ void test_case_1() {
 
 }
 
+void test_case_2() {
+
+    SpscCircularBuffer<std::string> q(3);
+    assert(q.capacity() == 4);
+
+    assert(q.try_push("a"));
+    assert(q.try_push("b"));
+    assert(q.try_push("c"));
+    assert(q.try_push("d"));
+    assert(!q.try_push("e"));
+
+    std::string s;
+    assert(q.try_pop(s) && s == "a");
+
+    std::string batch[4];
+    assert(q.try_pop_n(batch, 4) == 3);
+    assert(batch[0] == "b" && batch[2] == "d");
+    assert(!q.try_pop(s));
+
+    // 生产者和消费者各一个线程，检查顺序和完整性
+    const int count = 1000000;
+    SpscCircularBuffer<int> ints(1024);
+    std::thread producer([&] {
+        int items[16];
+        for (int i = 0; i < count; ) {
+            int n = 0;
+            for (; n < 16 && i + n < count; ++n) items[n] = i + n;
+            size_t pushed = ints.try_push_n(items, n);
+            if (pushed == 0) std::this_thread::yield();
+            i += pushed;
+        }
+    });
+
+    int expected = 0;
+    int items[16];
+    while (expected < count) {
+        size_t n = ints.try_pop_n(items, 16);
+        if (n == 0) std::this_thread::yield();
+        for (size_t i = 0; i < n; ++i) {
+            assert(items[i] == expected);
+            ++expected;
+        }
+    }
+    producer.join();
+    std::cout << "spsc ok" << std::endl;
+}
+
+void test_case_3() {
+
+    MpmcCircularBuffer<int> q(1);
+    assert(q.capacity() == 2);
+    assert(q.try_push(1) && q.try_push(2) && !q.try_push(3));
+
+    int v = 0;
+    assert(q.try_pop(v) && v == 1);
+    assert(q.try_pop(v) && v == 2);
+    assert(!q.try_pop(v));
+
+    // 多生产者多消费者，每个值恰好被消费一次
+    const int producers = 4;
+    const int consumers = 4;
+    const int per_producer = 200000;
+    MpmcCircularBuffer<int> ints(256);
+    std::vector<std::atomic<int>> seen(producers * per_producer);
+    std::atomic<int> consumed(0);
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] {
+            for (int i = 0; i < per_producer; ) {
+                if (ints.try_push(p * per_producer + i)) ++i;
+                else std::this_thread::yield();
+            }
+        });
+    }
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back([&] {
+            int item;
+            while (consumed.load() < producers * per_producer) {
+                if (ints.try_pop(item)) {
+                    seen[item].fetch_add(1);
+                    consumed.fetch_add(1);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    for (auto& s : seen) assert(s.load() == 1);
+    std::cout << "mpmc ok" << std::endl;
+}
+
+void test_case_4() {
+
+    CircularBuffer<int, pow2_capacity> cb(5);
+    assert(cb.capacity() == 8);
+
+    for (int i = 0; i < 5; ++i) cb.add(i);
+    auto spans = cb.as_spans();
+    assert(spans.first.size == 5 && spans.second.size == 0);
+
+    for (int i = 5; i < 11; ++i) cb.add(i);
+    assert(cb.is_full() && cb.size() == 8);
+
+    // 从旧到新依次是 3..10，跨越了回绕点
+    spans = cb.as_spans();
+    assert(spans.first.size + spans.second.size == 8);
+    int expected = 3;
+    for (int v : spans.first) assert(v == expected++);
+    for (int v : spans.second) assert(v == expected++);
+
+    for (size_t i = 0; i < cb.size(); ++i) {
+        assert(cb[i] == int(i) + 3);
+        assert(cb.unchecked_at(i) == int(i) + 3);
+    }
+
+    bool thrown = false;
+    try {
+        cb[8];
+    } catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    cb.resize(3);
+    assert(cb.capacity() == 4 && cb.size() == 4);
+    assert(cb[0] == 7 && cb[3] == 10);
+
+    CircularBuffer<int> exact(3);
+    for (int i = 0; i < 7; ++i) exact.add(i);
+    assert(exact[0] == 4 && exact[1] == 5 && exact[2] == 6);
+    std::cout << "capacity policy ok" << std::endl;
+}
+
+void test_case_5() {
+
+    MirroredByteBuffer ring(100);
+    size_t cap = ring.capacity();
+    assert(cap >= 100 && (cap & (cap - 1)) == 0);
+
+    // 写到接近末尾再消费掉，让后续写入跨越回绕点
+    std::string filler(cap - 10, 'x');
+    assert(ring.write(filler.data(), filler.size()) == filler.size());
+    ring.consume(filler.size());
+
+    const char msg[] = "hello, mirrored ring buffer";
+    assert(ring.write(msg, sizeof(msg)) == sizeof(msg));
+
+    // 跨越回绕点的数据在读区域中依然连续
+    auto r = ring.read_span();
+    assert(r.size == sizeof(msg));
+    assert(memcmp(r.data, msg, sizeof(msg)) == 0);
+
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    assert(ring.send_to(fds[0]) == (ssize_t)sizeof(msg));
+    assert(ring.empty());
+
+    assert(ring.recv_from(fds[1]) == (ssize_t)sizeof(msg));
+    char out[sizeof(msg)];
+    assert(ring.read(out, sizeof(out)) == sizeof(msg));
+    assert(memcmp(out, msg, sizeof(msg)) == 0);
+
+    // 缓冲区满时返回 -1，不与对端关闭(0)混淆
+    std::string full(ring.capacity(), 'y');
+    assert(ring.write(full.data(), full.size()) == full.size());
+    errno = 0;
+    assert(ring.recv_from(fds[1]) == -1 && errno == ENOBUFS);
+    ring.consume(ring.size());
+
+    close(fds[0]);
+    close(fds[1]);
+    std::cout << "mirrored ring ok" << std::endl;
+}
+
+// 统计存活对象数量，没有默认构造函数
+struct Tracked
+{
+    static int live;
+    int value;
+
+    explicit Tracked(int v) : value(v) { ++live; }
+    Tracked(const Tracked& rhs) : value(rhs.value) { ++live; }
+    Tracked(Tracked&& rhs) noexcept : value(rhs.value) { ++live; }
+    Tracked& operator=(const Tracked&) = default;
+    Tracked& operator=(Tracked&&) = default;
+    ~Tracked() { --live; }
+};
+
+int Tracked::live = 0;
+
+void test_case_6() {
+
+    {
+        CircularBuffer<Tracked> cb(4);
+        assert(Tracked::live == 0);     // 不再默认构造所有槽位
+
+        for (int i = 0; i < 3; ++i) cb.emplace_back(i);
+        assert(Tracked::live == 3);
+
+        for (int i = 3; i < 10; ++i) cb.push_back(Tracked(i));
+        assert(Tracked::live == 4);
+        assert(cb[0].value == 6 && cb[3].value == 9);
+
+        CircularBuffer<Tracked> copy(cb);
+        assert(Tracked::live == 8);
+        assert(copy[0].value == 6 && copy[3].value == 9);
+
+        cb.resize(2);
+        assert(Tracked::live == 6);
+        assert(cb[0].value == 8 && cb[1].value == 9);
+
+        cb.resize(5);
+        assert(cb.size() == 2 && !cb.is_full());
+        cb.emplace_back(10);
+        assert(cb[2].value == 10);
+        assert(Tracked::live == 7);
+
+        copy.clear();
+        assert(copy.size() == 0 && Tracked::live == 3);
+    }
+    assert(Tracked::live == 0);
+
+    // 只能移动的类型
+    CircularBuffer<std::unique_ptr<int>> owners(2);
+    owners.push_back(std::unique_ptr<int>(new int(1)));
+    owners.emplace_back(new int(2));
+    owners.push_back(std::unique_ptr<int>(new int(3)));
+    owners.resize(4);
+    assert(*owners[0] == 2 && *owners[1] == 3);
+    std::cout << "uninitialized storage ok" << std::endl;
+}
+
+void test_case_7() {
+
+    AggregatingCircularBuffer<int> window(100, 0.01);
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> dist(1, 100000);
+    std::vector<int> all;
+
+    for (int i = 0; i < 1000; ++i) {
+        int v = dist(rng);
+        all.push_back(v);
+        window.add(v);
+
+        // 与对整个窗口重新计算的结果比较
+        std::vector<int> recent(all.end() - window.size(), all.end());
+        double sum = 0;
+        for (int x : recent) sum += x;
+        double mean = sum / recent.size();
+        double var = 0;
+        for (int x : recent) var += (x - mean) * (x - mean);
+        var /= recent.size();
+
+        assert(window.size() == std::min<size_t>(all.size(), 100));
+        assert(std::fabs(window.sum() - sum) < 1e-6 * sum);
+        assert(std::fabs(window.mean() - mean) < 1e-6 * mean);
+        assert(std::fabs(window.variance() - var) < 1e-6 * var + 1e-6);
+        assert(window.min() == *std::min_element(recent.begin(), recent.end()));
+        assert(window.max() == *std::max_element(recent.begin(), recent.end()));
+
+        std::sort(recent.begin(), recent.end());
+        for (double q : {0.0, 0.5, 0.9, 0.99, 1.0}) {
+            double exact = recent[size_t(q * (recent.size() - 1))];
+            assert(std::fabs(window.quantile(q) - exact) <= 0.01 * exact + 1e-9);
+        }
+    }
+
+    // 单调序列：最值在窗口滑动时被淘汰
+    AggregatingCircularBuffer<double> ramp(3);
+    for (int i = 0; i < 10; ++i) ramp.add(i);
+    assert(ramp.min() == 7 && ramp.max() == 9 && ramp.sum() == 24);
+    for (int i = 10; i > 0; --i) ramp.add(i);
+    assert(ramp.min() == 1 && ramp.max() == 3);
+    std::cout << "window aggregates ok" << std::endl;
+}
+
+void test_case_8() {
+
+    typedef TimeBucketedCounter<> counter_type;
+    typedef counter_type::time_point time_point;
+    using std::chrono::seconds;
+
+    counter_type per_second(seconds(1), 60);
+    assert(per_second.bucket_count() == 64);
+
+    time_point t0 = time_point(seconds(1000));
+    for (int i = 0; i < 10; ++i) per_second.add_at(t0 + seconds(i), i + 1);   // 第 i 秒计 i + 1 次
+    time_point now = t0 + seconds(9);
+    assert(per_second.sum_at(now, 1) == 10);
+    assert(per_second.sum_at(now, 3) == 10 + 9 + 8);
+    assert(per_second.sum_at(now, 64) == 55);
+    // 时间前进，旧的时间片滑出窗口
+    assert(per_second.sum_at(now + seconds(5), 10) == 6 + 7 + 8 + 9 + 10);
+    assert(per_second.sum_at(now + seconds(100), 64) == 0);
+
+    // 绕过一整圈之后，同一个桶被新的时间片重置
+    per_second.add_at(t0 + seconds(64), 100);
+    assert(per_second.sum_at(t0 + seconds(64), 1) == 100);
+    assert(per_second.sum_at(t0 + seconds(64), 64) == 100 + 55 - 1);
+
+    // 多线程并发写同一个时间片
+    counter_type concurrent(std::chrono::hours(1), 4);
+    time_point fixed = time_point(std::chrono::hours(5));
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&]() {
+            for (int i = 0; i < 100000; ++i) concurrent.add_at(fixed);
+        });
+    }
+    for (auto& w : writers) w.join();
+    assert(concurrent.sum_at(fixed, 1) == 400000);
+
+    // 使用真实时钟
+    counter_type live(std::chrono::milliseconds(100), 16);
+    live.add();
+    live.add(2);
+    assert(live.sum(16) == 3);
+    std::cout << "time buckets ok" << std::endl;
+}
+
 int main() {
     
     test_case_1();
+    test_case_2();
+    test_case_3();
+    test_case_4();
+    test_case_5();
+    test_case_6();
+    test_case_7();
+    test_case_8();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,171 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <atomic>
+#include <unordered_map>
+
+#include "locker.h"
+#include "http_response.h"
+
+/**
+ * 过载时的准入控制，所有 reactor 和工作线程共享
+ * 排队时间：仿照 CoDel，工作线程取出连接时报告它在线程池里等了多久。一个 INTERVAL 内的最短等待时间
+ * 都超过 target，说明队列里有消不掉的积压，进入过载状态：排队超过 target 的请求直接拒绝，
+ * reactor 在最近的等待时间超过 target、线程池里还有积压时不再把新请求交给线程池，当场回 503。
+ * 不过载时只拒绝排队超过 INTERVAL 的请求。被拒绝的请求由 http_conn::shed() 解析后回 503，连接保持。
+ * 每个客户端 IP：同时打开的连接数超过上限时，新连接在 accept 之后用 reject() 回 503 并关闭
+ */
+class admission
+{
+    public:
+        // 默认的排队时间目标(毫秒)
+        static const int DEFAULT_TARGET_MS = 5;
+        // 统计最短等待时间的区间，也是不过载时允许的最长排队时间
+        static const int64_t INTERVAL_NS = 100 * 1000000LL;
+
+    public:
+        static admission* instance();
+        static int64_t now_ns();
+
+        // 排队时间目标，0 表示不按排队时间拒绝请求；启动时设置
+        void set_queue_target(int ms) { m_target_ns = ms * 1000000LL; }
+        // 每个客户端 IP 最多同时打开的连接数，0 表示不限制；启动时设置
+        void set_client_limit(int limit) { m_client_limit = limit; }
+        int client_limit() const { return m_client_limit; }
+
+        // 工作线程取出一个连接时调用，sojourn 是它排队的时间；返回 true 时应该拒绝这个请求
+        bool on_dequeue(int64_t sojourn, int64_t now);
+        // reactor 把请求交给线程池之前调用，queued 是线程池里排队的请求数；返回 false 时应该拒绝
+        bool admit(int queued) const;
+        bool overloaded() const { return m_overloaded.load(std::memory_order_relaxed); }
+
+        // 新连接建立时调用，返回 false 表示这个 IP 的连接数已经到上限，连接没有被计入
+        bool acquire_client(const sockaddr_in& addr);
+        // 被计入的连接关闭时调用
+        void release_client(const sockaddr_in& addr);
+
+        // 往还没有读过请求的 socket 发送固定的 503 应答(加上缓存的 Date 字段)，不等待；调用者随后关闭连接
+        static void reject(int sockfd);
+
+    private:
+        admission() : m_target_ns(DEFAULT_TARGET_MS * 1000000LL), m_client_limit(0), m_interval_end(0),
+                      m_interval_min(INT64_MAX), m_last_sojourn(0), m_overloaded(false) {}
+        admission(const admission&);
+        admission& operator=(const admission&);
+
+        int64_t m_target_ns;
+        int m_client_limit;
+
+        // 当前统计区间的结束时间和区间内的最短等待时间
+        std::atomic<int64_t> m_interval_end;
+        std::atomic<int64_t> m_interval_min;
+        // 最近一次取出的连接的等待时间
+        std::atomic<int64_t> m_last_sojourn;
+        std::atomic<bool> m_overloaded;
+
+        // 每个客户端 IP(网络字节序)打开的连接数
+        locker m_clients_lock;
+        std::unordered_map<uint32_t, int> m_clients;
+};
+
+inline admission* admission::instance()
+{
+    static admission a;
+    return &a;
+}
+
+inline int64_t admission::now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+inline bool admission::on_dequeue(int64_t sojourn, int64_t now)
+{
+    if (m_target_ns <= 0) {
+        return false;
+    }
+    // 只在变化时写，避免所有工作线程每次都抢同一个缓存行
+    if (m_last_sojourn.load(std::memory_order_relaxed) != sojourn) {
+        m_last_sojourn.store(sojourn, std::memory_order_relaxed);
+    }
+    int64_t min = m_interval_min.load(std::memory_order_relaxed);
+    while (sojourn < min && !m_interval_min.compare_exchange_weak(min, sojourn, std::memory_order_relaxed)) {
+    }
+    // 区间结束，由抢到的线程根据区间内的最短等待时间更新过载状态
+    int64_t end = m_interval_end.load(std::memory_order_relaxed);
+    if (now >= end && m_interval_end.compare_exchange_strong(end, now + INTERVAL_NS, std::memory_order_relaxed)) {
+        int64_t interval_min = m_interval_min.exchange(INT64_MAX, std::memory_order_relaxed);
+        m_overloaded.store(interval_min != INT64_MAX && interval_min > m_target_ns, std::memory_order_relaxed);
+    }
+    return sojourn > (overloaded() ? m_target_ns : INTERVAL_NS);
+}
+
+// 过载时，只要最近取出的请求还等了超过 target 就不再往队列里放；队列空了之后重新放行，
+// 否则最后一次报告的等待时间会一直停在 target 之上
+inline bool admission::admit(int queued) const
+{
+    return m_target_ns <= 0 || !overloaded() || queued == 0
+        || m_last_sojourn.load(std::memory_order_relaxed) <= m_target_ns;
+}
+
+inline bool admission::acquire_client(const sockaddr_in& addr)
+{
+    if (m_client_limit <= 0) {
+        return true;
+    }
+    m_clients_lock.lock();
+    int& count = m_clients[addr.sin_addr.s_addr];
+    bool ok = count < m_client_limit;
+    if (ok) {
+        ++count;
+    }
+    m_clients_lock.unlock();
+    return ok;
+}
+
+inline void admission::release_client(const sockaddr_in& addr)
+{
+    if (m_client_limit <= 0) {
+        return;
+    }
+    m_clients_lock.lock();
+    std::unordered_map<uint32_t, int>::iterator it = m_clients.find(addr.sin_addr.s_addr);
+    if (it != m_clients.end() && --it->second <= 0) {
+        m_clients.erase(it);
+    }
+    m_clients_lock.unlock();
+}
+
+inline void admission::reject(int sockfd)
+{
+    static const char status[] = "HTTP/1.1 503 Service Unavailable\r\n";
+    static const char rest[] = "Content-Length: 20\r\nConnection: close\r\nRetry-After: 1\r\n\r\n"
+                               "Service Unavailable\n";
+    // 读掉已经到达的请求，关闭时接收缓冲区里有未读的数据会发 RST，客户端可能收不到应答
+    char discard[4096];
+    while (recv(sockfd, discard, sizeof(discard), MSG_DONTWAIT) == (ssize_t)sizeof(discard)) {
+    }
+    const http_response::chunk& date = http_response::date();
+    struct iovec iov[3];
+    iov[0].iov_base = (void*)status;
+    iov[0].iov_len = sizeof(status) - 1;
+    iov[1].iov_base = (void*)date.data;
+    iov[1].iov_len = date.len;
+    iov[2].iov_base = (void*)rest;
+    iov[2].iov_len = sizeof(rest) - 1;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 3;
+    sendmsg(sockfd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+#endif
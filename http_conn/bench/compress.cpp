@@ -0,0 +1,234 @@
+// 启动 http_conn 服务器进程，分别不压缩、gzip、br 请求几个文本文件和动态应答(/metrics)，
+// 测量每个应答在线路上的字节数(含应答头)、服务器进程每个请求的 CPU 时间，以及第一次请求(要压缩)的延迟。
+// gzip 的应答解压之后和原文比较
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+static double now_seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 服务器进程已经用掉的 CPU 时间(用户态加内核态)，单位秒
+static double cpu_seconds(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE* f = fopen(path, "r");
+    if (!f) return 0;
+    char buf[1024];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    // 第2个字段(进程名)可能有空格，从最后一个 ')' 之后数：utime 和 stime 是第14、15个字段
+    const char* p = strrchr(buf, ')');
+    unsigned long utime = 0, stime = 0;
+    if (p) sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime);
+    return double(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+static int connect_to(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// 连接上收到但还没有处理的数据
+static std::string g_in;
+
+static bool fill(int fd)
+{
+    char buf[64 * 1024];
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) return false;
+    g_in.append(buf, n);
+    return true;
+}
+
+// 读一个应答，*wire 是应答在线路上的总字节数，*body 是(去掉分块格式之后的)应答体
+static bool read_response(int fd, long* wire, std::string* body, std::string* encoding)
+{
+    size_t end;
+    while ((end = g_in.find("\r\n\r\n")) == std::string::npos) {
+        if (!fill(fd)) return false;
+    }
+    std::string head = g_in.substr(0, end + 4);
+    size_t pos = end + 4;
+    encoding->clear();
+    long length = -1;
+    bool chunked = false;
+    std::istringstream lines(head);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (strncasecmp(line.c_str(), "Content-Length:", 15) == 0) length = atol(line.c_str() + 15);
+        if (strncasecmp(line.c_str(), "Transfer-Encoding: chunked", 26) == 0) chunked = true;
+        if (strncasecmp(line.c_str(), "Content-Encoding: ", 18) == 0) *encoding = line.substr(18, line.size() - 19);
+    }
+
+    body->clear();
+    if (!chunked) {
+        while (g_in.size() < pos + length) {
+            if (!fill(fd)) return false;
+        }
+        body->assign(g_in, pos, length);
+        pos += length;
+    } else {
+        while (true) {
+            size_t eol;
+            while ((eol = g_in.find("\r\n", pos)) == std::string::npos) {
+                if (!fill(fd)) return false;
+            }
+            long size = strtol(g_in.c_str() + pos, NULL, 16);
+            while (g_in.size() < eol + 2 + size + 2) {
+                if (!fill(fd)) return false;
+            }
+            body->append(g_in, eol + 2, size);
+            pos = eol + 2 + size + 2;
+            if (size == 0) break;
+        }
+    }
+    *wire = pos;
+    g_in.erase(0, pos);
+    return true;
+}
+
+static std::string gunzip(const std::string& in)
+{
+    std::string out;
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    inflateInit2(&stream, 15 + 16);
+    stream.next_in = (Bytef*)in.data();
+    stream.avail_in = in.size();
+    char buf[64 * 1024];
+    int ret;
+    do {
+        stream.next_out = (Bytef*)buf;
+        stream.avail_out = sizeof(buf);
+        ret = inflate(&stream, Z_NO_FLUSH);
+        out.append(buf, sizeof(buf) - stream.avail_out);
+    } while (ret == Z_OK);
+    inflateEnd(&stream);
+    return out;
+}
+
+static void write_file(const std::string& path, const std::string& content)
+{
+    std::ofstream(path, std::ios::binary) << content;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* server = argc > 1 ? argv[1] : "./http_conn";
+    int port = argc > 2 ? atoi(argv[2]) : 9302;
+    double seconds = argc > 3 ? atof(argv[3]) : 2;
+
+    // 测试文件：一段源代码(当作 JS)、一个 1MB 左右的 HTML 表格、一个 CSS
+    char dir[] = "/tmp/http_conn_compressXXXXXX";
+    mkdtemp(dir);
+    std::ostringstream source;
+    source << std::ifstream("http_conn.cpp").rdbuf();
+    std::string html = "<html><body><table>\n";
+    const char* words[] = {"alpha", "beta", "gamma", "delta", "request", "response", "server", "table"};
+    srand(1);
+    for (int i = 0; html.size() < 1000000; ++i) {
+        html += "<tr><td>" + std::to_string(i) + "</td>";
+        for (int j = 0; j < 4; ++j) html += std::string("<td>") + words[rand() % 8] + "</td>";
+        html += "</tr>\n";
+    }
+    html += "</table></body></html>\n";
+    std::string css;
+    for (int i = 0; i < 200; ++i) {
+        css += ".c" + std::to_string(i) + " { margin: " + std::to_string(i % 7) + "px; color: #333; }\n";
+    }
+    write_file(std::string(dir) + "/app.js", source.str());
+    write_file(std::string(dir) + "/page.html", html);
+    write_file(std::string(dir) + "/style.css", css);
+
+    std::string port_str = std::to_string(port);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        freopen("/dev/null", "w", stdout);
+        execl(server, server, "127.0.0.1", port_str.c_str(), dir, (char*)NULL);
+        _exit(127);
+    }
+    usleep(300 * 1000);
+
+    const char* paths[] = {"/style.css", "/app.js", "/page.html", "/metrics"};
+    const std::string originals[] = {css, source.str(), html, ""};
+    const char* encodings[] = {"identity", "gzip", "br"};
+    printf("%-11s %-9s %10s %8s %10s %12s %10s\n", "path", "encoding", "wire bytes", "ratio", "first ms",
+           "cpu us/req", "req/s");
+    for (int p = 0; p < 4; ++p) {
+        long identity_wire = 0;
+        for (int e = 0; e < 3; ++e) {
+            int fd = connect_to(port);
+            g_in.clear();
+            std::string request = std::string("GET ") + paths[p] + " HTTP/1.1\r\nHost: localhost\r\nAccept-Encoding: "
+                + encodings[e] + "\r\n\r\n";
+            long wire = 0;
+            std::string body, encoding;
+
+            // 第一次请求：静态文件在这时压缩并缓存
+            double start = now_seconds();
+            send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+            bool ok = read_response(fd, &wire, &body, &encoding);
+            double first_ms = (now_seconds() - start) * 1e3;
+            const char* check = ok ? "" : "  FAILED";
+            if (ok && encoding == "gzip" && !originals[p].empty() && gunzip(body) != originals[p]) {
+                check = "  MISMATCH";
+            }
+            if (e == 0) identity_wire = wire;
+
+            long requests = 0;
+            double cpu_start = cpu_seconds(pid);
+            start = now_seconds();
+            while (ok && now_seconds() - start < seconds) {
+                send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+                ok = read_response(fd, &wire, &body, &encoding);
+                ++requests;
+            }
+            double elapsed = now_seconds() - start;
+            double cpu = cpu_seconds(pid) - cpu_start;
+            close(fd);
+
+            // 服务器没有用请求的编码(比如动态应答不做 br)时注明
+            std::string served = encoding.empty() ? "identity" : encoding;
+            printf("%-11s %-9s %10ld %7.1f%% %10.2f %12.1f %10.0f%s%s%s\n", paths[p], encodings[e], wire,
+                   100.0 * wire / identity_wire, first_ms, cpu * 1e6 / requests, requests / elapsed,
+                   served != encodings[e] ? ("  (sent " + served + ")").c_str() : "", ok ? "" : "  FAILED", check);
+        }
+    }
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    std::string cleanup = std::string("rm -rf ") + dir;
+    return system(cleanup.c_str()) == -1;
+}
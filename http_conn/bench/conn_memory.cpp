@@ -0,0 +1,100 @@
+// 启动 http_conn 服务器进程，建立 N 个连接，每个连接先完成一次 keep-alive 请求然后保持空闲，
+// 读取服务器进程的 VmRSS
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+static long rss_kb(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "VmRSS:", 6) == 0) kb = atol(line + 6);
+    }
+    fclose(f);
+    return kb;
+}
+
+static int connect_to(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* server = argc > 1 ? argv[1] : "./http_conn";
+    int port = argc > 2 ? atoi(argv[2]) : 9300;
+    std::vector<int> counts;
+    for (int i = 3; i < argc; ++i) counts.push_back(atoi(argv[i]));
+    if (counts.empty()) counts = {1000, 5000, 9000};
+
+    char dir[] = "/tmp/http_conn_benchXXXXXX";
+    mkdtemp(dir);
+    std::string index = std::string(dir) + "/index.html";
+    FILE* f = fopen(index.c_str(), "w");
+    fputs("hello\n", f);
+    fclose(f);
+    chmod(index.c_str(), 0644);
+
+    for (int count : counts) {
+        std::string port_str = std::to_string(port);
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            freopen("/dev/null", "w", stdout);
+            execl(server, server, "127.0.0.1", port_str.c_str(), dir, (char*)NULL);
+            _exit(127);
+        }
+        usleep(300 * 1000);
+        long before = rss_kb(pid);
+
+        const char req[] = "GET /index.html HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n";
+        std::vector<int> fds;
+        char buf[1024];
+        for (int i = 0; i < count; ++i) {
+            int fd = connect_to(port);
+            if (fd < 0) break;
+            send(fd, req, sizeof(req) - 1, 0);
+            recv(fd, buf, sizeof(buf), 0);
+            fds.push_back(fd);
+        }
+        usleep(200 * 1000);
+        long after = rss_kb(pid);
+
+        printf("idle=%-6zu rss %7ld KB -> %7ld KB  (%.2f KB/conn)\n",
+                fds.size(), before, after, double(after - before) / fds.size());
+
+        for (int fd : fds) close(fd);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        ++port;
+    }
+
+    unlink(index.c_str());
+    rmdir(dir);
+    return 0;
+}
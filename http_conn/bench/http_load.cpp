@@ -0,0 +1,485 @@
+// http_conn 的标准压测客户端，只压本机
+// 闭环(默认)：每个连接发出 depth 个请求，收齐应答后再发下一批，测的是最大吞吐。
+// 开环(-R)：按固定的总速率发请求，每个请求有预定的发送时间，延迟从预定时间算起：
+// 服务器变慢时来不及发出的请求也把排队的时间算进去，修正协调遗漏(coordinated omission)，
+// 否则慢的那段时间里本该发出的请求根本没有被测量。
+// 延迟记录在 HDR 直方图里，输出百分位，-H 时把完整的分布按 .hgrm 格式写入文件
+// 用法: http_load [-c connections] [-t threads] [-d seconds] [-P depth] [-R rate] [-k | -C] [-H file] ip port path
+#include "hdr_histogram.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct options
+{
+    const char* ip;
+    int port;
+    std::string path;
+    int connections;
+    int threads;
+    int seconds;
+    int depth;
+    // 开环的总速率(请求/秒)，0 表示闭环
+    double rate;
+    bool keep_alive;
+    const char* hgrm;
+};
+
+struct connection
+{
+    int fd;
+    std::string in;
+    // 还没有写进内核的请求
+    std::string out;
+    // 已发出、尚未收到应答的请求的预定发送时间和实际发送时间
+    std::deque<int64_t> intended;
+    std::deque<int64_t> sent;
+    // 开环时下一个请求的预定发送时间
+    int64_t next_send;
+    bool want_write;
+};
+
+struct worker_result
+{
+    long requests;
+    long errors;
+    // 状态码不是 2xx 的应答
+    long non_2xx;
+    // 延迟从预定发送时间算起(闭环时与实际发送时间相同)
+    hdr_histogram latency;
+    // 开环时从实际发送时间算起的延迟，用来对比协调遗漏的影响
+    hdr_histogram uncorrected;
+    // 只算 2xx 应答的延迟，服务器拒绝请求(503)时用来看有效吞吐的延迟
+    hdr_histogram good;
+};
+
+struct worker_args
+{
+    const options* opt;
+    // 这个线程负责的连接在所有连接中的起始编号和个数
+    int first;
+    int connections;
+    worker_result result;
+};
+
+static int connect_to(const options& opt)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    inet_pton(AF_INET, opt.ip, &addr.sin_addr);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+// 从输入缓冲区中取出一个完整的应答，返回它的长度并填写状态码；不完整时返回0，格式错误时返回-1
+static long take_response(const std::string& in, int* status)
+{
+    size_t header_end = in.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+        return 0;
+    }
+    if (strncmp(in.data(), "HTTP/1.1 ", 9) != 0) {
+        return -1;
+    }
+    *status = atoi(in.data() + 9);
+    long content_length = 0;
+    size_t pos = 0;
+    while (pos < header_end) {
+        size_t eol = in.find("\r\n", pos);
+        if (eol - pos > 15 && strncasecmp(in.data() + pos, "Content-Length:", 15) == 0) {
+            content_length = atol(in.data() + pos + 15);
+        }
+        pos = eol + 2;
+    }
+    long total = header_end + 4 + content_length;
+    return (long)in.size() >= total ? total : 0;
+}
+
+// 等待事件，超时时间精确到纳秒；timeout_ns 为 -1 时一直等待
+static int wait_events(int epollfd, epoll_event* events, int max, int64_t timeout_ns)
+{
+    if (timeout_ns < 0) {
+        return epoll_wait(epollfd, events, max, -1);
+    }
+    struct timespec ts;
+    ts.tv_sec = timeout_ns / 1000000000;
+    ts.tv_nsec = timeout_ns % 1000000000;
+    int n = epoll_pwait2(epollfd, events, max, &ts, NULL);
+    if (n < 0 && errno == ENOSYS) {
+        // 老内核没有 epoll_pwait2，向上取整到毫秒
+        n = epoll_wait(epollfd, events, max, (int)((timeout_ns + 999999) / 1000000));
+    }
+    return n;
+}
+
+class worker_loop
+{
+    public:
+        worker_loop(worker_args* args) : m_args(args), m_opt(*args->opt), m_conns(args->connections)
+        {
+            m_request = "GET " + m_opt.path + " HTTP/1.1\r\nHost: localhost\r\n";
+            m_request += m_opt.keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+            m_epollfd = epoll_create1(0);
+        }
+
+        ~worker_loop()
+        {
+            for (size_t i = 0; i < m_conns.size(); ++i) {
+                if (m_conns[i].fd >= 0) {
+                    close(m_conns[i].fd);
+                }
+            }
+            close(m_epollfd);
+        }
+
+        void run();
+
+    private:
+        bool open(size_t i);
+        void reopen(size_t i);
+        void update_events(size_t i);
+        // 往连接上追加一个请求，start 是它的预定发送时间
+        void send_request(size_t i, int64_t start);
+        void flush(size_t i);
+        void on_readable(size_t i);
+
+        worker_args* m_args;
+        const options& m_opt;
+        std::vector<connection> m_conns;
+        std::string m_request;
+        int m_epollfd;
+};
+
+bool worker_loop::open(size_t i)
+{
+    connection& c = m_conns[i];
+    c.fd = connect_to(m_opt);
+    if (c.fd < 0) {
+        return false;
+    }
+    c.want_write = false;
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = i;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, c.fd, &ev);
+    return true;
+}
+
+void worker_loop::reopen(size_t i)
+{
+    connection& c = m_conns[i];
+    close(c.fd);
+    c.fd = -1;
+    c.in.clear();
+    c.out.clear();
+}
+
+void worker_loop::update_events(size_t i)
+{
+    connection& c = m_conns[i];
+    bool want_write = !c.out.empty();
+    if (want_write != c.want_write) {
+        epoll_event ev;
+        ev.events = want_write ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        ev.data.u64 = i;
+        epoll_ctl(m_epollfd, EPOLL_CTL_MOD, c.fd, &ev);
+        c.want_write = want_write;
+    }
+}
+
+void worker_loop::send_request(size_t i, int64_t start)
+{
+    connection& c = m_conns[i];
+    // 不保持连接时每个请求新建一个连接，建连的时间也算在延迟里
+    if (c.fd < 0 && !open(i)) {
+        fprintf(stderr, "connect failed: %s\n", strerror(errno));
+        exit(1);
+    }
+    c.intended.push_back(start);
+    c.sent.push_back(now_ns());
+    c.out += m_request;
+}
+
+void worker_loop::flush(size_t i)
+{
+    connection& c = m_conns[i];
+    if (c.fd < 0 || c.out.empty()) {
+        return;
+    }
+    ssize_t n = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+    if (n > 0) {
+        c.out.erase(0, n);
+    } else if (n < 0 && errno != EAGAIN) {
+        m_args->result.errors++;
+        c.out.clear();
+    }
+    update_events(i);
+}
+
+void worker_loop::on_readable(size_t i)
+{
+    connection& c = m_conns[i];
+    char buf[65536];
+    ssize_t r;
+    while ((r = recv(c.fd, buf, sizeof(buf), 0)) > 0) {
+        c.in.append(buf, r);
+    }
+    bool eof = r == 0 || (r < 0 && errno != EAGAIN);
+
+    long len = 0;
+    int status = 0;
+    while (!c.intended.empty() && (len = take_response(c.in, &status)) > 0) {
+        c.in.erase(0, len);
+        int64_t now = now_ns();
+        int64_t intended = c.intended.front();
+        m_args->result.latency.record(now - intended);
+        m_args->result.uncorrected.record(now - c.sent.front());
+        c.intended.pop_front();
+        c.sent.pop_front();
+        m_args->result.requests++;
+        if (status < 200 || status >= 300) {
+            m_args->result.non_2xx++;
+        } else {
+            m_args->result.good.record(now - intended);
+        }
+    }
+    if (len < 0) {
+        m_args->result.errors++;
+        c.in.clear();
+        c.intended.clear();
+        c.sent.clear();
+    }
+
+    if (!m_opt.keep_alive && c.intended.empty()) {
+        reopen(i);
+    } else if (eof) {
+        // 服务器关闭了连接(比如过载时回 503 之后)，没有收到应答的请求算出错，下一个请求重新建连
+        m_args->result.errors += c.intended.size();
+        c.intended.clear();
+        c.sent.clear();
+        reopen(i);
+    }
+}
+
+void worker_loop::run()
+{
+    const options& opt = m_opt;
+    int64_t start = now_ns();
+    int64_t deadline = start + (int64_t)opt.seconds * 1000000000;
+    // 开环时每个连接的发送间隔；各个连接错开，让请求在时间上均匀分布
+    int64_t interval = opt.rate > 0 ? (int64_t)(1e9 * opt.connections / opt.rate) : 0;
+    for (size_t i = 0; i < m_conns.size(); ++i) {
+        m_conns[i].fd = -1;
+        if (opt.keep_alive && !open(i)) {
+            fprintf(stderr, "connect failed: %s\n", strerror(errno));
+            exit(1);
+        }
+        m_conns[i].next_send = start + interval * (m_args->first + (int64_t)i) / opt.connections;
+    }
+
+    std::vector<epoll_event> events(m_conns.size());
+    while (true) {
+        int64_t now = now_ns();
+        if (now >= deadline) {
+            break;
+        }
+
+        // 发出到期的请求，算出下一次需要醒来的时间
+        int64_t wake = deadline;
+        for (size_t i = 0; i < m_conns.size(); ++i) {
+            connection& c = m_conns[i];
+            if (interval == 0) {
+                if (c.intended.empty()) {
+                    for (int k = 0; k < opt.depth; ++k) {
+                        send_request(i, now);
+                    }
+                }
+            } else {
+                // 流水线满了的连接不发，预定时间不变，等应答回来之后补发，排队时间算进延迟
+                while (c.next_send <= now && (int)c.intended.size() < opt.depth) {
+                    send_request(i, c.next_send);
+                    c.next_send += interval;
+                }
+                if ((int)c.intended.size() < opt.depth && c.next_send < wake) {
+                    wake = c.next_send;
+                }
+            }
+            flush(i);
+        }
+
+        int n = wait_events(m_epollfd, events.data(), events.size(), wake - now > 0 ? wake - now : 0);
+        for (int k = 0; k < n; ++k) {
+            size_t i = events[k].data.u64;
+            if (m_conns[i].fd < 0) {
+                continue;
+            }
+            if (events[k].events & EPOLLOUT) {
+                flush(i);
+            }
+            if (events[k].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                on_readable(i);
+            }
+        }
+    }
+}
+
+static void* worker(void* arg)
+{
+    // 默认 50us 的定时器松弛会让开环的请求统一晚发出去，算进延迟里
+    prctl(PR_SET_TIMERSLACK, 1UL);
+    worker_loop loop((worker_args*)arg);
+    loop.run();
+    return NULL;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [-c connections] [-t threads] [-d seconds] [-P depth] [-R rate] [-k | -C] [-H file] ip port path\n", prog);
+    fprintf(stderr, "  -P N  pipeline up to N requests per connection (default 1)\n");
+    fprintf(stderr, "  -R N  open loop at N requests/s in total, latency measured from the intended send time\n");
+    fprintf(stderr, "        (default 0: closed loop, each connection sends its next batch when the last one is answered)\n");
+    fprintf(stderr, "  -k    keep-alive (default): requests reuse their connection, as with ab -k\n");
+    fprintf(stderr, "  -C    close: every request uses a new connection with Connection: close (implies -P 1)\n");
+    fprintf(stderr, "  -H F  write the full latency distribution to F in HdrHistogram .hgrm format (microseconds)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    options opt;
+    opt.connections = 64;
+    opt.threads = 1;
+    opt.seconds = 5;
+    opt.depth = 1;
+    opt.rate = 0;
+    opt.keep_alive = true;
+    opt.hgrm = NULL;
+
+    int c;
+    while ((c = getopt(argc, argv, "c:t:d:P:R:kCH:")) != -1) {
+        switch (c) {
+            case 'c': opt.connections = atoi(optarg); break;
+            case 't': opt.threads = atoi(optarg); break;
+            case 'd': opt.seconds = atoi(optarg); break;
+            case 'P': opt.depth = atoi(optarg); break;
+            case 'R': opt.rate = atof(optarg); break;
+            case 'k': opt.keep_alive = true; break;
+            case 'C': opt.keep_alive = false; break;
+            case 'H': opt.hgrm = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (argc - optind < 3 || opt.connections <= 0 || opt.threads <= 0 || opt.depth <= 0 || opt.rate < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    opt.ip = argv[optind];
+    opt.port = atoi(argv[optind + 1]);
+    opt.path = argv[optind + 2];
+    if (!opt.keep_alive) {
+        opt.depth = 1;
+    }
+    if (opt.threads > opt.connections) {
+        opt.threads = opt.connections;
+    }
+
+    std::vector<worker_args> args(opt.threads);
+    std::vector<pthread_t> threads(opt.threads);
+    int first = 0;
+    for (int i = 0; i < opt.threads; ++i) {
+        args[i].opt = &opt;
+        args[i].first = first;
+        args[i].connections = opt.connections / opt.threads + (i < opt.connections % opt.threads ? 1 : 0);
+        args[i].result.requests = 0;
+        args[i].result.errors = 0;
+        args[i].result.non_2xx = 0;
+        first += args[i].connections;
+    }
+    int64_t start = now_ns();
+    for (int i = 0; i < opt.threads; ++i) {
+        pthread_create(&threads[i], NULL, worker, &args[i]);
+    }
+
+    long requests = 0, errors = 0, non_2xx = 0;
+    hdr_histogram latency;
+    hdr_histogram uncorrected;
+    hdr_histogram good;
+    for (int i = 0; i < opt.threads; ++i) {
+        pthread_join(threads[i], NULL);
+        requests += args[i].result.requests;
+        errors += args[i].result.errors;
+        non_2xx += args[i].result.non_2xx;
+        latency.add(args[i].result.latency);
+        uncorrected.add(args[i].result.uncorrected);
+        good.add(args[i].result.good);
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    if (latency.count() == 0) {
+        printf("no responses\n");
+        return 1;
+    }
+
+    printf("conns=%d depth=%d %s%s  %.0f req/s  p50 %.1f us  p99 %.1f us  p999 %.1f us  errors %ld\n",
+           opt.connections, opt.depth, opt.rate > 0 ? "open-loop" : "closed-loop", opt.keep_alive ? "" : " no-keepalive",
+           requests / seconds, latency.percentile(50) / 1e3, latency.percentile(99) / 1e3,
+           latency.percentile(99.9) / 1e3, errors);
+    if (opt.rate > 0) {
+        printf("  target %.0f req/s; without coordinated omission correction: p50 %.1f us  p99 %.1f us  p999 %.1f us\n",
+               opt.rate, uncorrected.percentile(50) / 1e3, uncorrected.percentile(99) / 1e3,
+               uncorrected.percentile(99.9) / 1e3);
+    }
+    if (non_2xx > 0) {
+        printf("  non-2xx responses: %ld;  goodput %.0f req/s  p50 %.1f us  p99 %.1f us  p999 %.1f us (2xx only)\n",
+               non_2xx, good.count() / seconds, good.percentile(50) / 1e3, good.percentile(99) / 1e3,
+               good.percentile(99.9) / 1e3);
+    }
+
+    const double percentiles[] = {50, 75, 90, 99, 99.9, 99.99, 99.999, 100};
+    printf("  latency distribution (us):");
+    for (double p : percentiles) {
+        printf("  %g%% %.1f", p, latency.percentile(p) / 1e3);
+    }
+    printf("\n  mean %.1f us  stddev %.1f us  max %.1f us\n", latency.mean() / 1e3, latency.stddev() / 1e3, latency.max() / 1e3);
+
+    if (opt.hgrm) {
+        FILE* out = fopen(opt.hgrm, "w");
+        if (!out) {
+            fprintf(stderr, "cannot open %s: %s\n", opt.hgrm, strerror(errno));
+            return 1;
+        }
+        latency.print_distribution(out, 1e3);
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+// 不经过事件循环，直接用 socketpair 驱动 http_conn 的 read/process/write，
+// 测量不同请求头大小下的单连接处理吞吐
+#include "http_conn.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+extern const char* doc_root;
+
+static int g_epollfd = -1;
+
+static double now_seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string make_request(size_t header_bytes)
+{
+    std::string req = "GET /index.html HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n";
+    int n = 0;
+    while (req.size() < header_bytes) {
+        req += "X-Padding-" + std::to_string(n++) + ": " + std::string(100, 'a') + "\r\n";
+    }
+    req += "\r\n";
+    return req;
+}
+
+static void run(size_t header_bytes, int iterations)
+{
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    int bufsize = 1 << 20;
+    setsockopt(sv[1], SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+
+    http_conn conn;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    conn.init(sv[0], addr, g_epollfd);
+
+    std::string req = make_request(header_bytes);
+    std::vector<char> resp(1 << 16);
+    int ok = 0;
+    double start = now_seconds();
+    for (int i = 0; i < iterations; ++i) {
+        send(sv[1], req.data(), req.size(), 0);
+        if (!conn.read()) break;
+        conn.process();
+        if (!conn.write()) break;
+        ssize_t n = recv(sv[1], resp.data(), resp.size(), 0);
+        if (n <= 0 || strncmp(resp.data(), "HTTP/1.1 200", 12) != 0) break;
+        ++ok;
+    }
+    double seconds = now_seconds() - start;
+
+    if (ok == iterations) {
+        printf("headers=%-6zu %9.0f req/s  %8.1f MB/s\n", req.size(), ok / seconds, ok * req.size() / seconds / 1e6);
+    } else {
+        printf("headers=%-6zu rejected after %d requests\n", req.size(), ok);
+    }
+    conn.close_conn();
+    close(sv[1]);
+}
+
+int main()
+{
+    char dir[] = "/tmp/http_conn_benchXXXXXX";
+    doc_root = mkdtemp(dir);
+    std::string index = std::string(doc_root) + "/index.html";
+    FILE* f = fopen(index.c_str(), "w");
+    fputs("<html><body>hello</body></html>\n", f);
+    fclose(f);
+    chmod(index.c_str(), 0644);
+
+    g_epollfd = epoll_create1(0);
+    for (size_t bytes : {512, 1024, 4096, 16384, 32768}) {
+        run(bytes, 20000);
+    }
+
+    unlink(index.c_str());
+    rmdir(doc_root);
+    return 0;
+}
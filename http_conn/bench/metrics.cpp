@@ -0,0 +1,69 @@
+// 测量指标记录的开销：一次阶段计时(采样时两次 rdtsc 加一次直方图记录，平摊到每次)、一次计数器自增，
+// 以及 8 个线程都有数据时生成一次 /metrics 输出的耗时。
+// 整个服务器的开销用 -DHTTP_CONN_NO_METRICS 编译的版本对比 bench/http_load 的吞吐
+#include "metrics.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <chrono>
+#include <string>
+
+static double now_seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void* fill(void*)
+{
+    for (int i = 0; i < 100000; ++i) {
+        metrics::STAGE stage = (metrics::STAGE)(i % metrics::STAGE_COUNT);
+        metrics::finish(stage, metrics::start(stage));
+    }
+    return NULL;
+}
+
+int main()
+{
+    const int iterations = 10000000;
+
+    double start = now_seconds();
+    uint64_t sink = 0;
+    for (int i = 0; i < iterations; ++i) {
+        sink += metrics::ticks();
+    }
+    double ticks_ns = (now_seconds() - start) * 1e9 / iterations;
+
+    start = now_seconds();
+    for (int i = 0; i < iterations; ++i) {
+        metrics::scope timing(metrics::STAGE_PROCESS_READ);
+    }
+    double scope_ns = (now_seconds() - start) * 1e9 / iterations;
+
+    start = now_seconds();
+    for (int i = 0; i < iterations; ++i) {
+        metrics::count(metrics::COUNTER_REQUESTS);
+    }
+    double count_ns = (now_seconds() - start) * 1e9 / iterations;
+
+    printf("ticks()         %5.1f ns\n", ticks_ns);
+    printf("scope (stage)   %5.1f ns  (1 in %d timed)\n", scope_ns, metrics::SAMPLE_EVERY);
+    printf("count           %5.1f ns\n", count_ns);
+
+    pthread_t threads[8];
+    for (int i = 0; i < 8; ++i) {
+        pthread_create(&threads[i], NULL, fill, NULL);
+    }
+    for (int i = 0; i < 8; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    const int scrapes = 100;
+    size_t bytes = 0;
+    start = now_seconds();
+    for (int i = 0; i < scrapes; ++i) {
+        std::string out;
+        metrics::instance()->render(out);
+        bytes = out.size();
+    }
+    printf("render          %5.1f us  (9 threads, %zu bytes)\n", (now_seconds() - start) * 1e6 / scrapes, bytes);
+    return sink == 0;
+}
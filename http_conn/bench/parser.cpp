@@ -0,0 +1,193 @@
+// 只测请求解析：把请求拆成行，解析请求行，并建立头部字段索引。
+// 比较原来逐字节找行尾 + strpbrk/strncasecmp 的解析和 http_parser 的向量化扫描
+#include "http_parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+static double now_seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct sample
+{
+    const char* name;
+    std::string text;
+};
+
+static std::vector<sample> make_samples()
+{
+    std::vector<sample> samples;
+    samples.push_back({"curl",
+        "GET /index.html HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "User-Agent: curl/8.4.0\r\n"
+        "Accept: */*\r\n"
+        "\r\n"});
+    samples.push_back({"browser",
+        "GET /static/js/app.3f9c2a.js HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "Connection: keep-alive\r\n"
+        "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+        "sec-ch-ua-mobile: ?0\r\n"
+        "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+        "sec-ch-ua-platform: \"Windows\"\r\n"
+        "Accept: */*\r\n"
+        "Sec-Fetch-Site: same-origin\r\n"
+        "Sec-Fetch-Mode: no-cors\r\n"
+        "Sec-Fetch-Dest: script\r\n"
+        "Referer: https://www.example.com/dashboard\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Accept-Language: en-US,en;q=0.9,zh-CN;q=0.8,zh;q=0.7\r\n"
+        "\r\n"});
+
+    // 带大 Cookie 和 JWT 的 API 请求
+    std::string cookie = "Cookie: ";
+    for (int i = 0; i < 24; ++i) {
+        cookie += "_ga_" + std::to_string(i) + "=GS1.1.1697000000.12.1.1697000123.0.0.0; ";
+    }
+    std::string jwt = "Authorization: Bearer ";
+    for (int i = 0; i < 12; ++i) {
+        jwt += "eyJhbGciOiJIUzI1NiIsInR5cCI6IkpXVCJ9";
+    }
+    samples.push_back({"api+cookie",
+        "GET /api/v2/orders?page=3&limit=50 HTTP/1.1\r\n"
+        "Host: api.example.com\r\n"
+        "Connection: keep-alive\r\n"
+        "Accept: application/json\r\n"
+        "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 (KHTML, like Gecko) Version/17.0 Safari/605.1.15\r\n"
+        + jwt + "\r\n" + cookie + "\r\n"
+        "X-Request-Id: 9b2f6c1e-4d8a-4e0b-a1f3-6c7d8e9f0a1b\r\n"
+        "\r\n"});
+    return samples;
+}
+
+// 原来的解析方式：逐字节找行尾，strpbrk 拆请求行，strncasecmp 逐个比较字段名
+static int legacy_parse(char* buf, int n)
+{
+    int checked = 0, start = 0, headers = 0;
+    bool request_line = true;
+    while (true) {
+        for (; checked < n; ++checked) {
+            if (buf[checked] == '\r' && checked + 1 < n && buf[checked + 1] == '\n') {
+                break;
+            }
+        }
+        if (checked >= n) {
+            return -1;
+        }
+        buf[checked++] = '\0';
+        buf[checked++] = '\0';
+        char* text = buf + start;
+        start = checked;
+
+        if (request_line) {
+            char* url = strpbrk(text, " \t");
+            if (!url) return -1;
+            *url++ = '\0';
+            if (strcasecmp(text, "GET") != 0) return -1;
+            url += strspn(url, " \t");
+            char* version = strpbrk(url, " \t");
+            if (!version) return -1;
+            *version++ = '\0';
+            version += strspn(version, " \t");
+            if (strcasecmp(version, "HTTP/1.1") != 0) return -1;
+            request_line = false;
+        } else if (text[0] == '\0') {
+            return headers;
+        } else if (strncasecmp(text, "Connection:", 11) == 0) {
+            ++headers;
+        } else if (strncasecmp(text, "Content-Length:", 15) == 0) {
+            ++headers;
+        } else if (strncasecmp(text, "Host:", 5) == 0) {
+            ++headers;
+        } else {
+            ++headers;
+        }
+    }
+}
+
+// http_conn 现在的解析方式：向量化找行尾，按长度拆请求行，头部字段记入视图索引
+static int simd_parse(char* buf, int n, http_parser::scan_fn find_line_end, std::vector<http_header>& index)
+{
+    index.clear();
+    const char* end = buf + n;
+    char* line = buf;
+    bool request_line = true;
+    while (true) {
+        char* eol = (char*)find_line_end(line, end);
+        if (eol + 1 >= end || eol[0] != '\r' || eol[1] != '\n') {
+            return -1;
+        }
+        eol[0] = eol[1] = '\0';
+        int len = eol - line;
+        char* text = line;
+        line = eol + 2;
+
+        if (request_line) {
+            char* url = (char*)http_parser::find_space(text, eol);
+            if (url == eol || !http_parser::iequals(std::string_view(text, url - text), "GET")) return -1;
+            url = (char*)http_parser::skip_space(url + 1, eol);
+            char* version = (char*)http_parser::find_space(url, eol);
+            if (version == eol) return -1;
+            version = (char*)http_parser::skip_space(version + 1, eol);
+            if (!http_parser::iequals(std::string_view(version, eol - version), "HTTP/1.1")) return -1;
+            request_line = false;
+        } else if (len == 0) {
+            return index.size();
+        } else {
+            http_header header;
+            if (!http_parser::split_header(text, len, &header)) return -1;
+            index.push_back(header);
+        }
+    }
+}
+
+int main()
+{
+    std::vector<sample> samples = make_samples();
+    struct impl
+    {
+        const char* name;
+        http_parser::scan_fn fn;
+    };
+    std::vector<impl> impls;
+    impls.push_back({"scalar", http_parser::find_line_end_scalar});
+#ifdef HTTP_PARSER_X86
+    impls.push_back({"sse2", http_parser::find_line_end_sse2});
+    if (__builtin_cpu_supports("avx2")) {
+        impls.push_back({"avx2", http_parser::find_line_end_avx2});
+    }
+#endif
+    printf("http_conn uses: %s\n", http_parser::implementation());
+
+    std::vector<http_header> index;
+    index.reserve(64);
+    for (size_t s = 0; s < samples.size(); ++s) {
+        const std::string& text = samples[s].text;
+        std::vector<char> buf(text.size());
+        int iterations = 2000000 / (text.size() / 64 + 1);
+
+        for (size_t k = 0; k <= impls.size(); ++k) {
+            bool legacy = k == 0;
+            int headers = 0;
+            double start = now_seconds();
+            for (int i = 0; i < iterations; ++i) {
+                // 解析会改写行尾，每次从原始请求拷贝一份
+                memcpy(buf.data(), text.data(), text.size());
+                headers = legacy ? legacy_parse(buf.data(), buf.size())
+                                 : simd_parse(buf.data(), buf.size(), impls[k - 1].fn, index);
+            }
+            double seconds = now_seconds() - start;
+            printf("%-10s %5zu bytes %2d headers  %-7s %8.0f MB/s  %6.2f M req/s\n",
+                   samples[s].name, text.size(), headers, legacy ? "legacy" : impls[k - 1].name,
+                   iterations * text.size() / seconds / 1e6, iterations / seconds / 1e6);
+        }
+    }
+    return 0;
+}
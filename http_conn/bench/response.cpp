@@ -0,0 +1,128 @@
+// 测量生成一个应答头(状态行、Date、Content-Length、Connection、空行)的耗时。
+// 比较原来每个字段一次 vsnprintf 的写法和 http_response 的预生成片段 + 查表整数转换
+#include "http_response.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <chrono>
+
+static double now_seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const int BUFFER_SIZE = 1024;
+
+struct writer
+{
+    char buf[BUFFER_SIZE];
+    int idx;
+
+    bool add_response(const char* format, ...)
+    {
+        if (idx >= BUFFER_SIZE) {
+            return false;
+        }
+        va_list arg_list;
+        va_start(arg_list, format);
+        int len = vsnprintf(buf + idx, BUFFER_SIZE - 1 - idx, format, arg_list);
+        va_end(arg_list);
+        if (len >= BUFFER_SIZE - 1 - idx) {
+            return false;
+        }
+        idx += len;
+        return true;
+    }
+
+    bool add_bytes(const char* data, int len)
+    {
+        if (idx + len > BUFFER_SIZE) {
+            return false;
+        }
+        memcpy(buf + idx, data, len);
+        idx += len;
+        return true;
+    }
+};
+
+// 原来的写法，Date 字段按同样的格式用 strftime 生成
+static int legacy_build(writer& w, int status, const char* title, int content_len, bool linger)
+{
+    w.idx = 0;
+    time_t now = time(NULL);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    char date[64];
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    w.add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    w.add_response("Date: %s\r\n", date);
+    w.add_response("Content-Length: %d\r\n", content_len);
+    w.add_response("Connection: %s\r\n", linger ? "keep-alive" : "close");
+    w.add_response("%s", "\r\n");
+    return w.idx;
+}
+
+// 改动之前 http_conn 实际生成的应答头，没有 Date 字段
+static int legacy_no_date_build(writer& w, int status, const char* title, int content_len, bool linger)
+{
+    w.idx = 0;
+    w.add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    w.add_response("Content-Length: %d\r\n", content_len);
+    w.add_response("Connection: %s\r\n", linger ? "keep-alive" : "close");
+    w.add_response("%s", "\r\n");
+    return w.idx;
+}
+
+// 和 http_conn::add_status_line/add_headers 相同的拼接方式
+static int template_build(writer& w, int status, const char*, int content_len, bool linger)
+{
+    w.idx = 0;
+    const http_response::chunk* line = http_response::status_line(status);
+    w.add_bytes(line->data, line->len);
+    const http_response::chunk& date = http_response::date();
+    w.add_bytes(date.data, date.len);
+    char buf[40] = "Content-Length: ";
+    int len = 16;
+    len += http_response::format_uint(buf + len, content_len);
+    buf[len++] = '\r';
+    buf[len++] = '\n';
+    w.add_bytes(buf, len);
+    const http_response::chunk& conn = http_response::connection(linger);
+    w.add_bytes(conn.data, conn.len);
+    w.add_bytes("\r\n", 2);
+    return w.idx;
+}
+
+typedef int (*build_fn)(writer&, int, const char*, int, bool);
+
+static void run(const char* name, build_fn build, int status, const char* title)
+{
+    const int iterations = 2000000;
+    writer w;
+    long bytes = 0;
+    double start = now_seconds();
+    for (int i = 0; i < iterations; ++i) {
+        bytes += build(w, status, title, 100 + (i & 0xffff), i & 1);
+    }
+    double seconds = now_seconds() - start;
+    printf("%-10s %d  %6.1f ns/op  (%ld bytes)\n", name, status, seconds * 1e9 / iterations, bytes / iterations);
+}
+
+int main()
+{
+    // 两种写法的输出必须一致
+    writer a, b;
+    int la = legacy_build(a, 404, "Not Found", 12345, true);
+    int lb = template_build(b, 404, "Not Found", 12345, true);
+    if (la != lb || memcmp(a.buf, b.buf, la) != 0) {
+        printf("outputs differ:\n%.*s\n%.*s\n", la, a.buf, lb, b.buf);
+        return 1;
+    }
+
+    run("old", legacy_no_date_build, 200, "OK");
+    run("vsnprintf", legacy_build, 200, "OK");
+    run("template", template_build, 200, "OK");
+    run("vsnprintf", legacy_build, 404, "Not Found");
+    run("template", template_build, 404, "Not Found");
+    return 0;
+}
@@ -0,0 +1,169 @@
+// 测量路由查找的耗时：分别注册10、1千、1万条路由(静态路径、带参数的路径、通配路径混合)，
+// 随机查找已注册路由对应的具体路径。作为对比，也测量逐条比较模式的线性查找。
+// 同时统计查找期间的内存分配次数，应当为0
+#include "router.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+static double now_seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static long g_allocations = 0;
+
+void* operator new(size_t size)
+{
+    ++g_allocations;
+    void* p = malloc(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+static int handler(const route_match&, std::string&)
+{
+    return 200;
+}
+
+// 第 i 条路由的模式，以及一个能匹配它的具体路径
+static void make_route(int i, std::string* pattern, std::string* path)
+{
+    std::string n = std::to_string(i);
+    std::string v = std::to_string(i % 3);
+    switch (i % 4) {
+        case 0:
+            *pattern = "/static/group" + std::to_string(i / 100) + "/file" + n + ".css";
+            *path = *pattern;
+            break;
+        case 1:
+            *pattern = "/api/v" + v + "/resource" + n + "/:id";
+            *path = "/api/v" + v + "/resource" + n + "/12345";
+            break;
+        case 2:
+            *pattern = "/api/v" + v + "/resource" + n + "/:id/items/:item";
+            *path = "/api/v" + v + "/resource" + n + "/42/items/abcdef";
+            break;
+        default:
+            *pattern = "/files" + n + "/*path";
+            *path = "/files" + n + "/a/b/c/d.txt";
+            break;
+    }
+}
+
+// 逐条比较的线性查找，按 '/' 分段匹配
+static bool linear_match(const std::vector<std::string>& patterns, std::string_view path, route_match* match)
+{
+    for (size_t r = 0; r < patterns.size(); ++r) {
+        std::string_view p = patterns[r];
+        std::string_view s = path;
+        match->param_count = 0;
+        bool ok = true;
+        while (ok && !p.empty()) {
+            if (p[0] == '*') {
+                match->values[match->param_count++] = s;
+                s = std::string_view();
+                p = std::string_view();
+                break;
+            }
+            if (p[0] == ':') {
+                size_t pe = p.find('/');
+                size_t se = s.find('/');
+                std::string_view value = s.substr(0, se);
+                if (value.empty()) {
+                    ok = false;
+                    break;
+                }
+                match->values[match->param_count++] = value;
+                p = pe == std::string_view::npos ? std::string_view() : p.substr(pe);
+                s = se == std::string_view::npos ? std::string_view() : s.substr(se);
+                continue;
+            }
+            if (s.empty() || s[0] != p[0]) {
+                ok = false;
+                break;
+            }
+            p.remove_prefix(1);
+            s.remove_prefix(1);
+        }
+        if (ok && s.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void run(int routes)
+{
+    router r;
+    std::vector<std::string> patterns(routes);
+    std::vector<std::string> paths(routes);
+    for (int i = 0; i < routes; ++i) {
+        make_route(i, &patterns[i], &paths[i]);
+        if (!r.add(0, patterns[i].c_str(), handler)) {
+            printf("add failed: %s\n", patterns[i].c_str());
+        }
+    }
+    r.compile();
+
+    const int lookups = 1 << 16;
+    std::vector<int> order(lookups);
+    for (int k = 0; k < lookups; ++k) {
+        order[k] = rand() % routes;
+    }
+
+    const int rounds = 20;
+    route_match match;
+    int found = 0;
+    long bytes = 0;
+    long allocations = g_allocations;
+    double start = now_seconds();
+    for (int round = 0; round < rounds; ++round) {
+        for (int k = 0; k < lookups; ++k) {
+            const std::string& path = paths[order[k]];
+            found += r.find(0, path, &match) && match.route->pattern == patterns[order[k]];
+            bytes += path.size();
+        }
+    }
+    double trie_ns = (now_seconds() - start) * 1e9 / (rounds * lookups);
+    allocations = g_allocations - allocations;
+
+    // 线性查找太慢，只查一部分
+    int linear_lookups = routes >= 10000 ? 2000 : lookups;
+    start = now_seconds();
+    int linear_found = 0;
+    for (int k = 0; k < linear_lookups; ++k) {
+        linear_found += linear_match(patterns, paths[order[k]], &match);
+    }
+    double linear_ns = (now_seconds() - start) * 1e9 / linear_lookups;
+
+    printf("%6d routes  trie %6.1f ns/lookup (%4.1f bytes/path, %ld allocations, %s)  linear %10.1f ns/lookup (%s)\n",
+           routes, trie_ns, double(bytes) / (rounds * lookups), allocations,
+           found == rounds * lookups ? "ok" : "MISMATCH", linear_ns,
+           linear_found == linear_lookups ? "ok" : "MISMATCH");
+}
+
+int main()
+{
+    srand(1);
+    run(10);
+    run(1000);
+    run(10000);
+    return 0;
+}
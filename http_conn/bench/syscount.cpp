@@ -0,0 +1,286 @@
+// 用 ptrace 跟踪 http_conn 服务器进程(包括它的所有线程)，统计每个请求平均用了多少个系统调用、分别是哪些，
+// 对比 epoll 后端(请求在 reactor 线程处理 / 交给线程池)和 io_uring 后端。
+// 客户端在另一个线程里，每个连接发一个请求，收齐所有连接的应答后再发下一轮；只统计预热之后的那段。
+// 跟踪本身让系统调用慢很多，这里不看吞吐，吞吐用 bench/http_load 测(make load SERVER_ARGS="-b uring")
+// 用法: syscount [server] [port] [requests] [connections]
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+static const char* syscall_name(long nr)
+{
+    switch (nr) {
+        case SYS_read: return "read";
+        case SYS_write: return "write";
+        case SYS_readv: return "readv";
+        case SYS_writev: return "writev";
+        case SYS_recvfrom: return "recvfrom";
+        case SYS_sendto: return "sendto";
+        case SYS_recvmsg: return "recvmsg";
+        case SYS_sendmsg: return "sendmsg";
+        case SYS_sendfile: return "sendfile";
+        case SYS_accept: return "accept";
+        case SYS_accept4: return "accept4";
+        case SYS_close: return "close";
+        case SYS_openat: return "openat";
+        case SYS_fstat: return "fstat";
+        case SYS_newfstatat: return "newfstatat";
+        case SYS_mmap: return "mmap";
+        case SYS_munmap: return "munmap";
+        case SYS_epoll_wait: return "epoll_wait";
+        case SYS_epoll_pwait: return "epoll_pwait";
+        case SYS_epoll_ctl: return "epoll_ctl";
+        case SYS_io_uring_enter: return "io_uring_enter";
+        case SYS_futex: return "futex";
+        case SYS_clock_gettime: return "clock_gettime";
+        case SYS_getpeername: return "getpeername";
+        case SYS_setsockopt: return "setsockopt";
+        case SYS_fcntl: return "fcntl";
+        case SYS_madvise: return "madvise";
+        case SYS_sched_yield: return "sched_yield";
+    }
+    return NULL;
+}
+
+static int connect_to(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 读一个应答(只有 Content-Length 的)，in 里保留多读的部分
+static bool read_response(int fd, std::string& in)
+{
+    char buf[16 * 1024];
+    size_t end;
+    while ((end = in.find("\r\n\r\n")) == std::string::npos || in.size() < end + 4) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return false;
+        in.append(buf, n);
+    }
+    const char* length = strcasestr(in.c_str(), "Content-Length:");
+    size_t total = end + 4 + (length ? atol(length + 15) : 0);
+    while (in.size() < total) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return false;
+        in.append(buf, n);
+    }
+    in.erase(0, total);
+    return true;
+}
+
+struct load_args
+{
+    pid_t server;
+    int port;
+    int requests;
+    int connections;
+    // 统计窗口：客户端开始正式发请求时置位，发完后清零
+    std::atomic<bool> measuring;
+    int completed;
+    bool failed;
+};
+
+static void* load_thread(void* arg)
+{
+    load_args* args = (load_args*)arg;
+    std::vector<int> fds;
+    for (int tries = 0; tries < 200 && fds.empty(); ++tries) {
+        int fd = connect_to(args->port);
+        if (fd >= 0) {
+            fds.push_back(fd);
+        } else {
+            usleep(20 * 1000);
+        }
+    }
+    while (!fds.empty() && (int)fds.size() < args->connections) {
+        int fd = connect_to(args->port);
+        if (fd < 0) break;
+        fds.push_back(fd);
+    }
+    args->failed = (int)fds.size() < args->connections;
+
+    const char request[] = "GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    std::vector<std::string> in(fds.size());
+    int warmup = args->requests / 10;
+    int sent = 0;
+    while (!args->failed && sent < warmup + args->requests) {
+        if (sent >= warmup) {
+            args->measuring = true;
+        }
+        for (size_t i = 0; i < fds.size(); ++i) {
+            if (send(fds[i], request, sizeof(request) - 1, MSG_NOSIGNAL) != sizeof(request) - 1) args->failed = true;
+        }
+        for (size_t i = 0; i < fds.size() && !args->failed; ++i) {
+            if (!read_response(fds[i], in[i])) args->failed = true;
+        }
+        sent += fds.size();
+        if (args->measuring) {
+            args->completed += fds.size();
+        }
+    }
+    args->measuring = false;
+    for (size_t i = 0; i < fds.size(); ++i) {
+        close(fds[i]);
+    }
+    kill(args->server, SIGKILL);
+    return NULL;
+}
+
+// 启动并跟踪服务器，直到它被客户端线程杀掉；counts 按系统调用号累计统计窗口内的次数
+static bool run(const char* server, const std::vector<const char*>& server_args, const char* root, int port,
+                int requests, int connections, std::map<long, long>& counts, int* completed)
+{
+    std::string port_str = std::to_string(port);
+    std::vector<const char*> argv;
+    argv.push_back(server);
+    argv.insert(argv.end(), server_args.begin(), server_args.end());
+    argv.push_back("127.0.0.1");
+    argv.push_back(port_str.c_str());
+    argv.push_back(root);
+    argv.push_back(NULL);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        freopen("/dev/null", "w", stdout);
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        execv(server, (char* const*)argv.data());
+        _exit(127);
+    }
+    // exec 之后服务器停在 SIGTRAP 上
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) {
+        return false;
+    }
+    ptrace(PTRACE_SETOPTIONS, pid, NULL,
+           (void*)(long)(PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL));
+    ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+
+    load_args args;
+    args.server = pid;
+    args.port = port;
+    args.requests = requests;
+    args.connections = connections;
+    args.measuring = false;
+    args.completed = 0;
+    args.failed = false;
+    pthread_t thread;
+    pthread_create(&thread, NULL, load_thread, &args);
+
+    // 每个线程交替停在系统调用的入口和出口，只在入口计数
+    std::set<pid_t> in_syscall;
+    while (true) {
+        pid_t tid = waitpid(-1, &status, __WALL);
+        if (tid < 0) break;
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            in_syscall.erase(tid);
+            if (tid == pid) break;
+            continue;
+        }
+        int sig = 0;
+        if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+            if (in_syscall.erase(tid) == 0) {
+                in_syscall.insert(tid);
+                if (args.measuring) {
+                    long nr = ptrace(PTRACE_PEEKUSER, tid, (void*)offsetof(struct user_regs_struct, orig_rax), NULL);
+                    ++counts[nr];
+                }
+            }
+        } else if (WSTOPSIG(status) != SIGTRAP && WSTOPSIG(status) != SIGSTOP) {
+            // 其他信号原样交给服务器；新线程开始时的 SIGSTOP 和 clone 事件的 SIGTRAP 不用转发
+            sig = WSTOPSIG(status);
+        }
+        ptrace(PTRACE_SYSCALL, tid, NULL, (void*)(long)sig);
+    }
+    pthread_join(thread, NULL);
+    *completed = args.completed;
+    return !args.failed;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* server = argc > 1 ? argv[1] : "./http_conn";
+    int port = argc > 2 ? atoi(argv[2]) : 9303;
+    int requests = argc > 3 ? atoi(argv[3]) : 20000;
+    int connections = argc > 4 ? atoi(argv[4]) : 16;
+
+    char dir[] = "/tmp/http_conn_syscountXXXXXX";
+    mkdtemp(dir);
+    std::string index = std::string(dir) + "/index.html";
+    std::ofstream(index) << "<html><body>hello</body></html>\n";
+
+    struct config
+    {
+        const char* name;
+        std::vector<const char*> args;
+    };
+    const config configs[] = {
+        {"epoll -t 0", {"-b", "epoll", "-t", "0"}},
+        {"epoll -t 8", {"-b", "epoll"}},
+        {"uring", {"-b", "uring"}},
+    };
+
+    printf("%d requests over %d keep-alive connections, syscalls per request (all server threads)\n", requests,
+           connections);
+    for (const config& c : configs) {
+        std::map<long, long> counts;
+        int completed = 0;
+        if (!run(server, c.args, dir, port, requests, connections, counts, &completed) || completed == 0) {
+            printf("%-11s failed\n", c.name);
+            continue;
+        }
+        long total = 0;
+        std::vector<std::pair<long, long>> sorted;
+        for (auto& entry : counts) {
+            total += entry.second;
+            sorted.push_back(std::make_pair(entry.second, entry.first));
+        }
+        std::sort(sorted.rbegin(), sorted.rend());
+        printf("%-11s %6.2f  ", c.name, (double)total / completed);
+        for (size_t i = 0; i < sorted.size() && (double)sorted[i].first / completed >= 0.01; ++i) {
+            const char* name = syscall_name(sorted[i].second);
+            if (name) {
+                printf(" %s %.2f", name, (double)sorted[i].first / completed);
+            } else {
+                printf(" syscall_%ld %.2f", sorted[i].second, (double)sorted[i].first / completed);
+            }
+        }
+        printf("\n");
+        // 等端口释放(SO_REUSEADDR 之外还有 TIME_WAIT 的连接)
+        usleep(200 * 1000);
+    }
+
+    unlink(index.c_str());
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,96 @@
+// 任务分发吞吐和排队延迟：一个线程(相当于主线程)不断提交空任务，比较 threadpool 和 work_stealing_pool
+#include "threadpool.h"
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string.h>
+#include <vector>
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::atomic<int> g_done(0);
+
+struct task
+{
+    int64_t enqueued;
+    int64_t latency;
+
+    void process()
+    {
+        latency = now_ns() - enqueued;
+        g_done.fetch_add(1, std::memory_order_release);
+    }
+};
+
+template<typename Pool>
+static void run(const char* name, Pool* pool, int workers, int count)
+{
+    std::vector<task> tasks(count);
+    g_done.store(0);
+
+    int64_t start = now_ns();
+    for (int i = 0; i < count; ++i) {
+        tasks[i].enqueued = now_ns();
+        while (!pool->append(&tasks[i])) {
+            sched_yield();
+        }
+    }
+    while (g_done.load(std::memory_order_acquire) < count) {
+        sched_yield();
+    }
+    double seconds = (now_ns() - start) / 1e9;
+
+    std::vector<int64_t> latencies(count);
+    for (int i = 0; i < count; ++i) latencies[i] = tasks[i].latency;
+    std::sort(latencies.begin(), latencies.end());
+
+    printf("%-20s workers=%-3d saturated %7.3f M tasks/s  queueing p50 %7.1f us  p99 %7.1f us\n", name, workers,
+            count / seconds / 1e6, latencies[count / 2] / 1e3, latencies[count * 99 / 100] / 1e3);
+}
+
+// 每次只提交一个任务并等它完成，测量线程池空闲时的分发延迟(包括唤醒工作线程的开销)
+template<typename Pool>
+static void run_one_by_one(const char* name, Pool* pool, int workers, int count)
+{
+    std::vector<task> tasks(count);
+    g_done.store(0);
+
+    for (int i = 0; i < count; ++i) {
+        tasks[i].enqueued = now_ns();
+        pool->append(&tasks[i]);
+        while (g_done.load(std::memory_order_acquire) <= i) {
+            sched_yield();
+        }
+    }
+
+    std::vector<int64_t> latencies(count);
+    for (int i = 0; i < count; ++i) latencies[i] = tasks[i].latency;
+    std::sort(latencies.begin(), latencies.end());
+
+    printf("%-20s workers=%-3d one-by-one dispatch p50 %7.1f us  p99 %7.1f us\n", name, workers,
+            latencies[count / 2] / 1e3, latencies[count * 99 / 100] / 1e3);
+}
+
+int main(int argc, char* argv[])
+{
+    bool pin = argc > 1 && strcmp(argv[1], "--pin") == 0;
+    const int count = 200000;
+
+    for (int workers : {1, 2, 4, 8, 16, 32, 64}) {
+        // threadpool 的析构函数不会等待工作线程退出，这里有意不释放它
+        threadpool<task>* locked = new threadpool<task>(workers, 10000);
+        run("threadpool", locked, workers, count);
+        run_one_by_one("threadpool", locked, workers, 20000);
+
+        work_stealing_pool<task>* stealing = new work_stealing_pool<task>(workers, 10000, pin);
+        run("work_stealing_pool", stealing, workers, count);
+        run_one_by_one("work_stealing_pool", stealing, workers, 20000);
+        delete stealing;
+    }
+    return 0;
+}
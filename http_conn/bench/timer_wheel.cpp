@@ -0,0 +1,119 @@
+// 模拟10万个连接的超时管理：建立定时器、每次活动后重新设置、推进时间让它们到期，
+// 比较时间轮和按截止时间排序的 std::set(红黑树，每次重新设置都是 O(log n))
+#include "timer_wheel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <set>
+#include <utility>
+#include <vector>
+
+static double now_seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const int CONNECTIONS = 100000;
+// 每个连接的活动次数
+static const int ACTIVITIES = 20;
+
+struct result
+{
+    double schedule_ns;
+    double reschedule_ns;
+    double expire_ns;
+};
+
+static void print(const char* name, const result& r)
+{
+    printf("%-12s schedule %6.1f ns  reschedule %6.1f ns  expire %6.1f ns/timer\n",
+           name, r.schedule_ns, r.reschedule_ns, r.expire_ns);
+}
+
+static result run_wheel(const std::vector<int>& order)
+{
+    timer_wheel wheel(100, 512);
+    std::vector<timer_wheel::node> nodes(CONNECTIONS);
+    long now = timer_wheel::now_ms();
+    result r;
+
+    double start = now_seconds();
+    for (int i = 0; i < CONNECTIONS; ++i) {
+        wheel.schedule(&nodes[i], now, 10000 + i % 5000);
+    }
+    r.schedule_ns = (now_seconds() - start) * 1e9 / CONNECTIONS;
+
+    // 活动按随机顺序到达，时间缓慢前进
+    start = now_seconds();
+    for (size_t k = 0; k < order.size(); ++k) {
+        now += (k & 1023) == 0;
+        wheel.schedule(&nodes[order[k]], now, 15000);
+    }
+    r.reschedule_ns = (now_seconds() - start) * 1e9 / order.size();
+
+    // 时间跳过所有截止时间，分多步推进
+    int fired = 0;
+    start = now_seconds();
+    for (long t = now; t <= now + 20000; t += 100) {
+        fired += wheel.expire(t, [](timer_wheel::node*) {});
+    }
+    r.expire_ns = (now_seconds() - start) * 1e9 / CONNECTIONS;
+    if (fired != CONNECTIONS || wheel.size() != 0) {
+        printf("wheel: fired %d of %d\n", fired, CONNECTIONS);
+    }
+    return r;
+}
+
+static result run_set(const std::vector<int>& order)
+{
+    std::set<std::pair<long, int> > timers;
+    std::vector<long> deadline(CONNECTIONS);
+    long now = timer_wheel::now_ms();
+    result r;
+
+    double start = now_seconds();
+    for (int i = 0; i < CONNECTIONS; ++i) {
+        deadline[i] = now + 10000 + i % 5000;
+        timers.insert(std::make_pair(deadline[i], i));
+    }
+    r.schedule_ns = (now_seconds() - start) * 1e9 / CONNECTIONS;
+
+    start = now_seconds();
+    for (size_t k = 0; k < order.size(); ++k) {
+        now += (k & 1023) == 0;
+        int i = order[k];
+        timers.erase(std::make_pair(deadline[i], i));
+        deadline[i] = now + 15000;
+        timers.insert(std::make_pair(deadline[i], i));
+    }
+    r.reschedule_ns = (now_seconds() - start) * 1e9 / order.size();
+
+    int fired = 0;
+    start = now_seconds();
+    for (long t = now; t <= now + 20000; t += 100) {
+        while (!timers.empty() && timers.begin()->first <= t) {
+            timers.erase(timers.begin());
+            ++fired;
+        }
+    }
+    r.expire_ns = (now_seconds() - start) * 1e9 / CONNECTIONS;
+    if (fired != CONNECTIONS) {
+        printf("set: fired %d of %d\n", fired, CONNECTIONS);
+    }
+    return r;
+}
+
+int main()
+{
+    std::vector<int> order((size_t)CONNECTIONS * ACTIVITIES);
+    srand(1);
+    for (size_t k = 0; k < order.size(); ++k) {
+        order[k] = rand() % CONNECTIONS;
+    }
+
+    printf("%d connections, %d activities each\n", CONNECTIONS, ACTIVITIES);
+    print("timer_wheel", run_wheel(order));
+    print("std::set", run_set(order));
+    return 0;
+}
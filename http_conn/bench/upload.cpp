@@ -0,0 +1,171 @@
+// 启动 http_conn 服务器进程，测量 POST 上传的吞吐(Content-Length 和分块传输)，
+// 以及多个上传同时进行时服务器进程的内存峰值(VmHWM)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+static double now_seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static long status_kb(pid_t pid, const char* field)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    char line[256];
+    long kb = -1;
+    size_t n = strlen(field);
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, field, n) == 0) kb = atol(line + n);
+    }
+    fclose(f);
+    return kb;
+}
+
+static int connect_to(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool send_all(int fd, const char* data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static const size_t CHUNK = 64 * 1024;
+static char g_payload[CHUNK];
+static int g_port;
+
+// 上传 size 字节，返回服务器确认收到的字节数，出错返回 -1
+static long upload(size_t size, bool chunked)
+{
+    int fd = connect_to(g_port);
+    if (fd < 0) return -1;
+
+    std::string head = "POST /upload HTTP/1.1\r\nHost: localhost\r\n";
+    head += chunked ? std::string("Transfer-Encoding: chunked\r\n") : "Content-Length: " + std::to_string(size) + "\r\n";
+    head += "\r\n";
+    bool ok = send_all(fd, head.data(), head.size());
+    for (size_t sent = 0; ok && sent < size; sent += CHUNK) {
+        size_t n = size - sent < CHUNK ? size - sent : CHUNK;
+        if (chunked) {
+            char line[32];
+            int len = snprintf(line, sizeof(line), "%zx\r\n", n);
+            ok = send_all(fd, line, len) && send_all(fd, g_payload, n) && send_all(fd, "\r\n", 2);
+        } else {
+            ok = send_all(fd, g_payload, n);
+        }
+    }
+    if (ok && chunked) {
+        ok = send_all(fd, "0\r\n\r\n", 5);
+    }
+
+    char resp[1024];
+    long received = -1;
+    ssize_t n = ok ? recv(fd, resp, sizeof(resp) - 1, 0) : -1;
+    if (n > 0) {
+        resp[n] = '\0';
+        const char* body = strstr(resp, "\r\n\r\n");
+        if (body) received = atol(body + 4);
+    }
+    close(fd);
+    return received;
+}
+
+struct job
+{
+    size_t size;
+    long received;
+};
+
+static void* upload_thread(void* arg)
+{
+    job* j = (job*)arg;
+    j->received = upload(j->size, false);
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* server = argc > 1 ? argv[1] : "./http_conn";
+    g_port = argc > 2 ? atoi(argv[2]) : 9301;
+    memset(g_payload, 'x', sizeof(g_payload));
+
+    char dir[] = "/tmp/http_conn_benchXXXXXX";
+    mkdtemp(dir);
+
+    std::string port_str = std::to_string(g_port);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        freopen("/dev/null", "w", stdout);
+        execl(server, server, "-t", "0", "127.0.0.1", port_str.c_str(), dir, (char*)NULL);
+        _exit(127);
+    }
+    usleep(300 * 1000);
+    long base = status_kb(pid, "VmRSS:");
+
+    const size_t sizes[] = {1UL << 20, 16UL << 20, 256UL << 20, 1UL << 30};
+    for (size_t size : sizes) {
+        for (int chunked = 0; chunked <= 1; ++chunked) {
+            double start = now_seconds();
+            long received = upload(size, chunked);
+            double seconds = now_seconds() - start;
+            printf("%-7s %5zu MB  %7.0f MB/s  %s\n", chunked ? "chunked" : "length", size >> 20,
+                   size / seconds / 1e6, received == (long)size ? "ok" : "MISMATCH");
+        }
+    }
+
+    // 同时进行多个上传，看服务器内存峰值
+    const int uploads = 16;
+    std::vector<job> jobs(uploads);
+    std::vector<pthread_t> threads(uploads);
+    for (int i = 0; i < uploads; ++i) {
+        jobs[i].size = 64UL << 20;
+        pthread_create(&threads[i], NULL, upload_thread, &jobs[i]);
+    }
+    int ok = 0;
+    for (int i = 0; i < uploads; ++i) {
+        pthread_join(threads[i], NULL);
+        ok += jobs[i].received == (long)jobs[i].size;
+    }
+    long peak = status_kb(pid, "VmHWM:");
+    printf("%d concurrent 64 MB uploads (%d ok): rss %ld KB at start, peak %ld KB  (%.1f KB/upload)\n",
+           uploads, ok, base, peak, double(peak - base) / uploads);
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,185 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "locker.h"
+
+/**
+ * 按大小分级的缓冲区池，所有连接共享
+ * 缓冲区大小从 MIN_BUFFER_SIZE 开始按2倍分级，每一级从 slab(一次申请的一大块内存)中切出，
+ * 归还的缓冲区挂在该级的空闲链表上，下次直接复用。连接只在真正有数据要读写时才持有缓冲区，
+ * 空闲连接不占用缓冲区内存
+ */
+class buffer_pool
+{
+    public:
+        // 最小的一级缓冲区大小
+        static const int MIN_BUFFER_SIZE = 2048;
+        // 级数：2K, 4K, 8K, 16K, 32K, 64K
+        static const int SIZE_CLASSES = 6;
+        // 最大的一级缓冲区大小
+        static const int MAX_BUFFER_SIZE = MIN_BUFFER_SIZE << (SIZE_CLASSES - 1);
+        // 每次向系统申请的 slab 大小
+        static const int SLAB_SIZE = 64 * 1024;
+
+    public:
+        buffer_pool() {}
+        ~buffer_pool();
+
+        // 进程内共享的缓冲区池
+        static buffer_pool* instance();
+
+        // 取得一个至少 size 字节的缓冲区，实际大小写入 capacity；size 超过 MAX_BUFFER_SIZE 时返回 NULL
+        char* acquire(int size, int* capacity);
+        // 归还缓冲区，capacity 必须是 acquire 时得到的大小
+        void release(char* buf, int capacity);
+
+        // 已经向系统申请的字节数
+        size_t reserved_bytes();
+        // 正在被使用的字节数
+        size_t in_use_bytes();
+
+    private:
+        buffer_pool(const buffer_pool&);
+        buffer_pool& operator=(const buffer_pool&);
+
+        // 空闲缓冲区的前几个字节用来存放链表指针
+        struct free_node
+        {
+            free_node* next;
+        };
+
+        struct size_class
+        {
+            size_class() : free_list(NULL), in_use(0), reserved(0) {}
+
+            locker lock;
+            free_node* free_list;
+            int in_use;         // 被取走的缓冲区个数
+            int reserved;       // 已切出的缓冲区个数
+        };
+
+        static int class_index(int size);
+        static int class_size(int index) { return MIN_BUFFER_SIZE << index; }
+        // 申请一个 slab 并切成该级的缓冲区，调用时需持有该级的锁
+        bool refill(int index);
+
+        size_class m_classes[SIZE_CLASSES];
+        locker m_slab_lock;
+        std::vector<char*> m_slabs;
+};
+
+inline buffer_pool::~buffer_pool()
+{
+    for (size_t i = 0; i < m_slabs.size(); ++i) {
+        free(m_slabs[i]);
+    }
+}
+
+inline buffer_pool* buffer_pool::instance()
+{
+    static buffer_pool pool;
+    return &pool;
+}
+
+inline int buffer_pool::class_index(int size)
+{
+    int index = 0;
+    while (index < SIZE_CLASSES && class_size(index) < size) {
+        ++index;
+    }
+    return index;
+}
+
+inline bool buffer_pool::refill(int index)
+{
+    int size = class_size(index);
+    int slab_size = size > SLAB_SIZE ? size : SLAB_SIZE;
+    char* slab = (char*)malloc(slab_size);
+    if (!slab) {
+        return false;
+    }
+
+    m_slab_lock.lock();
+    try {
+        m_slabs.push_back(slab);
+    } catch (...) {
+        m_slab_lock.unlock();
+        free(slab);
+        return false;
+    }
+    m_slab_lock.unlock();
+
+    size_class& cls = m_classes[index];
+    for (int offset = 0; offset + size <= slab_size; offset += size) {
+        free_node* node = (free_node*)(slab + offset);
+        node->next = cls.free_list;
+        cls.free_list = node;
+        ++cls.reserved;
+    }
+    return true;
+}
+
+inline char* buffer_pool::acquire(int size, int* capacity)
+{
+    int index = class_index(size);
+    if (index >= SIZE_CLASSES) {
+        return NULL;
+    }
+
+    size_class& cls = m_classes[index];
+    cls.lock.lock();
+    if (!cls.free_list && !refill(index)) {
+        cls.lock.unlock();
+        return NULL;
+    }
+    free_node* node = cls.free_list;
+    cls.free_list = node->next;
+    ++cls.in_use;
+    cls.lock.unlock();
+
+    *capacity = class_size(index);
+    return (char*)node;
+}
+
+inline void buffer_pool::release(char* buf, int capacity)
+{
+    if (!buf) {
+        return;
+    }
+
+    size_class& cls = m_classes[class_index(capacity)];
+    free_node* node = (free_node*)buf;
+    cls.lock.lock();
+    node->next = cls.free_list;
+    cls.free_list = node;
+    --cls.in_use;
+    cls.lock.unlock();
+}
+
+inline size_t buffer_pool::reserved_bytes()
+{
+    size_t total = 0;
+    for (int i = 0; i < SIZE_CLASSES; ++i) {
+        m_classes[i].lock.lock();
+        total += (size_t)m_classes[i].reserved * class_size(i);
+        m_classes[i].lock.unlock();
+    }
+    return total;
+}
+
+inline size_t buffer_pool::in_use_bytes()
+{
+    size_t total = 0;
+    for (int i = 0; i < SIZE_CLASSES; ++i) {
+        m_classes[i].lock.lock();
+        total += (size_t)m_classes[i].in_use * class_size(i);
+        m_classes[i].lock.unlock();
+    }
+    return total;
+}
+
+#endif
@@ -0,0 +1,448 @@
+// 路由、请求头解析、分块传输解码和时间轮的正确性检查，bench/ 里只测耗时，这里用 assert 检查结果
+// 用法: make check
+#include "router.h"
+#include "http_parser.h"
+#include "http_conn.h"
+#include "timer_wheel.h"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <cassert>
+#include <iostream>
+#include <string>
+
+static int handler_a(const route_match&, std::string&)
+{
+    return 200;
+}
+
+static int handler_b(const route_match&, std::string&)
+{
+    return 201;
+}
+
+// 与 http_conn::METHOD 一致
+static const int GET = 0;
+static const int POST = 1;
+
+static const char* matched(const router& r, int method, const char* path, route_match* match)
+{
+    return r.find(method, path, match) ? match->route->pattern.c_str() : NULL;
+}
+
+static bool same(const char* a, const char* b)
+{
+    return a && b && std::string(a) == b;
+}
+
+// 静态路径、参数、通配，以及它们之间的优先级和回溯
+void test_case_1()
+{
+    router r;
+    assert(r.add(GET, "/", handler_a));
+    assert(r.add(GET, "/users/new", handler_a));
+    assert(r.add(GET, "/users/:id", handler_a));
+    assert(r.add(GET, "/users/:id/posts", handler_a));
+    assert(r.add(GET, "/users/*rest", handler_a));
+    assert(r.add(GET, "/search", handler_a));
+    assert(r.add(GET, "/settings", handler_a));
+    assert(r.add(GET, "/a/:x/b/:y", handler_a));
+    assert(r.add(GET, "/static/*file", handler_a));
+    assert(r.add(POST, "/users/:id", handler_b));
+
+    route_match m;
+    // 没有编译之前查不到
+    assert(!r.find(GET, "/", &m));
+    r.compile();
+    assert(r.size() == 10);
+
+    assert(same(matched(r, GET, "/", &m), "/"));
+    assert(m.param_count == 0);
+
+    // 静态优先于参数
+    assert(same(matched(r, GET, "/users/new", &m), "/users/new"));
+    assert(m.param_count == 0);
+    assert(same(matched(r, GET, "/users/42", &m), "/users/:id"));
+    assert(m.param_count == 1 && m.param("id") == "42");
+    assert(m.param("missing").empty());
+
+    // 静态的 new 后面走不通，回溯到参数
+    assert(same(matched(r, GET, "/users/new/posts", &m), "/users/:id/posts"));
+    assert(m.param_count == 1 && m.param("id") == "new");
+    assert(same(matched(r, GET, "/users/42/posts", &m), "/users/:id/posts"));
+    assert(m.param("id") == "42");
+
+    // 参数也走不通时落到通配，回溯时丢弃参数
+    assert(same(matched(r, GET, "/users/42/other", &m), "/users/*rest"));
+    assert(m.param_count == 1 && m.param("rest") == "42/other");
+    assert(m.param("id").empty());
+    // 参数不能为空，通配可以
+    assert(same(matched(r, GET, "/users/", &m), "/users/*rest"));
+    assert(m.param_count == 1 && m.param("rest").empty());
+    assert(same(matched(r, GET, "/static/", &m), "/static/*file"));
+    assert(m.param("file").empty());
+    assert(same(matched(r, GET, "/static/css/site.css", &m), "/static/*file"));
+    assert(m.param("file") == "css/site.css");
+
+    // 公共前缀劈开之后两边都能找到
+    assert(same(matched(r, GET, "/search", &m), "/search"));
+    assert(same(matched(r, GET, "/settings", &m), "/settings"));
+
+    assert(same(matched(r, GET, "/a/1/b/2", &m), "/a/:x/b/:y"));
+    assert(m.param_count == 2 && m.param("x") == "1" && m.param("y") == "2");
+    // 参数值指向被查找的路径，不拷贝
+    std::string path = "/a/first/b/second";
+    assert(r.find(GET, path, &m));
+    assert(m.param("x").data() == path.data() + 3);
+
+    // 按请求方法区分
+    assert(same(matched(r, POST, "/users/new", &m), "/users/:id"));
+    assert(m.param("id") == "new");
+    assert(m.route->handler == handler_b);
+    assert(!r.find(POST, "/users/42/posts", &m));
+    assert(!r.find(POST, "/", &m));
+}
+
+// 查不到的路径
+void test_case_2()
+{
+    router r;
+    assert(r.add(GET, "/users/new", handler_a));
+    assert(r.add(GET, "/users/:id", handler_a));
+    assert(r.add(GET, "/search", handler_a));
+    assert(r.add(GET, "/settings", handler_a));
+    assert(r.add(GET, "/a/:x/b/:y", handler_a));
+    r.compile();
+
+    route_match m;
+    assert(!r.find(GET, "", &m));
+    assert(!r.find(GET, "/", &m));
+    assert(!r.find(GET, "/user", &m));
+    assert(!r.find(GET, "/users", &m));
+    assert(!r.find(GET, "/users/", &m));
+    assert(!r.find(GET, "/users/42/", &m));
+    assert(!r.find(GET, "/users/new/posts", &m));
+    assert(!r.find(GET, "/se", &m));
+    assert(!r.find(GET, "/searchx", &m));
+    assert(!r.find(GET, "/Search", &m));
+    assert(!r.find(GET, "/a/1/b", &m));
+    assert(!r.find(GET, "/a/1/b/", &m));
+    assert(!r.find(GET, "/a//b/2", &m));
+    assert(!r.find(GET, "/a/1/c/2", &m));
+    // 请求方法超出范围
+    assert(!r.find(-1, "/search", &m));
+    assert(!r.find(router::METHOD_COUNT, "/search", &m));
+
+    // 参数超过 MAX_PARAMS 个时查不到
+    router deep;
+    std::string pattern, path;
+    for (int i = 0; i <= route_match::MAX_PARAMS; ++i) {
+        pattern += "/:p" + std::to_string(i);
+        path += "/" + std::to_string(i);
+    }
+    assert(deep.add(GET, pattern.c_str(), handler_a));
+    deep.compile();
+    assert(!deep.find(GET, path, &m));
+}
+
+// 不合法的模式和冲突的路由
+void test_case_3()
+{
+    router r;
+    assert(r.add(GET, "/users/:id", handler_a));
+    assert(r.add(GET, "/files/*path", handler_a));
+
+    // 同一个模式和请求方法只能注册一次，不同的方法可以
+    assert(!r.add(GET, "/users/:id", handler_b));
+    assert(r.add(POST, "/users/:id", handler_b));
+    // 同一个位置的参数或者通配必须同名
+    assert(!r.add(GET, "/users/:name/posts", handler_a));
+    assert(!r.add(POST, "/files/*rest", handler_a));
+    assert(r.add(GET, "/users/:id/posts", handler_a));
+
+    // 参数和通配符必须占据一整段，通配符只能在末尾
+    assert(!r.add(GET, "/user:id", handler_a));
+    assert(!r.add(GET, "/x/*path/more", handler_a));
+    assert(!r.add(GET, "/x/:", handler_a));
+    assert(!r.add(GET, "/x/*", handler_a));
+    assert(!r.add(GET, "/x/:a:b", handler_a));
+    assert(!r.add(GET, "/x/:a*b", handler_a));
+
+    // 模式必须以 '/' 开头，要有处理函数，请求方法在范围内
+    assert(!r.add(GET, "users", handler_a));
+    assert(!r.add(GET, "", handler_a));
+    assert(!r.add(GET, NULL, handler_a));
+    assert(!r.add(GET, "/ok", NULL));
+    assert(!r.add(-1, "/ok", handler_a));
+    assert(!r.add(router::METHOD_COUNT, "/ok", handler_a));
+    assert(r.size() == 4);
+
+    // 被拒绝的路由不影响已有的
+    r.compile();
+    route_match m;
+    assert(same(matched(r, GET, "/users/7/posts", &m), "/users/:id/posts"));
+    assert(same(matched(r, POST, "/users/7", &m), "/users/:id"));
+    assert(!r.find(GET, "/user7", &m));
+    assert(!r.find(GET, "/x/1/more", &m));
+}
+
+// 请求头拆分和大小写无关的比较
+void test_case_4()
+{
+    http_header h;
+    std::string line = "Host:  example.com \t";
+    assert(http_parser::split_header(line.data(), line.size(), &h));
+    assert(h.name == "Host" && h.value == "example.com");
+
+    line = "X-Note:\ta  b";
+    assert(http_parser::split_header(line.data(), line.size(), &h));
+    assert(h.name == "X-Note" && h.value == "a  b");
+
+    // 值可以为空，值里的冒号不影响拆分
+    line = "X-Empty: \t ";
+    assert(http_parser::split_header(line.data(), line.size(), &h));
+    assert(h.name == "X-Empty" && h.value.empty());
+    line = "Referer: http://host:80/";
+    assert(http_parser::split_header(line.data(), line.size(), &h));
+    assert(h.name == "Referer" && h.value == "http://host:80/");
+
+    // 只看 len 以内的部分
+    line = "Accept: */*\r\nHost: x";
+    assert(http_parser::split_header(line.data(), 11, &h));
+    assert(h.name == "Accept" && h.value == "*/*");
+
+    assert(!http_parser::split_header("NoColon", 7, &h));
+    assert(!http_parser::split_header(": value", 7, &h));
+    assert(!http_parser::split_header("", 0, &h));
+
+    assert(http_parser::iequals("Content-Length", "content-length"));
+    assert(http_parser::iequals("CHUNKED", "chunked"));
+    assert(http_parser::iequals("a1-Z", "A1-z"));
+    assert(http_parser::iequals("", ""));
+    assert(!http_parser::iequals("chunked", "chunke"));
+    assert(!http_parser::iequals("chunked", "chunkes"));
+    // 只有字母忽略大小写：'@' 和 '`'、'[' 和 '{' 只差 0x20，但不相等
+    assert(!http_parser::iequals("@", "`"));
+    assert(!http_parser::iequals("[", "{"));
+    assert(!http_parser::iequals("1", "\x11"));
+
+    long length = -1;
+    assert(http_parser::parse_length("0", &length) && length == 0);
+    assert(http_parser::parse_length("1234", &length) && length == 1234);
+    assert(http_parser::parse_length("999999999999999999", &length) && length == 999999999999999999L);
+    length = -1;
+    assert(!http_parser::parse_length("", &length));
+    assert(!http_parser::parse_length("+1", &length));
+    assert(!http_parser::parse_length("-1", &length));
+    assert(!http_parser::parse_length(" 1", &length));
+    assert(!http_parser::parse_length("1 ", &length));
+    assert(!http_parser::parse_length("12a", &length));
+    assert(!http_parser::parse_length("1000000000000000000", &length));
+    assert(length == -1);
+}
+
+// 找行尾的各个实现在每个长度、每个位置上结果一致
+void test_case_5()
+{
+    char buf[80];
+    for (int len = 0; len <= 70; ++len) {
+        for (int pos = 0; pos <= len; ++pos) {
+            memset(buf, 'x', sizeof(buf));
+            if (pos < len) {
+                buf[pos] = pos % 2 ? '\r' : '\n';
+            }
+            // 范围之外的 '\n' 不能被找到
+            buf[len] = '\n';
+            const char* expected = buf + pos;
+            assert(http_parser::find_line_end_scalar(buf, buf + len) == expected);
+            assert(http_parser::find_line_end(buf, buf + len) == expected);
+#ifdef HTTP_PARSER_X86
+            assert(http_parser::find_line_end_sse2(buf, buf + len) == expected);
+            if (__builtin_cpu_supports("avx2")) {
+                assert(http_parser::find_line_end_avx2(buf, buf + len) == expected);
+            }
+#endif
+        }
+    }
+}
+
+// 块大小行
+void test_case_6()
+{
+    long size = -1;
+    assert(http_parser::parse_chunk_size("0", &size) && size == 0);
+    assert(http_parser::parse_chunk_size("5", &size) && size == 5);
+    assert(http_parser::parse_chunk_size("1aF", &size) && size == 0x1af);
+    assert(http_parser::parse_chunk_size("000010", &size) && size == 16);
+    assert(http_parser::parse_chunk_size("7fffffffffffffff", &size) && size == 0x7fffffffffffffffL);
+    // 扩展前面可以有空白
+    assert(http_parser::parse_chunk_size("5;name=value", &size) && size == 5);
+    assert(http_parser::parse_chunk_size("5 \t;name", &size) && size == 5);
+
+    size = -1;
+    assert(!http_parser::parse_chunk_size("", &size));
+    assert(!http_parser::parse_chunk_size(" 5", &size));
+    assert(!http_parser::parse_chunk_size("+5", &size));
+    assert(!http_parser::parse_chunk_size("-5", &size));
+    assert(!http_parser::parse_chunk_size("0x5", &size));
+    assert(!http_parser::parse_chunk_size("5 ", &size));
+    assert(!http_parser::parse_chunk_size("5g", &size));
+    assert(!http_parser::parse_chunk_size(";ext", &size));
+    assert(!http_parser::parse_chunk_size("8000000000000000", &size));
+    assert(!http_parser::parse_chunk_size("00000000000000001", &size));
+    assert(size == -1);
+}
+
+// 收集消息体的处理器
+static std::string g_body;
+static bool g_completed;
+
+class collect_handler : public body_handler
+{
+    public:
+        bool on_data(const char* data, int len) { g_body.append(data, len); return true; }
+        bool on_complete() { g_completed = true; return true; }
+};
+
+static body_handler* collect_factory(const char*, long)
+{
+    return new collect_handler;
+}
+
+// 不经过事件循环，用 socketpair 驱动 http_conn，发送一个分块传输的 POST 请求，返回应答的状态码
+static int post_chunked(http_conn& conn, int peer, const std::string& body)
+{
+    std::string req = "POST /upload HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked\r\n\r\n" + body;
+    g_body.clear();
+    g_completed = false;
+    assert(send(peer, req.data(), req.size(), 0) == (ssize_t)req.size());
+    assert(conn.read());
+    conn.process();
+    conn.write();
+    char resp[4096];
+    ssize_t n = recv(peer, resp, sizeof(resp) - 1, MSG_DONTWAIT);
+    if (n < 12) {
+        return 0;
+    }
+    resp[n] = '\0';
+    return atoi(resp + 9);
+}
+
+// 分块传输的解码：合法的块大小、扩展、尾部字段，以及不合法的块大小
+void test_case_7()
+{
+    http_conn::set_body_handler_factory(collect_factory);
+    int epollfd = epoll_create1(0);
+
+    struct chunked_case
+    {
+        const char* body;
+        int status;
+        const char* data;
+    };
+    const chunked_case cases[] = {
+        {"5\r\nhello\r\n0\r\n\r\n", 200, "hello"},
+        {"3\r\nabc\r\n2\r\nde\r\n0\r\n\r\n", 200, "abcde"},
+        {"A\r\n0123456789\r\n0\r\n\r\n", 200, "0123456789"},
+        {"a\r\n0123456789\r\n000\r\n\r\n", 200, "0123456789"},
+        {"0005;name=value\r\nhello\r\n0;last\r\n\r\n", 200, "hello"},
+        {"5 ;ext\r\nhello\r\n0\r\n\r\n", 200, "hello"},
+        {"5\r\nhello\r\n0\r\nX-Trailer: 1\r\nX-Other: 2\r\n\r\n", 200, "hello"},
+        {"0\r\n\r\n", 200, ""},
+        {" 5\r\nhello\r\n0\r\n\r\n", 400, NULL},
+        {"+5\r\nhello\r\n0\r\n\r\n", 400, NULL},
+        {"-5\r\nhello\r\n0\r\n\r\n", 400, NULL},
+        {"0x5\r\nhello\r\n0\r\n\r\n", 400, NULL},
+        {"\r\nhello\r\n0\r\n\r\n", 400, NULL},
+        {"5 \r\nhello\r\n0\r\n\r\n", 400, NULL},
+        {"10000000000000000\r\nhello\r\n0\r\n\r\n", 400, NULL},
+        {"8000000000000000\r\nhello\r\n0\r\n\r\n", 400, NULL},
+        // 块数据后面必须紧跟 "\r\n"
+        {"5\r\nhelloX\r\n0\r\n\r\n", 400, NULL},
+    };
+    for (const chunked_case& c : cases) {
+        int sv[2];
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        http_conn conn;
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        conn.init(sv[0], addr, epollfd);
+
+        int status = post_chunked(conn, sv[1], c.body);
+        assert(status == c.status);
+        if (c.data) {
+            assert(g_completed && g_body == c.data);
+            // 连接保持，可以接着发下一个请求
+            assert(post_chunked(conn, sv[1], "3\r\nabc\r\n0\r\n\r\n") == 200);
+            assert(g_completed && g_body == "abc");
+        } else {
+            assert(!g_completed);
+        }
+        conn.close_conn();
+        close(sv[1]);
+    }
+
+    // 块大小行太长
+    int sv[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    http_conn conn;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    conn.init(sv[0], addr, epollfd);
+    assert(post_chunked(conn, sv[1], "5;" + std::string(http_conn::MAX_CHUNK_LINE, 'x')) == 400);
+    conn.close_conn();
+    close(sv[1]);
+
+    close(epollfd);
+    http_conn::set_body_handler_factory(NULL);
+}
+
+// 在到期回调里重新设置定时器
+void test_case_8()
+{
+    // 落后超过一圈时从 now 往前扫一圈，回调里用旧的时间(超时为0)重新设置的节点可能落在还没扫到的槽里，
+    // 这一次 expire 里也不能再触发；换几个落后的距离，让它落在不同的槽
+    for (int lag = 8; lag < 24; ++lag) {
+        timer_wheel wheel(10, 8);
+        long base = timer_wheel::now_ms();
+        timer_wheel::node a, b;
+        wheel.schedule(&a, base, 10);
+        wheel.schedule(&b, base, 30);
+        assert(wheel.size() == 2);
+
+        int fired_a = 0;
+        int fired_b = 0;
+        long now = base + lag * 10;
+        int fired = wheel.expire(now, [&](timer_wheel::node* n) {
+            if (n == &a) {
+                ++fired_a;
+                wheel.schedule(n, base, 0);
+            } else {
+                ++fired_b;
+                wheel.schedule(n, now, 10);
+            }
+        });
+        assert(fired == 2 && fired_a == 1 && fired_b == 1);
+        assert(a.linked() && b.linked() && wheel.size() == 2);
+
+        // 下一个 tick 才到期
+        assert(wheel.expire(now, [](timer_wheel::node*) {}) == 0);
+        assert(wheel.expire(now + 20, [](timer_wheel::node*) {}) == 2);
+        assert(!a.linked() && !b.linked() && wheel.size() == 0);
+    }
+}
+
+int main()
+{
+    test_case_1();
+    test_case_2();
+    test_case_3();
+    test_case_4();
+    test_case_5();
+    test_case_6();
+    test_case_7();
+    test_case_8();
+    std::cout << "all checks passed (" << http_parser::implementation() << ")" << std::endl;
+    return 0;
+}
@@ -0,0 +1,272 @@
+#ifndef COMPRESSOR_H
+#define COMPRESSOR_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <string_view>
+#include <zlib.h>
+#ifdef HTTP_CONN_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#include "http_parser.h"
+
+/**
+ * 应答压缩：Accept-Encoding 协商、静态文件的一次性压缩和动态应答的流式 gzip 压缩
+ * 编译时定义 HTTP_CONN_BROTLI(并链接 libbrotlienc)才支持 br
+ */
+class compressor
+{
+    public:
+        enum ENCODING {IDENTITY = 0, GZIP, BROTLI, ENCODING_COUNT};
+
+        // 小于这个大小的内容不压缩，省下的字节抵不上多出来的头部字段和CPU
+        static const long MIN_SIZE = 256;
+        // 静态文件超过这个大小不压缩，避免压缩结果占用太多内存、第一次请求等太久
+        static const long MAX_STATIC_SIZE = 8 * 1024 * 1024;
+        // 静态文件只压缩一次，用最高的压缩率
+        static const int STATIC_GZIP_LEVEL = 9;
+        static const int STATIC_BROTLI_QUALITY = 9;
+        // 动态应答每次都压缩，用默认的压缩率
+        static const int DYNAMIC_GZIP_LEVEL = Z_DEFAULT_COMPRESSION;
+
+        // 客户端接受的编码的位集合(1 << ENCODING)，q=0 的编码不算；不区分其他 q 值的高低
+        static int accepted(std::string_view accept_encoding);
+        // 按 br、gzip 的顺序选择服务器支持、客户端接受的编码，没有时返回 IDENTITY
+        static ENCODING choose(int accepted);
+        static bool supported(ENCODING encoding);
+        // 应答头中的名字
+        static const char* name(ENCODING encoding);
+
+        // 按扩展名判断是否是值得压缩的文本类型
+        static bool compressible(const char* path);
+
+        // 一次性压缩 len 字节，成功时返回 malloc 分配的结果，调用者负责 free；结果不比原文小时也返回 NULL
+        static char* compress(ENCODING encoding, const char* data, size_t len, size_t* out_len);
+};
+
+/**
+ * 流式 gzip 压缩器，每个线程一个，压缩状态在应答之间复用(deflateReset)，不用每次分配几百KB的内部缓冲区
+ * 输入可以分多次给出，输出按 CHUNK_SIZE 分段交给回调，调用者不需要持有整个压缩结果
+ */
+class gzip_stream
+{
+    public:
+        static const int CHUNK_SIZE = 16 * 1024;
+
+        gzip_stream() : m_ready(false) {}
+        ~gzip_stream() { if (m_ready) deflateEnd(&m_stream); }
+
+        // 当前线程的压缩器
+        static gzip_stream* local();
+
+        // 开始压缩一个新的应答
+        bool begin(int level);
+        // 压缩一段输入，finish 为 true 时这是最后一段；on_output(const char*, int) 返回 false 时中止
+        template <typename F>
+        bool write(const char* data, size_t len, bool finish, F on_output);
+
+    private:
+        gzip_stream(const gzip_stream&);
+        gzip_stream& operator=(const gzip_stream&);
+
+        z_stream m_stream;
+        bool m_ready;
+        int m_level;
+        char m_out[CHUNK_SIZE];
+};
+
+inline int compressor::accepted(std::string_view accept_encoding)
+{
+    int mask = 0;
+    int wildcard = -1;
+    while (!accept_encoding.empty()) {
+        size_t comma = accept_encoding.find(',');
+        std::string_view item = accept_encoding.substr(0, comma);
+        accept_encoding = comma == std::string_view::npos ? std::string_view() : accept_encoding.substr(comma + 1);
+
+        // "gzip;q=0.5" 分成编码名和参数
+        size_t semi = item.find(';');
+        std::string_view coding = item.substr(0, semi);
+        while (!coding.empty() && (coding.front() == ' ' || coding.front() == '\t')) coding.remove_prefix(1);
+        while (!coding.empty() && (coding.back() == ' ' || coding.back() == '\t')) coding.remove_suffix(1);
+        bool allowed = true;
+        if (semi != std::string_view::npos) {
+            std::string_view params = item.substr(semi + 1);
+            size_t q = params.find("q=");
+            if (q != std::string_view::npos) {
+                // q 值只有 "0"、"0.0"、"0.00"、"0.000" 表示不接受
+                std::string_view value = params.substr(q + 2);
+                size_t end = 0;
+                while (end < value.size() && (value[end] == '0' || value[end] == '.')) ++end;
+                allowed = !(end > 0 && (end == value.size() || value[end] == ' ' || value[end] == ';'));
+            }
+        }
+
+        int bit = 0;
+        if (http_parser::iequals(coding, "gzip") || http_parser::iequals(coding, "x-gzip")) {
+            bit = 1 << GZIP;
+        } else if (http_parser::iequals(coding, "br")) {
+            bit = 1 << BROTLI;
+        } else if (coding == "*") {
+            wildcard = allowed;
+            continue;
+        }
+        if (allowed) {
+            mask |= bit;
+        } else {
+            mask &= ~bit;
+        }
+    }
+    // "*" 只对没有单独列出的编码生效，这里简化成没有列出任何编码时才生效
+    if (wildcard == 1 && mask == 0) {
+        mask = (1 << GZIP) | (1 << BROTLI);
+    }
+    return mask;
+}
+
+inline bool compressor::supported(ENCODING encoding)
+{
+#ifdef HTTP_CONN_BROTLI
+    return encoding == GZIP || encoding == BROTLI;
+#else
+    return encoding == GZIP;
+#endif
+}
+
+inline compressor::ENCODING compressor::choose(int accepted)
+{
+    if ((accepted & (1 << BROTLI)) && supported(BROTLI)) {
+        return BROTLI;
+    }
+    if (accepted & (1 << GZIP)) {
+        return GZIP;
+    }
+    return IDENTITY;
+}
+
+inline const char* compressor::name(ENCODING encoding)
+{
+    switch (encoding) {
+        case GZIP: return "gzip";
+        case BROTLI: return "br";
+        default: return "identity";
+    }
+}
+
+inline bool compressor::compressible(const char* path)
+{
+    static const char* extensions[] = {
+        ".html", ".htm", ".css", ".js", ".mjs", ".json", ".txt", ".xml", ".svg", ".csv", ".md", ".map", ".wasm"
+    };
+    const char* dot = strrchr(path, '.');
+    if (!dot || strchr(dot, '/')) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); ++i) {
+        if (strcasecmp(dot, extensions[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline char* compressor::compress(ENCODING encoding, const char* data, size_t len, size_t* out_len)
+{
+    char* out = NULL;
+    if (encoding == GZIP) {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        // windowBits 加 16 输出 gzip 格式
+        if (deflateInit2(&stream, STATIC_GZIP_LEVEL, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return NULL;
+        }
+        size_t bound = deflateBound(&stream, len);
+        out = (char*)malloc(bound);
+        stream.next_in = (Bytef*)data;
+        stream.avail_in = len;
+        stream.next_out = (Bytef*)out;
+        stream.avail_out = bound;
+        int ret = out ? deflate(&stream, Z_FINISH) : Z_MEM_ERROR;
+        *out_len = stream.total_out;
+        deflateEnd(&stream);
+        if (ret != Z_STREAM_END) {
+            free(out);
+            return NULL;
+        }
+    }
+#ifdef HTTP_CONN_BROTLI
+    else if (encoding == BROTLI) {
+        size_t bound = BrotliEncoderMaxCompressedSize(len);
+        out = (char*)malloc(bound ? bound : len + 1024);
+        *out_len = bound ? bound : len + 1024;
+        if (!out || !BrotliEncoderCompress(STATIC_BROTLI_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                                           len, (const uint8_t*)data, out_len, (uint8_t*)out)) {
+            free(out);
+            return NULL;
+        }
+    }
+#endif
+    else {
+        return NULL;
+    }
+
+    if (*out_len >= len) {
+        free(out);
+        return NULL;
+    }
+    // 压缩结果长期缓存，把多分配的部分还回去
+    char* shrunk = (char*)realloc(out, *out_len);
+    return shrunk ? shrunk : out;
+}
+
+inline gzip_stream* gzip_stream::local()
+{
+    static thread_local gzip_stream stream;
+    return &stream;
+}
+
+inline bool gzip_stream::begin(int level)
+{
+    if (m_ready && level != m_level) {
+        deflateEnd(&m_stream);
+        m_ready = false;
+    }
+    if (!m_ready) {
+        memset(&m_stream, 0, sizeof(m_stream));
+        if (deflateInit2(&m_stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        m_ready = true;
+        m_level = level;
+        return true;
+    }
+    return deflateReset(&m_stream) == Z_OK;
+}
+
+template <typename F>
+bool gzip_stream::write(const char* data, size_t len, bool finish, F on_output)
+{
+    m_stream.next_in = (Bytef*)data;
+    m_stream.avail_in = len;
+    int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+    while (true) {
+        m_stream.next_out = (Bytef*)m_out;
+        m_stream.avail_out = CHUNK_SIZE;
+        int ret = deflate(&m_stream, flush);
+        if (ret == Z_STREAM_ERROR) {
+            return false;
+        }
+        int produced = CHUNK_SIZE - m_stream.avail_out;
+        if (produced > 0 && !on_output(m_out, produced)) {
+            return false;
+        }
+        // 输出缓冲区没有写满，说明这一段输入已经处理完(finish 时还要等到流结束)
+        if (finish ? ret == Z_STREAM_END : m_stream.avail_out != 0) {
+            return true;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,370 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <stddef.h>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "locker.h"
+#include "compressor.h"
+
+/**
+ * 静态文件缓存，所有连接共享
+ * 以文件路径为键，缓存打开的文件描述符、stat 结果和(小文件的)mmap 映射，按 LRU 淘汰。
+ * 命中时不需要任何系统调用；缓存项超过 REVALIDATE_MS 没有检查过时重新 stat 一次，
+ * 修改时间、大小或 inode 变了就换成新的缓存项。
+ * 缓存项带引用计数，发送队列持有引用期间即使被淘汰或者替换，也要等引用归零才关闭和解除映射。
+ * 文本文件的压缩版本(gzip、br)在第一次被请求时生成并挂在缓存项上，文件改变时随旧的缓存项一起丢弃
+ */
+class file_cache
+{
+    public:
+        // 默认最多缓存的文件数
+        static const int DEFAULT_MAX_ENTRIES = 1024;
+        // 缓存的映射总字节数上限
+        static const size_t MAX_MAPPED_BYTES = 64 * 1024 * 1024;
+        // 大于这个大小的文件不做映射，用 sendfile 发送
+        static const long MMAP_THRESHOLD = 64 * 1024;
+        // 缓存项重新检查文件是否改变的间隔
+        static const long REVALIDATE_MS = 1000;
+        // 缓存的压缩版本的总字节数上限
+        static const size_t MAX_COMPRESSED_BYTES = 32 * 1024 * 1024;
+
+        enum RESULT {OK = 0, NOT_FOUND, FORBIDDEN, NOT_FILE, ERROR};
+
+        // 文件的一个压缩版本
+        struct variant
+        {
+            // 还没有生成、正在生成、可用、压缩失败或者不值得压缩
+            enum STATE {NONE = 0, BUSY, READY, FAILED};
+            STATE state;
+            char* data;
+            size_t length;
+        };
+
+        struct entry
+        {
+            std::string path;
+            int fd;
+            struct stat st;
+            // 小文件的映射地址，大文件为 NULL
+            char* address;
+            int refs;
+            // 是否还在缓存表中
+            bool cached;
+            long checked_at;
+            std::list<entry*>::iterator lru;
+            // 按 compressor::ENCODING 索引，IDENTITY 不用
+            variant variants[compressor::ENCODING_COUNT];
+        };
+
+    public:
+        file_cache() : m_max_entries(DEFAULT_MAX_ENTRIES), m_mapped_bytes(0), m_compressed_bytes(0), m_hits(0), m_misses(0) {}
+        ~file_cache();
+
+        // 进程内共享的文件缓存
+        static file_cache* instance();
+
+        // 设置最多缓存的文件数，0 表示不缓存(每次请求都打开文件，发送完就关闭)
+        void set_max_entries(int max_entries);
+
+        // 取得文件，成功时 *file 持有一个引用，用完必须 release
+        RESULT acquire(const char* path, entry** file);
+        void release(entry* file);
+        // 取得文件的压缩版本，调用者持有 file 的引用期间 *data 一直有效。
+        // 第一次请求时在调用线程里压缩；别的线程正在压缩、文件不值得压缩或者超出内存上限时返回 false，这时发送原文
+        bool acquire_variant(entry* file, compressor::ENCODING encoding, const char** data, size_t* length);
+
+        long hits() { return m_hits; }
+        long misses() { return m_misses; }
+
+    private:
+        file_cache(const file_cache&);
+        file_cache& operator=(const file_cache&);
+
+        static long now_ms();
+        // 打开文件并建立缓存项，不持有锁
+        static RESULT load(const char* path, entry** file);
+        static void destroy(entry* file);
+        // 读出文件内容并压缩，不持有锁
+        static char* compress_file(entry* file, compressor::ENCODING encoding, size_t* length);
+        // 把缓存项移出缓存表，没有引用时直接销毁，调用时需持有锁
+        void evict(entry* file);
+
+        locker m_lock;
+        int m_max_entries;
+        size_t m_mapped_bytes;
+        size_t m_compressed_bytes;
+        std::unordered_map<std::string, entry*> m_entries;
+        // 最近用过的在前
+        std::list<entry*> m_lru;
+        // 查找用的键，避免每次查找都分配内存
+        std::string m_key;
+        long m_hits;
+        long m_misses;
+};
+
+inline file_cache::~file_cache()
+{
+    for (std::list<entry*>::iterator it = m_lru.begin(); it != m_lru.end(); ++it) {
+        destroy(*it);
+    }
+}
+
+inline file_cache* file_cache::instance()
+{
+    static file_cache cache;
+    return &cache;
+}
+
+inline long file_cache::now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+inline void file_cache::set_max_entries(int max_entries)
+{
+    m_lock.lock();
+    m_max_entries = max_entries;
+    while ((int)m_entries.size() > m_max_entries) {
+        evict(m_lru.back());
+    }
+    m_lock.unlock();
+}
+
+inline file_cache::RESULT file_cache::load(const char* path, entry** file)
+{
+    // O_NONBLOCK 避免打开 FIFO 时阻塞
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == EACCES ? FORBIDDEN : NOT_FOUND;
+    }
+
+    entry* e = new entry;
+    e->fd = fd;
+    e->address = NULL;
+    e->refs = 1;
+    e->cached = false;
+    memset(e->variants, 0, sizeof(e->variants));
+    if (fstat(fd, &e->st) < 0) {
+        destroy(e);
+        return ERROR;
+    }
+    if (!(e->st.st_mode & S_IROTH)) {
+        destroy(e);
+        return FORBIDDEN;
+    }
+    if (!S_ISREG(e->st.st_mode)) {
+        destroy(e);
+        return NOT_FILE;
+    }
+
+    if (e->st.st_size > 0 && e->st.st_size <= MMAP_THRESHOLD) {
+        void* address = mmap(0, e->st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            destroy(e);
+            return ERROR;
+        }
+        e->address = (char*)address;
+    }
+    e->path = path;
+    e->checked_at = now_ms();
+    *file = e;
+    return OK;
+}
+
+inline void file_cache::destroy(entry* file)
+{
+    if (file->address) {
+        munmap(file->address, file->st.st_size);
+    }
+    for (int i = 0; i < compressor::ENCODING_COUNT; ++i) {
+        free(file->variants[i].data);
+    }
+    close(file->fd);
+    delete file;
+}
+
+inline void file_cache::evict(entry* file)
+{
+    m_entries.erase(file->path);
+    m_lru.erase(file->lru);
+    if (file->address) {
+        m_mapped_bytes -= file->st.st_size;
+    }
+    for (int i = 0; i < compressor::ENCODING_COUNT; ++i) {
+        m_compressed_bytes -= file->variants[i].length;
+    }
+    file->cached = false;
+    if (file->refs == 0) {
+        destroy(file);
+    }
+}
+
+inline file_cache::RESULT file_cache::acquire(const char* path, entry** file)
+{
+    m_lock.lock();
+    m_key.assign(path);
+    std::unordered_map<std::string, entry*>::iterator it = m_entries.find(m_key);
+    entry* e = it != m_entries.end() ? it->second : NULL;
+    // 缓存项过期且文件已经变了，这时已经解锁
+    bool stale = false;
+    if (e) {
+        ++e->refs;
+        long now = now_ms();
+        if (now - e->checked_at >= REVALIDATE_MS) {
+            // stat 在锁外做：持有引用，并把检查时间提前，其他线程在此期间照常使用这个缓存项
+            e->checked_at = now;
+            m_lock.unlock();
+            struct stat st;
+            bool fresh = stat(path, &st) == 0 && st.st_ino == e->st.st_ino && st.st_size == e->st.st_size
+                && st.st_mtim.tv_sec == e->st.st_mtim.tv_sec && st.st_mtim.tv_nsec == e->st.st_mtim.tv_nsec;
+            m_lock.lock();
+            if (!fresh) {
+                // 期间可能已经被其他线程淘汰或者换掉，还在缓存里时才淘汰(没有别的引用时 evict 里就释放了)
+                --e->refs;
+                bool dead = !e->cached && e->refs == 0;
+                if (e->cached) {
+                    evict(e);
+                }
+                ++m_misses;
+                m_lock.unlock();
+                if (dead) {
+                    destroy(e);
+                }
+                e = NULL;
+                stale = true;
+            }
+        }
+    }
+    if (e) {
+        if (e->cached) {
+            m_lru.splice(m_lru.begin(), m_lru, e->lru);
+        }
+        ++m_hits;
+        m_lock.unlock();
+        *file = e;
+        return OK;
+    }
+    if (!stale) {
+        ++m_misses;
+        m_lock.unlock();
+    }
+
+    RESULT ret = load(path, file);
+    if (ret != OK) {
+        return ret;
+    }
+
+    e = *file;
+    m_lock.lock();
+    if (m_max_entries <= 0) {
+        m_lock.unlock();
+        return OK;
+    }
+    // 其他线程可能同时加载了同一个文件，以后加载的为准
+    it = m_entries.find(e->path);
+    if (it != m_entries.end()) {
+        evict(it->second);
+    }
+    e->cached = true;
+    m_lru.push_front(e);
+    e->lru = m_lru.begin();
+    m_entries[e->path] = e;
+    if (e->address) {
+        m_mapped_bytes += e->st.st_size;
+    }
+    while ((int)m_entries.size() > m_max_entries || (m_mapped_bytes > MAX_MAPPED_BYTES && m_lru.back() != e)) {
+        evict(m_lru.back());
+    }
+    m_lock.unlock();
+    return OK;
+}
+
+inline void file_cache::release(entry* file)
+{
+    if (!file) {
+        return;
+    }
+
+    m_lock.lock();
+    bool dead = --file->refs == 0 && !file->cached;
+    m_lock.unlock();
+    if (dead) {
+        destroy(file);
+    }
+}
+
+inline char* file_cache::compress_file(entry* file, compressor::ENCODING encoding, size_t* length)
+{
+    // 大文件没有常驻的映射，压缩期间临时映射一次
+    char* address = file->address;
+    if (!address) {
+        void* mapped = mmap(0, file->st.st_size, PROT_READ, MAP_PRIVATE, file->fd, 0);
+        if (mapped == MAP_FAILED) {
+            return NULL;
+        }
+        address = (char*)mapped;
+    }
+    char* data = compressor::compress(encoding, address, file->st.st_size, length);
+    if (address != file->address) {
+        munmap(address, file->st.st_size);
+    }
+    return data;
+}
+
+inline bool file_cache::acquire_variant(entry* file, compressor::ENCODING encoding, const char** data, size_t* length)
+{
+    // 不在缓存里的文件压缩之后只用一次，不值得
+    if (encoding == compressor::IDENTITY || !compressor::supported(encoding)
+            || file->st.st_size < compressor::MIN_SIZE || file->st.st_size > compressor::MAX_STATIC_SIZE) {
+        return false;
+    }
+
+    variant& v = file->variants[encoding];
+    m_lock.lock();
+    if (v.state != variant::NONE || !file->cached || m_compressed_bytes >= MAX_COMPRESSED_BYTES) {
+        bool ready = v.state == variant::READY;
+        if (ready) {
+            *data = v.data;
+            *length = v.length;
+        }
+        m_lock.unlock();
+        return ready;
+    }
+    // 由这个线程负责压缩，其他线程在此期间发送原文
+    v.state = variant::BUSY;
+    m_lock.unlock();
+
+    size_t compressed_length = 0;
+    char* compressed = compress_file(file, encoding, &compressed_length);
+
+    m_lock.lock();
+    if (compressed) {
+        v.data = compressed;
+        v.length = compressed_length;
+        v.state = variant::READY;
+        // 压缩期间缓存项可能已经被淘汰，那时 evict 已经减过了，不再计入
+        if (file->cached) {
+            m_compressed_bytes += compressed_length;
+        }
+        *data = compressed;
+        *length = compressed_length;
+    } else {
+        v.state = variant::FAILED;
+    }
+    m_lock.unlock();
+    return compressed != NULL;
+}
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * 高动态范围(HDR)直方图，记录非负整数(比如纳秒)的分布
+ * 每个2的幂区间 [2^k, 2^(k+1)) 等分成 SUB_BUCKETS 个桶，所以任何值的相对误差都不超过 1/SUB_BUCKETS，
+ * 覆盖整个64位范围只要固定的几千个计数器。记录一个值是几次位运算加一次自增，不分配内存。
+ * 不加锁：每个线程记录自己的直方图，需要时用 add() 合并
+ */
+class hdr_histogram
+{
+    public:
+        // 每个2的幂区间的桶数是 2^SUB_BITS，相对误差小于 0.8%
+        static const int SUB_BITS = 7;
+        static const int SUB_BUCKETS = 1 << SUB_BITS;
+        static const int BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    public:
+        hdr_histogram() { reset(); }
+
+        void reset();
+        void record(uint64_t value) { record(value, 1); }
+        void record(uint64_t value, uint64_t count);
+        void add(const hdr_histogram& other);
+
+        uint64_t count() const { return m_count; }
+        // 所有记录值的精确总和
+        uint64_t sum() const { return m_sum; }
+        uint64_t min() const { return m_count ? m_min : 0; }
+        uint64_t max() const { return m_max; }
+        double mean() const;
+        double stddev() const;
+        // 不小于 percentile% 的记录值的最小值(取所在桶的上界)
+        uint64_t percentile(double percentile) const;
+        // 不大于 value 的记录数，value 所在的桶整个算进去
+        uint64_t count_at_or_below(uint64_t value) const;
+
+        // 按 HdrHistogram 的 .hgrm 格式输出百分位分布，数值除以 scale，可以直接用 HdrHistogram 的绘图工具打开
+        void print_distribution(FILE* out, double scale, int ticks_per_half_distance = 5) const;
+
+        static int index_of(uint64_t value);
+        // 桶内值的下界和上界
+        static uint64_t lowest_of(int index);
+        static uint64_t highest_of(int index);
+
+    private:
+        uint64_t m_counts[BUCKETS];
+        uint64_t m_count;
+        uint64_t m_sum;
+        uint64_t m_min;
+        uint64_t m_max;
+};
+
+inline void hdr_histogram::reset()
+{
+    memset(m_counts, 0, sizeof(m_counts));
+    m_count = 0;
+    m_sum = 0;
+    m_min = UINT64_MAX;
+    m_max = 0;
+}
+
+// 小于 SUB_BUCKETS 的值每个值一个桶；其余的值按最高位所在的位置分区间，区间内取最高位之后的 SUB_BITS 位
+inline int hdr_histogram::index_of(uint64_t value)
+{
+    if (value < (uint64_t)SUB_BUCKETS) {
+        return value;
+    }
+    int shift = 63 - __builtin_clzll(value) - SUB_BITS;
+    return ((shift + 1) << SUB_BITS) + (int)((value >> shift) - SUB_BUCKETS);
+}
+
+inline uint64_t hdr_histogram::lowest_of(int index)
+{
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    int shift = (index >> SUB_BITS) - 1;
+    return (uint64_t)((index & (SUB_BUCKETS - 1)) + SUB_BUCKETS) << shift;
+}
+
+inline uint64_t hdr_histogram::highest_of(int index)
+{
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    int shift = (index >> SUB_BITS) - 1;
+    return lowest_of(index) + ((uint64_t)1 << shift) - 1;
+}
+
+inline void hdr_histogram::record(uint64_t value, uint64_t count)
+{
+    m_counts[index_of(value)] += count;
+    m_count += count;
+    m_sum += value * count;
+    if (value < m_min) {
+        m_min = value;
+    }
+    if (value > m_max) {
+        m_max = value;
+    }
+}
+
+inline void hdr_histogram::add(const hdr_histogram& other)
+{
+    for (int i = 0; i < BUCKETS; ++i) {
+        m_counts[i] += other.m_counts[i];
+    }
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    if (other.m_min < m_min) {
+        m_min = other.m_min;
+    }
+    if (other.m_max > m_max) {
+        m_max = other.m_max;
+    }
+}
+
+inline double hdr_histogram::mean() const
+{
+    return m_count ? (double)m_sum / m_count : 0;
+}
+
+inline double hdr_histogram::stddev() const
+{
+    if (m_count == 0) {
+        return 0;
+    }
+    double avg = mean();
+    double total = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+        if (m_counts[i]) {
+            double d = (lowest_of(i) + highest_of(i)) / 2.0 - avg;
+            total += (double)m_counts[i] * d * d;
+        }
+    }
+    return sqrt(total / m_count);
+}
+
+inline uint64_t hdr_histogram::percentile(double percentile) const
+{
+    if (m_count == 0) {
+        return 0;
+    }
+    if (percentile > 100) {
+        percentile = 100;
+    }
+    uint64_t target = (uint64_t)ceil(percentile / 100 * m_count);
+    if (target == 0) {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+        seen += m_counts[i];
+        if (seen >= target) {
+            uint64_t value = highest_of(i);
+            return value < m_max ? value : m_max;
+        }
+    }
+    return m_max;
+}
+
+inline uint64_t hdr_histogram::count_at_or_below(uint64_t value) const
+{
+    uint64_t total = 0;
+    int last = index_of(value);
+    for (int i = 0; i <= last; ++i) {
+        total += m_counts[i];
+    }
+    return total;
+}
+
+// 百分位按 HdrHistogram 的方式取点：每离 100% 近一半，取 ticks_per_half_distance 个点
+inline void hdr_histogram::print_distribution(FILE* out, double scale, int ticks_per_half_distance) const
+{
+    fprintf(out, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+    if (m_count > 0) {
+        double percentile = 0;
+        while (true) {
+            uint64_t value = this->percentile(percentile);
+            uint64_t below = count_at_or_below(value);
+            double fraction = (double)below / m_count;
+            if (fraction >= 1.0) {
+                fprintf(out, "%12.3f %2.12f %10llu\n", value / scale, 1.0, (unsigned long long)below);
+                break;
+            }
+            fprintf(out, "%12.3f %2.12f %10llu %14.2f\n", value / scale, fraction,
+                    (unsigned long long)below, 1 / (1 - fraction));
+
+            // 下一个点：剩余距离减半 ticks_per_half_distance 次
+            double remaining = 100 - percentile;
+            double half_distance = pow(2, floor(log2(100 / remaining)) + 1);
+            percentile += 100 / (half_distance * ticks_per_half_distance);
+            if (percentile < fraction * 100) {
+                percentile = fraction * 100 + 100 / (half_distance * ticks_per_half_distance);
+            }
+            if (percentile >= 100) {
+                percentile = 100;
+            }
+        }
+    }
+    fprintf(out, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", mean() / scale, stddev() / scale);
+    fprintf(out, "#[Max     = %12.3f, Total count    = %12llu]\n", max() / scale, (unsigned long long)m_count);
+    fprintf(out, "#[Buckets = %12d, SubBuckets     = %12d]\n", 64 - SUB_BITS + 1, SUB_BUCKETS);
+}
+
+#endif
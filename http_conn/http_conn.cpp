@@ -1,8 +1,11 @@
+#include <algorithm>
+#include <sys/sendfile.h>
+
 #include "http_conn.h"
 
 // 定义HTTP响应的一些状态信息
 const char* ok_20_title = "OK";
-const char* error_400_title = "OK";
+const char* error_400_title = "Bad Request";
 const char* error_400_from = "Your request has bad syntax or is inherently impossible to satisfy.";
 const char* error_403_title = "Forbidden";
 const char* error_403_from = "You do not have permission to get file from this server.\n";
@@ -10,20 +13,30 @@ const char* error_404_title = "Not Found";
 const char* error_404_from = "The requested file was not found on this server.\n";
 const char* error_500_title = "Internal Error";
 const char* error_500_from = "There was an unusual problem serving the requested file.\n";
+const char* error_431_title = "Request Header Fields Too Large";
+const char* error_431_from = "The request line and header fields are too large.\n";
+const char* error_501_title = "Not Implemented";
+const char* error_501_from = "The server does not support the transfer coding of this request.\n";
+const char* error_503_title = "Service Unavailable";
+const char* error_503_from = "The server is overloaded, please retry later.\n";
 
 // 网站根目录
 const char* doc_root = "/var/www/html";
 
 int setnonblocking(int fd)
 {
-    int old_option fcntl(fd, F_GETFL);
+    int old_option = fcntl(fd, F_GETFL);
     int new_option = old_option | O_NONBLOCK;
     fcntl(fd, F_SETFL, new_option);
-    return old_optioin;
+    return old_option;
 }
 
+// epollfd 为-1时连接由 io_uring 驱动(uring_reactor)，下面三个函数不操作 epoll，socket 在 accept 时已经是非阻塞的
 void addfd(int epollfd, int fd, bool one_shot)
 {
+    if (epollfd < 0) {
+        return;
+    }
     epoll_event event;
     event.data.fd = fd;
     /**
@@ -42,101 +55,260 @@ void addfd(int epollfd, int fd, bool one_shot)
 
 void removefd(int epollfd, int fd)
 {
-    epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, 0);
+    if (epollfd >= 0) {
+        epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, 0);
+    }
     close(fd);
 }
 
 void modfd(int epollfd, int fd, int ev)
 {
+    if (epollfd < 0) {
+        return;
+    }
     epoll_event event;
     event.data.fd = fd;
-    events.events = ev | EPOLLET | EPOLLONESHOT | EPOLLRDHUP;
+    event.events = ev | EPOLLET | EPOLLONESHOT | EPOLLRDHUP;
     epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
 }
 
-int http_conn::m_user_count = 0;
-int http_conn::m_epollfd = -1;
+std::atomic<int> http_conn::m_user_count(0);
+body_handler_factory http_conn::m_body_handler_factory = NULL;
+const router* http_conn::m_router = NULL;
 
 void http_conn::close_conn(bool real_close)
 {
     if (real_close && (m_sockfd != -1)) {
-        removefd(m_epollfd, m_sockfd);
+        int sockfd = m_sockfd;
         m_sockfd = -1;
         m_user_count--;     // 关闭一个连接时，将客户总量减1
+        admission::instance()->release_client(m_address);
+        unmap();
+        release_buffers();
+        // 上传到一半的请求被中止
+        delete m_body_handler;
+        m_body_handler = NULL;
+        // 最后才关闭描述符：关闭之后这个描述符号随时可能被重新 accept
+        removefd(m_epollfd, sockfd);
     }
 }
 
-void http_conn::init(int sockfd, const sockaddr_in& addr) 
+void http_conn::init(int sockfd, const sockaddr_in& addr, int epollfd)
 {
+    m_epollfd = epollfd;
     m_sockfd = sockfd;
     m_address = addr;
     // 如下两行是为了避免TIME_WAIT状态，仅用于调试，实际使用时应该去掉
-    int reuse = -1;
+    int reuse = 1;
     setsockopt(m_sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
     addfd(m_epollfd, sockfd, true);
     m_user_count++;
+    m_requests = 0;
+    m_timer_phase = PHASE_NONE;
 
     init();
 }
 
 void http_conn::init()
+{
+    reset_request();
+    m_start_line = 0;
+    m_checked_idx = 0;
+    m_read_idx = 0;
+    m_request_start = 0;
+    m_write_idx = 0;
+    // 连接空闲时不保留发送队列和头部字段索引的内存
+    std::vector<out_segment>().swap(m_out);
+    std::vector<http_header>().swap(m_headers);
+    m_out_index = 0;
+
+    // 上一批请求已经处理完，连接进入空闲状态，缓冲区还给缓冲区池
+    release_buffers();
+}
+
+void http_conn::reset_request()
 {
     m_check_state = CHECK_STATE_REQUESTLINE;
-    m_linger = false;
+    // HTTP/1.1 默认保持连接，除非请求中带有 Connection: close
+    m_linger = true;
 
     m_method = GET;
     m_url = 0;
     m_version = 0;
     m_content_length = 0;
+    m_chunked = false;
+    m_expect_continue = false;
+    m_chunk_state = CHUNK_SIZE;
+    m_body_remaining = 0;
+    m_body_received = 0;
+    delete m_body_handler;
+    m_body_handler = NULL;
+    m_route = NULL;
+    m_accept_encoding = 0;
     m_host = 0;
-    m_start_line = 0;
-    m_checked_idx = 0;
-    m_read_idx = 0;
-    m_write_idx = 0;
-
-    memset(m_read_buf, '\0', READ_BUFFER_SIZE);
-    memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
+    m_headers.clear();
     memset(m_real_file, '\0', FILENAME_LEN);
 }
 
+void http_conn::finish_request()
+{
+    // 下一个请求从当前解析位置开始
+    m_request_start = m_checked_idx;
+    m_start_line = m_checked_idx;
+    bool linger = m_linger;
+    reset_request();
+    m_linger = linger;
+}
+
+void http_conn::compact_read_buf()
+{
+    if (m_request_start == 0) {
+        return;
+    }
+
+    // 把尚未处理的字节(可能是半个请求)搬到缓冲区开头，指向它们的指针一起平移
+    int remain = m_read_idx - m_request_start;
+    if (remain > 0) {
+        memmove(m_read_buf, m_read_buf + m_request_start, remain);
+    }
+    shift_read_pointers(m_read_buf + m_request_start, m_read_buf);
+    m_read_idx = remain;
+    m_checked_idx -= m_request_start;
+    m_start_line -= m_request_start;
+    m_request_start = 0;
+}
+
+void http_conn::shift_read_pointers(char* old_base, char* new_base)
+{
+    if (m_url) m_url = new_base + (m_url - old_base);
+    if (m_version) m_version = new_base + (m_version - old_base);
+    if (m_host) m_host = new_base + (m_host - old_base);
+    for (size_t i = 0; i < m_headers.size(); ++i) {
+        http_header& h = m_headers[i];
+        h.name = std::string_view(new_base + (h.name.data() - old_base), h.name.size());
+        h.value = std::string_view(new_base + (h.value.data() - old_base), h.value.size());
+    }
+}
+
+std::string_view http_conn::header(std::string_view name) const
+{
+    for (size_t i = 0; i < m_headers.size(); ++i) {
+        if (http_parser::iequals(m_headers[i].name, name)) {
+            return m_headers[i].value;
+        }
+    }
+    return std::string_view();
+}
+
+http_conn::TIMER_PHASE http_conn::timer_phase() const
+{
+    if (m_sockfd == -1) {
+        return PHASE_NONE;
+    }
+    if (!m_out.empty()) {
+        return PHASE_WRITE;
+    }
+    if (m_read_idx == 0) {
+        // 新连接还没有发来任何请求，按请求头超时计算
+        return m_requests == 0 ? PHASE_HEADER : PHASE_KEEPALIVE;
+    }
+    return m_check_state == CHECK_STATE_CONTENT ? PHASE_BODY : PHASE_HEADER;
+}
+
+int http_conn::phase_timeout(TIMER_PHASE phase)
+{
+    switch (phase) {
+        case PHASE_HEADER: return HEADER_TIMEOUT_MS;
+        case PHASE_BODY: return BODY_TIMEOUT_MS;
+        case PHASE_WRITE: return BODY_TIMEOUT_MS;
+        case PHASE_KEEPALIVE: return KEEPALIVE_TIMEOUT_MS;
+        default: return 0;
+    }
+}
+
+bool http_conn::grow_read_buf()
+{
+    int new_size = 0;
+    char* new_buf = buffer_pool::instance()->acquire(m_read_buf ? m_read_buf_size * 2 : READ_BUFFER_SIZE, &new_size);
+    if (!new_buf) {
+        return false;
+    }
+
+    if (m_read_buf) {
+        memcpy(new_buf, m_read_buf, m_read_idx);
+        // 请求可能解析到一半，指向旧缓冲区的指针要平移到新缓冲区
+        shift_read_pointers(m_read_buf, new_buf);
+        buffer_pool::instance()->release(m_read_buf, m_read_buf_size);
+    }
+
+    m_read_buf = new_buf;
+    m_read_buf_size = new_size;
+    return true;
+}
+
+void http_conn::release_buffers()
+{
+    if (m_read_buf) {
+        buffer_pool::instance()->release(m_read_buf, m_read_buf_size);
+        m_read_buf = NULL;
+        m_read_buf_size = 0;
+    }
+    if (m_write_buf) {
+        buffer_pool::instance()->release(m_write_buf, m_write_buf_size);
+        m_write_buf = NULL;
+        m_write_buf_size = 0;
+    }
+}
+
 // 从状态机
 http_conn::LINE_STATUS http_conn::parse_line()
 {
-    char temp;
-    for (; m_checked_idx < m_read_idx; ++m_checked_idx) {
-        temp = m_read_buf[m_checked_idx];
-        if (temp == '\r') {
-            if ((m_checked_idx + 1) == m_read_idx) {
-                return LINE_OPEN;
-            } else if (m_read_buf[m_checked_idx + 1] == '\n') {
-                m_read_buf[m_checked_idx++] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
+    // 向量化地找到下一个 '\r' 或 '\n'，中间的字节不需要逐个检查
+    const char* end = http_parser::find_line_end(m_read_buf + m_checked_idx, m_read_buf + m_read_idx);
+    m_checked_idx = end - m_read_buf;
+    if (m_checked_idx == m_read_idx) {
+        return LINE_OPEN;
+    }
 
-            return LINE_BAD;
-        } else if (temp == '\n') {
-            if ((m_checked_idx > 1) && (m_read_buf[m_checked_idx - 1] == '\r')) {
-                m_read_buf[m_checked_idx - 1] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
+    if (*end == '\r') {
+        if ((m_checked_idx + 1) == m_read_idx) {
+            return LINE_OPEN;
+        } else if (m_read_buf[m_checked_idx + 1] == '\n') {
+            m_read_buf[m_checked_idx++] = '\0';
+            m_read_buf[m_checked_idx++] = '\0';
+            return LINE_OK;
         }
+        return LINE_BAD;
+    }
+
+    if ((m_checked_idx > 1) && (m_read_buf[m_checked_idx - 1] == '\r')) {
+        m_read_buf[m_checked_idx - 1] = '\0';
+        m_read_buf[m_checked_idx++] = '\0';
+        return LINE_OK;
     }
-    return LINE_OPEN;
+    return LINE_BAD;
 }
 
 // 循环读取客户数据，直到无数据可读或者对方关闭连接
 bool http_conn::read()
 {
-    if (m_read_idx >= READ_BUFFER_SIZE) return false;
+    metrics::scope timing(metrics::STAGE_READ);
+    if (!m_read_buf && !grow_read_buf()) return false;
 
     int bytes_read = 0;
     while (true) {
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+        // 缓冲区已满时增长。读消息体时缓冲区到 BODY_BUFFER_SIZE 就不再增长，增长到上限之后也停止读取：
+        // 先由 process() 消费已经读入的数据，再重新注册 EPOLLIN 继续读，发送得快的客户端因此被限速(背压)
+        if (m_read_idx >= m_read_buf_size) {
+            bool streaming = m_check_state == CHECK_STATE_CONTENT && m_read_buf_size >= BODY_BUFFER_SIZE;
+            if (streaming || !grow_read_buf()) {
+                break;
+            }
+        }
+
+        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_buf_size - m_read_idx, 0);
         if (bytes_read == -1) {
-            if (errno == EAGIN || errno == EWOULDBLOCK) break;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
             return false;
         } else if (bytes_read == 0) {
             return false;
@@ -146,28 +318,53 @@ bool http_conn::read()
     return true;
 }
 
+int http_conn::feed(const char* data, int len)
+{
+    metrics::scope timing(metrics::STAGE_READ);
+    if (!m_read_buf && !grow_read_buf()) return -1;
+
+    int fed = 0;
+    while (fed < len) {
+        // 和 read() 一样的背压规则：读消息体时不超过 BODY_BUFFER_SIZE，请求头不超过读缓冲区的上限
+        if (m_read_idx >= m_read_buf_size) {
+            bool streaming = m_check_state == CHECK_STATE_CONTENT && m_read_buf_size >= BODY_BUFFER_SIZE;
+            if (streaming || !grow_read_buf()) {
+                break;
+            }
+        }
+        int n = std::min(len - fed, m_read_buf_size - m_read_idx);
+        memcpy(m_read_buf + m_read_idx, data + fed, n);
+        m_read_idx += n;
+        fed += n;
+    }
+    return fed;
+}
+
 // 解析HTTP请求行，获取请求方法，目标URL，以及HTTP版本号
-http_conn::HTTP_CODE http_conn::parse_request_line(char* text)
+http_conn::HTTP_CODE http_conn::parse_request_line(char* text, int len)
 {
-    m_url = strpbrk(text, " \t");
-    if (!m_url) return BAD_REQUEST;
+    char* end = text + len;
+    m_url = (char*)http_parser::find_space(text, end);
+    if (m_url == end) return BAD_REQUEST;
 
     *m_url++ = '\0';
 
-    char* method = text;
-    if (strcasecmp(method, "GET") == 0) {
+    std::string_view method(text, m_url - 1 - text);
+    if (http_parser::iequals(method, "GET")) {
         m_method = GET;
+    } else if (http_parser::iequals(method, "POST")) {
+        m_method = POST;
     } else {
         return BAD_REQUEST;
     }
 
-    m_url += strspn(m_url, " \t");
-    m_version = strpbrk(m_url, " \t");
-    if (!m_version) return BAD_REQUEST;
+    m_url = (char*)http_parser::skip_space(m_url, end);
+    m_version = (char*)http_parser::find_space(m_url, end);
+    if (m_version == end) return BAD_REQUEST;
 
     *m_version++ = '\0';
-    m_version += strspan(m_version, " \t");
-    if (strcasecmp(m_version, "HTTP/1.1") != 0) {
+    m_version = (char*)http_parser::skip_space(m_version, end);
+    if (!http_parser::iequals(std::string_view(m_version, end - m_version), "HTTP/1.1")) {
         return BAD_REQUEST;
     }
 
@@ -176,51 +373,238 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char* text)
         m_url = strchr(m_url, '/');
     }
 
-    if (!m_url || murl[0] != '/') return BAD_REQUEST;
+    if (!m_url || m_url[0] != '/') return BAD_REQUEST;
 
     m_check_state = CHECK_STATE_HEADER;
     return NO_REQUEST;
 }
 
 // 解析HTTP请求的一个头部信息
-http_conn::HTTP_CODE http_conn::parse_headers(char* text)
+http_conn::HTTP_CODE http_conn::parse_headers(char* text, int len)
 {
     // 遇到空行，表示头部字段解析完毕
-    if (text[0] == '\0') {
-        // 如果HTTP请求有消息体，则还需要读取m_content_length字节的消息体，状态机转移到CHECK_STATE_CONTENT状态
-        if (m_content_length != 0) {
-            m_check_state = CHECK_STATE_CONTENT;
-            return NO_REQUEST;
-        }
-        // 否则说明我们已经得到了一个完整的HTTP请求
-        return GET_REQUEST;
-    } else if (strncasecmp(text, "Connection:", 11) == 0) { // 处理Connection头部字段
-        text += 11;
-        text += strspn(text, " \t");
-        if (strncasecmp(text, "keep-alive") == 0) {
+    if (len == 0) {
+        return start_body();
+    }
+
+    // 名字和值以视图的形式记入索引，不拷贝
+    http_header header;
+    if (!http_parser::split_header(text, len, &header)) {
+        return BAD_REQUEST;
+    }
+    m_headers.push_back(header);
+
+    // 服务器自己关心的几个字段，先按长度筛选再比较
+    std::string_view name = header.name;
+    std::string_view value = header.value;
+    if (name.size() == 10 && http_parser::iequals(name, "Connection")) {
+        if (http_parser::iequals(value.substr(0, 10), "keep-alive")) {
             m_linger = true;
+        } else if (http_parser::iequals(value.substr(0, 5), "close")) {
+            m_linger = false;
+        }
+    } else if (name.size() == 14 && http_parser::iequals(name, "Content-Length")) {
+        // 重复出现且值不同时拒绝：前面的代理可能取了另一个值，两边对消息体边界的理解不同(请求走私)。
+        // header() 返回第一个同名字段，不是刚加入的这个时说明前面已经有过
+        std::string_view first = http_conn::header("Content-Length");
+        if (first.data() != value.data() && first != value) {
+            return BAD_REQUEST;
+        }
+        if (!http_parser::parse_length(value, &m_content_length)) {
+            return BAD_REQUEST;
+        }
+    } else if (name.size() == 17 && http_parser::iequals(name, "Transfer-Encoding")) {
+        // 只支持单独的 chunked；其他编码(包括 "gzip, chunked")处理器拿到的消息体还是编码过的，回 501
+        if (!http_parser::iequals(value, "chunked")) {
+            m_linger = false;
+            return NOT_IMPLEMENTED;
+        }
+        if (m_chunked) {
+            return BAD_REQUEST;
         }
-    } else if (strncasecm(text, "Content-Length:", 15) == 0) {  // 处理 Content-Length头部字段
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);
-    } else if (strncasecmp(text, "Host:", 5) == 0) {    // 处理Host头部字段
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
+        m_chunked = true;
+    } else if (name.size() == 6 && http_parser::iequals(name, "Expect")) {
+        m_expect_continue = http_parser::iequals(value, "100-continue");
+    } else if (name.size() == 4 && http_parser::iequals(name, "Host")) {
+        m_host = (char*)value.data();
     } else {
+#ifdef HTTP_CONN_DEBUG
         printf("oop! unknow header %s \n", text);
+#endif
     }
 
     return NO_REQUEST;
 }
 
-// 我们没有真正解析HTTP请求的消息体，只是判断它是否被完整地读入
-http_conn::HTTP_CODE http_conn::parse_content(char* text)
+http_conn::HTTP_CODE http_conn::start_body()
+{
+    // 目标文件的路径在这里确定：接收消息体时请求行和头部字段所在的字节会被丢弃
+    strcpy(m_real_file, doc_root);
+    int len = strlen(doc_root);
+    strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
+
+    // 同时有 Transfer-Encoding 和 Content-Length 时以前者为准，应答之后关闭连接
+    if (m_chunked && m_content_length > 0) {
+        m_linger = false;
+    }
+    // 过载时不查找文件、不调用处理函数，也不接收消息体：有消息体的请求应答之后关闭连接
+    if (m_shed) {
+        if (m_chunked || m_content_length > 0) {
+            m_linger = false;
+        }
+        return SERVICE_UNAVAILABLE;
+    }
+    // 头部字段在接收消息体时会被丢弃，这里先记下应答要用的
+    m_accept_encoding = compressor::accepted(header("Accept-Encoding"));
+    // URL 被截断时不参与路由，以免匹配到别的路径
+    if (m_router && strlen(m_url) < (size_t)(FILENAME_LEN - len - 1)) {
+        route_match match;
+        if (m_router->find(m_method, route_path(), &match)) {
+            m_route = match.route;
+        }
+    }
+    // 路由自己的消息体处理器优先
+    body_handler_factory factory = m_route && m_route->factory ? m_route->factory : m_body_handler_factory;
+    if (m_method == POST && factory) {
+        m_body_handler = factory(m_url, m_chunked ? -1 : m_content_length);
+        if (!m_body_handler) {
+            // 消息体没有读，连接上后面的数据无法解析
+            m_linger = false;
+            return FORBIDDEN_REQUEST;
+        }
+    }
+    if (!m_chunked && m_content_length == 0) {
+        return finish_body();
+    }
+
+    if (m_expect_continue) {
+        // 临时应答排在同一个发送队列里，跟在前面流水线请求的应答后面按顺序发出
+        static const char continue_line[] = "HTTP/1.1 100 Continue\r\n\r\n";
+        int start = m_write_idx;
+        if ((!m_write_buf && !grow_write_buf()) || !add_bytes(continue_line, sizeof(continue_line) - 1)) {
+            return INTERNAL_ERROR;
+        }
+        queue_segment(NULL, start, sizeof(continue_line) - 1);
+    }
+
+    m_check_state = CHECK_STATE_CONTENT;
+    m_chunk_state = CHUNK_SIZE;
+    m_body_remaining = m_chunked ? 0 : m_content_length;
+    m_url = 0;
+    m_version = 0;
+    m_host = 0;
+    m_headers.clear();
+    m_request_start = m_checked_idx;
+    m_start_line = m_checked_idx;
+    return NO_REQUEST;
+}
+
+bool http_conn::deliver_body(const char* data, long len)
+{
+    m_body_received += len;
+    return !m_body_handler || m_body_handler->on_data(data, len);
+}
+
+http_conn::HTTP_CODE http_conn::finish_body()
+{
+    if (m_body_handler && !m_body_handler->on_complete()) {
+        return INTERNAL_ERROR;
+    }
+    if (m_route) {
+        return ROUTE_REQUEST;
+    }
+    if (m_method != POST) {
+        // GET 请求的消息体没有意义，丢弃之后照常返回文件
+        return do_request();
+    }
+    return POST_REQUEST;
+}
+
+std::string_view http_conn::route_path() const
+{
+    const char* url = m_real_file + strlen(doc_root);
+    const char* query = strchr(url, '?');
+    return std::string_view(url, query ? query - url : strlen(url));
+}
+
+// 消息体边收边交给处理器，交出去的字节随即从读缓冲区中丢弃，所以内存占用与消息体大小无关
+// 消息体之后可能紧跟着下一个流水线请求，所以不能越过消息体的末尾
+http_conn::HTTP_CODE http_conn::parse_content()
 {
-    if (m_read_idx >= (m_content_length + m_checked_idx)) {
-        text[m_content_length] = '\0';
-        return GET_REQUEST;
+    while (true) {
+        if (!m_chunked || m_chunk_state == CHUNK_DATA) {
+            long n = m_read_idx - m_checked_idx;
+            if (n > m_body_remaining) {
+                n = m_body_remaining;
+            }
+            if (n > 0) {
+                if (!deliver_body(m_read_buf + m_checked_idx, n)) {
+                    return INTERNAL_ERROR;
+                }
+                m_checked_idx += n;
+                m_body_remaining -= n;
+            }
+            m_start_line = m_checked_idx;
+            m_request_start = m_checked_idx;
+            if (m_body_remaining > 0) {
+                return NO_REQUEST;
+            }
+            if (!m_chunked) {
+                return finish_body();
+            }
+            m_chunk_state = CHUNK_DATA_END;
+        }
+
+        LINE_STATUS line_status = parse_line();
+        if (line_status == LINE_BAD) {
+            return BAD_REQUEST;
+        }
+        if (line_status == LINE_OPEN) {
+            return m_checked_idx - m_start_line > MAX_CHUNK_LINE ? BAD_REQUEST : NO_REQUEST;
+        }
+        char* text = get_line();
+        int len = m_checked_idx - m_start_line - 2;
+        m_start_line = m_checked_idx;
+        m_request_start = m_checked_idx;
+
+        switch (m_chunk_state) {
+            case CHUNK_SIZE:
+            {
+                // 块大小是十六进制，后面可能有 ";扩展"，忽略扩展；
+                // 不用 strtol：它接受前导空白、正负号和 0x 前缀，前面的代理可能按另一种方式切分消息体
+                long size;
+                if (!http_parser::parse_chunk_size(std::string_view(text, len), &size)) {
+                    return BAD_REQUEST;
+                }
+                if (size == 0) {
+                    m_chunk_state = CHUNK_TRAILER;
+                } else {
+                    m_body_remaining = size;
+                    m_chunk_state = CHUNK_DATA;
+                }
+                break;
+            }
+            case CHUNK_DATA_END:
+            {
+                if (len != 0) {
+                    return BAD_REQUEST;
+                }
+                m_chunk_state = CHUNK_SIZE;
+                break;
+            }
+            case CHUNK_TRAILER:
+            {
+                // 尾部字段忽略，空行表示消息体结束
+                if (len == 0) {
+                    return finish_body();
+                }
+                break;
+            }
+            default:
+            {
+                return INTERNAL_ERROR;
+            }
+        }
     }
 }
 
@@ -231,16 +615,31 @@ http_conn::HTTP_CODE http_conn::process_read()
     HTTP_CODE ret = NO_REQUEST;
     char *text = 0;
 
-    while ((m_check_state == CHECK_STATE_CONTENT) && (line_status == LINE_OK) || ((line_status = parse_line()) == LINE_OK)) {
+    while (true) {
+        // 消息体不是按行解析的
+        if (m_check_state == CHECK_STATE_CONTENT) {
+            return parse_content();
+        }
+        line_status = parse_line();
+        if (line_status == LINE_BAD) {
+            return BAD_REQUEST;
+        } else if (line_status == LINE_OPEN) {
+            break;
+        }
+
         text = get_line();
+        // 完整的一行以 "\r\n" 结尾，两个字节都已经被改写成 '\0'
+        int len = m_checked_idx - m_start_line - 2;
         m_start_line = m_checked_idx;
-        prnitf("got 1 http line: %s\n", text);
+#ifdef HTTP_CONN_DEBUG
+        printf("got 1 http line: %s\n", text);
+#endif
 
-        switch (m_checked_idx)
+        switch (m_check_state)
         {
             case CHECK_STATE_REQUESTLINE:
             {
-                ret = parse_request_line(text);
+                ret = parse_request_line(text, len);
                 if (ret == BAD_REQUEST) {
                     return BAD_REQUEST;
                 }
@@ -248,24 +647,13 @@ http_conn::HTTP_CODE http_conn::process_read()
             } 
             case CHECK_STATE_HEADER:
             {
-                ret = parse_headers(text);
-
-                if (ret == BAD_REQUEST) {
-                    return BAD_REQUEST;
-                } else if (ret == GET_REQUEST) {
-                    return do_request();
+                ret = parse_headers(text, len);
+                // 请求头结束时，没有消息体的请求已经得到了结果
+                if (ret != NO_REQUEST) {
+                    return ret;
                 }
                 break;
             }
-            case CHECK_STATE_CONTENT:
-            {
-                ret = parse_content(text);
-                if (ret == GET_REQUEST) {
-                    return do_request();
-                }
-                line_status = LINE_OPEN;
-                break;
-            }
             default:
             {
                 return INTERNAL_ERROR;
@@ -277,141 +665,310 @@ http_conn::HTTP_CODE http_conn::process_read()
 
 /**
  * 当得到一个完整，正确的HTTP 请求时，我们就分析目标文件的属性。
- * 如果目标文件存在，对所有用户可读，且不是目录，则使用mmap将其映射到内存地址m_file_address处，并告诉调用者获取文件成功
+ * 如果目标文件存在，对所有用户可读，且不是目录，则从文件缓存取得它(打开的描述符，小文件还有mmap映射)，并告诉调用者获取文件成功
  */
 http_conn::HTTP_CODE http_conn::do_request()
 {
-    strcpy(m_real_file, doc_root);
-    int len = strlen(doc_root);
-    strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
-    if (stat(m_real_file, &m_file_stat) < 0) {
-        return NO_RESOUCE;
-    }
-
-    if (!(m_file_stat.st_mode & S_IROTH)) {
-        return FORBIDDEN_REQUEST;
-    }
-
-    if (S_ISDIR(m_file_stat.st_mode)) {
-        return BAD_REQUEST;
+    metrics::scope timing(metrics::STAGE_DO_REQUEST);
+    // m_real_file 已经在 start_body 中确定
+    switch (file_cache::instance()->acquire(m_real_file, &m_file)) {
+        case file_cache::OK:
+            return FILE_REQUEST;
+        case file_cache::NOT_FOUND:
+            return NO_RESOUCE;
+        case file_cache::FORBIDDEN:
+            return FORBIDDEN_REQUEST;
+        case file_cache::NOT_FILE:
+            return BAD_REQUEST;
+        default:
+            return INTERNAL_ERROR;
     }
-
-    int fd = open(m_read_file, O_RDONLY);
-    m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
-    return FILE_REQUEST;
 }
 
-// 对内存映射区执行munmap操作
+// 释放对文件缓存的引用，包括已经排进发送队列的文件，并清空发送队列
 void http_conn::unmap()
 {
-    if (m_file_address) {
-        mummap(m_file_address, m_file_stat.st_size);
-        m_file_address = 0;
+    file_cache* cache = file_cache::instance();
+    if (m_file) {
+        cache->release(m_file);
+        m_file = NULL;
     }
+    for (size_t i = 0; i < m_out.size(); ++i) {
+        cache->release(m_out[i].file);
+    }
+    m_out.clear();
+    m_out_index = 0;
 }
 
-// 写HTTP响应
+// 写HTTP响应。一批流水线请求的应答(包括各自的文件内容)用 writev 一起发送，没有映射的大文件的原文用 sendfile 发送
 bool http_conn::write()
 {
-    int temp = 0;
-    int bytes_have_send = 0;
-    int bytes_to_send = m_write_idx;
-    if (bytes_to_send == 0) {
-        modfd(m_epollfd, m_sockfd, EPOLLIN);
-        init();
-        return true;
-    }
-
-    while (1)
+    metrics::scope timing(metrics::STAGE_WRITE);
+    while (m_out_index < m_out.size())
     {
-        temp = writev(m_sockfd, m_iv, m_iv_count);
+        ssize_t temp;
+        const out_segment& first = m_out[m_out_index];
+        if (first.file && !first.encoding && !first.file->address) {
+            off_t offset = first.offset;
+            temp = sendfile(m_sockfd, first.file->fd, &offset, first.length);
+            // 文件在发送过程中被截短
+            if (temp == 0) {
+                return false;
+            }
+        } else {
+            struct iovec iov[MAX_IOVEC];
+            temp = writev(m_sockfd, iov, prepare_write(iov, MAX_IOVEC));
+        }
         if (temp <= -1) {
             /**
              * 如果TCP写缓冲没有空间，则等待下一轮EPOLLOUT事件，虽然在此期间，服务器无法立即接收同一客户的下一个请求，但这可以保证连接的完整性
              */
-            if (errno == EAGIN) {
+            if (errno == EAGAIN) {
                 modfd(m_epollfd, m_sockfd, EPOLLOUT);
                 return true;
             }
-            unmap();
             return false;
         }
+        advance_write(temp);
+    }
+    return finish_write();
+}
 
-        bytes_to_send -= temp;
-        bytes_have_send += temp;
+int http_conn::prepare_write(struct iovec* iov, int max) const
+{
+    // 收集到下一个需要 sendfile 的段为止
+    int count = 0;
+    for (size_t i = m_out_index; i < m_out.size() && count < max; ++i, ++count) {
+        const out_segment& seg = m_out[i];
+        if (seg.file && !seg.encoding && !seg.file->address) {
+            break;
+        }
+        const char* base = m_write_buf;
+        if (seg.file) {
+            base = seg.encoding ? seg.file->variants[seg.encoding].data : seg.file->address;
+        }
+        iov[count].iov_base = (char*)base + seg.offset;
+        iov[count].iov_len = seg.length;
+    }
+    return count;
+}
 
-        if (bytes_to_send <= bytes_have_send) {
-            // 发送HTTP响应成功，根据HTTP请求中的Connection字段决定是否立即关闭连接
-            unmap();
-            if (m_linger) {
-                init();
-                modfd(m_epollfd, m_sockfd, EPOLLIN);
-                return true;
-            } else {
-                modfd(m_epollfd, m_sockfd, EPOLLIN);
-                return false;
-            }
+bool http_conn::complete_write(long bytes)
+{
+    advance_write(bytes);
+    return m_out_index < m_out.size() || finish_write();
+}
+
+void http_conn::advance_write(long bytes)
+{
+    // writev 可能只写出一部分，跳过已经发完的段，并调整断点所在段的起始位置
+    while (bytes > 0) {
+        out_segment& seg = m_out[m_out_index];
+        if (bytes >= seg.length) {
+            bytes -= seg.length;
+            ++m_out_index;
+        } else {
+            seg.offset += bytes;
+            seg.length -= bytes;
+            bytes = 0;
         }
     }
 }
 
-// 往写缓冲中写入待发送的数据
-bool http_conn::add_response(const char* format, ...) {
-    if (m_write_idx >= WRITE_BUFFER_SIZE) {
+bool http_conn::finish_write()
+{
+    // 这一批应答发送完毕，释放文件和写缓冲区
+    unmap();
+    m_write_idx = 0;
+    if (m_write_buf) {
+        buffer_pool::instance()->release(m_write_buf, m_write_buf_size);
+        m_write_buf = NULL;
+        m_write_buf_size = 0;
+    }
+
+    // 根据HTTP请求中的Connection字段决定是否立即关闭连接
+    if (!m_linger) {
         return false;
     }
+    // 读缓冲区中还有流水线请求没有处理，由调用者再次调度 process()，这时不能重新注册 EPOLLIN
+    if (has_pending_input()) {
+        return true;
+    }
+    // 发完的是 100 Continue 时请求还没有收完，保留解析状态继续接收消息体
+    if (m_check_state != CHECK_STATE_CONTENT) {
+        init();
+    }
+    modfd(m_epollfd, m_sockfd, EPOLLIN);
+    return true;
+}
 
-    va_list arg_list;
-    int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list);
-    if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx)) {
+bool http_conn::grow_write_buf()
+{
+    int new_size = 0;
+    char* new_buf = buffer_pool::instance()->acquire(m_write_buf ? m_write_buf_size * 2 : WRITE_BUFFER_SIZE, &new_size);
+    if (!new_buf) {
         return false;
     }
+
+    // 发送队列里记录的是写缓冲区内的偏移，换缓冲区不影响它们
+    if (m_write_buf) {
+        memcpy(new_buf, m_write_buf, m_write_idx);
+        buffer_pool::instance()->release(m_write_buf, m_write_buf_size);
+    }
+    m_write_buf = new_buf;
+    m_write_buf_size = new_size;
+    return true;
+}
+
+// 往写缓冲中写入待发送的数据，写缓冲区不够时增长
+bool http_conn::add_response(const char* format, ...) {
+    while (true) {
+        if (m_write_idx < m_write_buf_size) {
+            va_list arg_list;
+            va_start(arg_list, format);
+            int len = vsnprintf(m_write_buf + m_write_idx, m_write_buf_size - 1 - m_write_idx, format, arg_list);
+            va_end(arg_list);
+            if (len < (m_write_buf_size - 1 - m_write_idx)) {
+                m_write_idx += len;
+                return true;
+            }
+        }
+        if (!grow_write_buf()) {
+            return false;
+        }
+    }
+}
+
+void http_conn::queue_segment(file_cache::entry* file, long offset, long length, compressor::ENCODING encoding)
+{
+    // 写缓冲区中相邻的两段合并成一段
+    if (!file && !m_out.empty()) {
+        out_segment& last = m_out.back();
+        if (!last.file && last.offset + last.length == offset) {
+            last.length += length;
+            return;
+        }
+    }
+    out_segment seg;
+    seg.file = file;
+    seg.offset = offset;
+    seg.length = length;
+    seg.encoding = encoding;
+    m_out.push_back(seg);
+}
+
+// 往写缓冲中拷贝一段数据，写缓冲区不够时增长
+bool http_conn::add_bytes(const char* data, int len)
+{
+    while (m_write_idx + len > m_write_buf_size) {
+        if (!grow_write_buf()) {
+            return false;
+        }
+    }
+    memcpy(m_write_buf + m_write_idx, data, len);
     m_write_idx += len;
-    va_end(arg_list);
     return true;
 }
 
+// 下面这些函数用预先生成的片段拼接应答头，不经过 vsnprintf
 bool http_conn::add_status_line(int status, const char* title)
 {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    const http_response::chunk* line = http_response::status_line(status);
+    if (!line) {
+        return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    }
+    return add_bytes(line->data, line->len);
 }
 
 bool http_conn::add_headers(int content_len)
 {
-    add_content_length(content_len);
-    add_linger();
-    add_blank_line();
+    return add_date() && add_content_length(content_len) && add_linger() && add_blank_line();
+}
+
+bool http_conn::add_encoding(compressor::ENCODING encoding)
+{
+    static const char gzip[] = "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n";
+    static const char br[] = "Content-Encoding: br\r\nVary: Accept-Encoding\r\n";
+    if (encoding == compressor::BROTLI) {
+        return add_bytes(br, sizeof(br) - 1);
+    }
+    return add_bytes(gzip, sizeof(gzip) - 1);
+}
+
+bool http_conn::add_vary()
+{
+    static const char vary[] = "Vary: Accept-Encoding\r\n";
+    return add_bytes(vary, sizeof(vary) - 1);
+}
+
+bool http_conn::add_gzip_chunked(const char* data, int len)
+{
+    static const char chunked[] = "Transfer-Encoding: chunked\r\n";
+    gzip_stream* stream = gzip_stream::local();
+    if (!add_date() || !add_encoding(compressor::GZIP) || !add_bytes(chunked, sizeof(chunked) - 1)
+            || !add_linger() || !add_blank_line() || !stream->begin(compressor::DYNAMIC_GZIP_LEVEL)) {
+        return false;
+    }
+    // 压缩输出每满一段就作为一个块追加到写缓冲区，不需要另外保存整个压缩结果
+    bool ok = stream->write(data, len, true, [this](const char* out, int n) {
+        char size_line[16];
+        int size_len = snprintf(size_line, sizeof(size_line), "%x\r\n", n);
+        return add_bytes(size_line, size_len) && add_bytes(out, n) && add_bytes("\r\n", 2);
+    });
+    return ok && add_bytes("0\r\n\r\n", 5);
 }
 
 bool http_conn::add_content_length(int content_len)
 {
-    return add_response("Content-Length: %d\r\n", content_len);
+    char buf[40] = "Content-Length: ";
+    int len = 16;
+    len += http_response::format_uint(buf + len, content_len);
+    buf[len++] = '\r';
+    buf[len++] = '\n';
+    return add_bytes(buf, len);
 }
 
 bool http_conn::add_linger()
 {
-    return add_response("Connection: %s\r\n", (m_linger == true) ? "keep-alive" : "close");
+    const http_response::chunk& line = http_response::connection(m_linger);
+    return add_bytes(line.data, line.len);
+}
+
+bool http_conn::add_date()
+{
+    const http_response::chunk& line = http_response::date();
+    return add_bytes(line.data, line.len);
 }
 
 bool http_conn::add_blank_line()
 {
-    return add_response("%s", "\r\n");
+    return add_bytes("\r\n", 2);
 }
 
 bool http_conn::add_content(const char* content)
 {
-    return add_response("%s", content);
+    return add_bytes(content, strlen(content));
 }
 
 // 根据服务处理器HTTP请求的结果，决定返回给客户端的内容
+// 应答追加到发送队列中，同一批流水线请求的应答依次排列
 bool http_conn::process_write(HTTP_CODE ret)
 {
+    if (!m_write_buf && !grow_write_buf()) {
+        return false;
+    }
+
+    // 请求格式错误或者服务器出错时，后面的数据已经无法可靠地解析，发送应答之后关闭连接
+    if (ret == BAD_REQUEST || ret == INTERNAL_ERROR || ret == NOT_IMPLEMENTED || ret == HEADER_TOO_LARGE) {
+        m_linger = false;
+    }
+
+    int start = m_write_idx;
     switch(ret) {
         case INTERNAL_ERROR:
         {
             add_status_line(500, error_500_title);
-            add_headers(strlen(error_500_title));
+            add_headers(strlen(error_500_from));
             if (!add_content(error_500_from)) {
                 return false;
             }
@@ -428,9 +985,9 @@ bool http_conn::process_write(HTTP_CODE ret)
         }
         case NO_RESOUCE:
         {
-            add_status_line(400, error_400_title);
-            add_headers(strlen(error_400_from));
-            if (!add_content(error_400_from)) {
+            add_status_line(404, error_404_title);
+            add_headers(strlen(error_404_from));
+            if (!add_content(error_404_from)) {
                 return false;
             }
             break;
@@ -444,50 +1001,217 @@ bool http_conn::process_write(HTTP_CODE ret)
             }
             break;
         }
+        case HEADER_TOO_LARGE:
+        {
+            add_status_line(431, error_431_title);
+            add_headers(strlen(error_431_from));
+            if (!add_content(error_431_from)) {
+                return false;
+            }
+            break;
+        }
+        case NOT_IMPLEMENTED:
+        {
+            add_status_line(501, error_501_title);
+            add_headers(strlen(error_501_from));
+            if (!add_content(error_501_from)) {
+                return false;
+            }
+            break;
+        }
+        case SERVICE_UNAVAILABLE:
+        {
+            static const char retry_after[] = "Retry-After: 1\r\n";
+            add_status_line(503, error_503_title);
+            add_bytes(retry_after, sizeof(retry_after) - 1);
+            add_headers(strlen(error_503_from));
+            if (!add_content(error_503_from)) {
+                return false;
+            }
+            break;
+        }
+        case POST_REQUEST:
+        {
+            // 告诉客户端收到了多少字节的消息体
+            char content[40];
+            int len = http_response::format_uint(content, m_body_received);
+            memcpy(content + len, " bytes received\n", 16);
+            len += 16;
+            add_status_line(200, ok_20_title);
+            if (!add_headers(len) || !add_bytes(content, len)) {
+                return false;
+            }
+            break;
+        }
+        case ROUTE_REQUEST:
+        {
+            // 再查找一次取得路径参数：它们指向 m_real_file，接收消息体期间读缓冲区里的请求行已经被丢弃
+            route_match match;
+            if (!m_router->find(m_method, route_path(), &match)) {
+                return false;
+            }
+            // 每个线程复用同一个字符串，应答体拷贝进写缓冲区之后就不再需要
+            static thread_local std::string body;
+            body.clear();
+            int status = match.route->handler(match, body);
+            add_status_line(status, http_response::reason(status));
+            if (body.size() >= (size_t)COMPRESS_ROUTE_SIZE && (m_accept_encoding & (1 << compressor::GZIP))) {
+                if (!add_gzip_chunked(body.data(), body.size())) {
+                    return false;
+                }
+                break;
+            }
+            if (!add_headers(body.size()) || !add_bytes(body.data(), body.size())) {
+                return false;
+            }
+            break;
+        }
         case FILE_REQUEST:
         {
             add_status_line(200, ok_20_title);
-            if (m_file_stat.st_size != 0)
+            if (m_file->st.st_size != 0)
             {
-                add_headers(m_file_stat.st_size);
-                m_iv[0].iov_base = m_write_buf;
-                m_iv[0].iov_len = m_write_idx;
-                m_iv[1].iov_base = m_file_address;
-                m_iv[1].iov_len = m_file_stat.st_size;
-                m_iv_count = 2;
+                // 客户端接受、文件值得压缩时发送缓存的压缩版本
+                compressor::ENCODING encoding = compressor::choose(m_accept_encoding);
+                const char* data = NULL;
+                size_t length = m_file->st.st_size;
+                bool compressible = compressor::compressible(m_file->path.c_str());
+                if (encoding == compressor::IDENTITY || !compressible
+                        || !file_cache::instance()->acquire_variant(m_file, encoding, &data, &length)) {
+                    encoding = compressor::IDENTITY;
+                    length = m_file->st.st_size;
+                    // 应答内容取决于 Accept-Encoding，中间的缓存要区分
+                    if (compressible && m_file->st.st_size >= compressor::MIN_SIZE && !add_vary()) {
+                        return false;
+                    }
+                } else if (!add_encoding(encoding)) {
+                    return false;
+                }
+                if (!add_headers(length)) {
+                    return false;
+                }
+                // 文件的引用交给发送队列，发送完毕后统一释放
+                queue_segment(NULL, start, m_write_idx - start);
+                queue_segment(m_file, 0, length, encoding);
+                m_file = NULL;
                 return true;
             } else {
+                file_cache::instance()->release(m_file);
+                m_file = NULL;
                 const char* ok_string = "<html><body></body></html>";
                 add_headers(strlen(ok_string));
                 if (!add_content(ok_string)) {
                     return false;
                 }
             }
+            break;
         }
         default:
         {
             return false;
         }
     }
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv_count = 1;
+    queue_segment(NULL, start, m_write_idx - start);
     return true;
 }
 
-// 由线程池的工作线程调用，这是处理HTTP请求的入口函数
+// 由线程池的工作线程(或者 reactor 线程)调用，这是处理HTTP请求的入口函数
 void http_conn::process()
 {
-    HTTP_CODE read_ret = process_read();
-    if (read_ret == NO_REQUEST) {
-        modfd(m_epollfd, m_sockfd, EPOLLIN);
-        return;
+    metrics::finish(metrics::STAGE_QUEUE, m_queued_at);
+    m_queued_at = 0;
+    if (m_enqueued_ns) {
+        // 在线程池里等得太久，客户端多半已经不想要这个应答了，直接拒绝，把时间留给排在后面的请求
+        int64_t now = admission::now_ns();
+        bool shed = admission::instance()->on_dequeue(now - m_enqueued_ns, now);
+        m_enqueued_ns = 0;
+        if (shed) {
+            m_shed = true;
+        }
+    }
+    NEXT_STEP next;
+    int handled = process_requests(next);
+    if (m_shed) {
+        m_shed = false;
+        metrics::count(metrics::COUNTER_SHED_QUEUE_TIMEOUT, handled);
+    }
+
+    // 先清除 busy 再重新注册事件：注册之后 reactor 随时可能拿到事件，把连接再次交给线程池。
+    // 要关闭的连接不在这里关，描述符关了就可能被 accept 复用；只 shutdown，由 reactor 收到 EPOLLHUP 后关闭
+    int epollfd = m_epollfd;
+    int sockfd = m_sockfd;
+    if (next == NEXT_CLOSE && epollfd >= 0) {
+        shutdown(sockfd, SHUT_RDWR);
+        next = NEXT_READ;
+    }
+    m_busy.store(false, std::memory_order_release);
+    // 之后连接已经交回 reactor，只能用上面取出的描述符
+    if (next == NEXT_CLOSE) {
+        close_conn();
+    } else {
+        modfd(epollfd, sockfd, next == NEXT_WRITE ? EPOLLOUT : EPOLLIN);
     }
+}
 
-    bool write_ret = process_write(read_ret);
-    if (!write_ret) {
+int http_conn::shed()
+{
+    m_shed = true;
+    NEXT_STEP next;
+    int handled = process_requests(next);
+    m_shed = false;
+    if (next == NEXT_CLOSE) {
         close_conn();
+    } else {
+        modfd(m_epollfd, m_sockfd, next == NEXT_WRITE ? EPOLLOUT : EPOLLIN);
+    }
+    return handled;
+}
+
+// 读缓冲区里可能有多个流水线请求，依次解析并把应答排进同一个发送队列，最后一起发送
+int http_conn::process_requests(NEXT_STEP& next)
+{
+    int handled = 0;
+    while (handled < MAX_PIPELINE) {
+        HTTP_CODE read_ret;
+        {
+            metrics::scope timing(metrics::STAGE_PROCESS_READ);
+            read_ret = process_read();
+        }
+        if (read_ret == NO_REQUEST) {
+            break;
+        }
+
+        bool write_ret;
+        {
+            metrics::scope timing(metrics::STAGE_PROCESS_WRITE);
+            write_ret = process_write(read_ret);
+        }
+        if (!write_ret) {
+            next = NEXT_CLOSE;
+            return handled;
+        }
+        ++handled;
+        ++m_requests;
+
+        finish_request();
+        // Connection: close 之后的请求不再处理
+        if (!m_linger) {
+            break;
+        }
     }
 
-    modfd(m_epollfd, m_sockfd, EPOLLOUT);
+    metrics::count(metrics::COUNTER_REQUESTS, handled);
+    compact_read_buf();
+    // 读缓冲区已经增长到上限，却连一个完整的请求头都放不下
+    if (handled < MAX_PIPELINE && m_check_state != CHECK_STATE_CONTENT
+            && m_read_idx >= m_read_buf_size && m_read_buf_size >= MAX_READ_BUFFER_SIZE) {
+        // 回 431，发送之后关闭连接
+        if (!process_write(HEADER_TOO_LARGE)) {
+            next = NEXT_CLOSE;
+            return handled;
+        }
+    }
+    // 发送队列里也可能只有 100 Continue
+    next = m_out.empty() ? NEXT_READ : NEXT_WRITE;
+    return handled;
 }
\ No newline at end of file
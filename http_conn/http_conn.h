@@ -16,95 +16,239 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <atomic>
+#include <vector>
 
-#include "demo_locker_1.h"
+#include "locker.h"
+#include "buffer_pool.h"
+#include "file_cache.h"
+#include "compressor.h"
+#include "http_parser.h"
+#include "http_response.h"
+#include "router.h"
+#include "metrics.h"
+#include "admission.h"
+#include "timer_wheel.h"
+
+/**
+ * 请求消息体的处理器，每个 POST 请求创建一个
+ * 消息体边收边交给处理器，服务器不缓存整个消息体；处理器在工作线程(或者 reactor 线程)中被调用，
+ * 同一个请求的调用不会并发
+ */
+class body_handler
+{
+    public:
+        virtual ~body_handler() {}
+        // 收到一段消息体，返回false时中止请求，应答500并关闭连接
+        virtual bool on_data(const char* data, int len) = 0;
+        // 消息体接收完毕，返回false时应答500
+        virtual bool on_complete() = 0;
+};
 
 class http_conn
 {
     public:
         // 文件名的最大长度
         static const int FILENAME_LEN = 200;
-        // 读缓冲区的大小
+        // 读缓冲区的初始大小，请求头更大时按2倍增长
         static const int READ_BUFFER_SIZE = 2048;
-        // 写缓冲区的大小
+        // 读缓冲区的最大大小，请求头超过则拒绝请求
+        static const int MAX_READ_BUFFER_SIZE = buffer_pool::MAX_BUFFER_SIZE;
+        // 读消息体时读缓冲区最多增长到这个大小，满了之后先交给处理器消费再继续读
+        static const int BODY_BUFFER_SIZE = 32 * 1024;
+        // 分块传输中块大小行和尾部字段行的最大长度
+        static const int MAX_CHUNK_LINE = 1024;
+        // 写缓冲区的初始大小，一批流水线请求的应答头放不下时按2倍增长
         static const int WRITE_BUFFER_SIZE = 1024;
-        // HTTP请求方法，但我们仅支持GET
+        // 一次 process() 最多处理的流水线请求数，剩下的在这一批应答发送完之后继续处理
+        static const int MAX_PIPELINE = 32;
+        // 一次 writev 最多提交的内存块数
+        static const int MAX_IOVEC = 64;
+        // 动态应答体达到这个大小、客户端接受 gzip 时，压缩后分块发送
+        static const int COMPRESS_ROUTE_SIZE = 1024;
+        // 从请求的第一个字节开始，完整的请求头必须在这个时间内到达，期间收到数据不会延长(防止 slowloris)
+        static const int HEADER_TIMEOUT_MS = 10000;
+        // 读消息体或者发送应答时，两次进展之间的最长间隔
+        static const int BODY_TIMEOUT_MS = 30000;
+        // 应答发送完毕之后，等待下一个请求的最长时间
+        static const int KEEPALIVE_TIMEOUT_MS = 15000;
+        // HTTP请求方法，我们支持GET和POST
         enum METHOD {GET = 0, POST, HEAD, PUT, DELETE, TRACE, OPTIONS, CONNECT, PATCH};
         // 解析客户请求时，主机态所处的状态
         enum CHECK_STATE {CHECK_STATE_REQUESTLINE = 0, CHECK_STATE_HEADER, CHECK_STATE_CONTENT};
+        // 分块传输的消息体中，当前在等待的部分：块大小行、块数据、块数据后的 "\r\n"、尾部字段
+        enum CHUNK_STATE {CHUNK_SIZE = 0, CHUNK_DATA, CHUNK_DATA_END, CHUNK_TRAILER};
 
         // 服务器处理HTTP请求的可能结果
-        enum HTTP_CODE {NO_REQUEST, GET_REQUEST, BAD_REQUEST, NO_RESOUCE, FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION};
+        enum HTTP_CODE {NO_REQUEST, GET_REQUEST, BAD_REQUEST, NO_RESOUCE, FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION, POST_REQUEST, ROUTE_REQUEST, SERVICE_UNAVAILABLE, NOT_IMPLEMENTED, HEADER_TOO_LARGE};
 
         // 行的读取状态
         enum LINE_STATUS {LINE_OK = 0, LINE_BAD, LINE_OPEN};
 
+        // 连接当前在等什么，决定用哪一个超时时间
+        enum TIMER_PHASE {PHASE_NONE = 0, PHASE_HEADER, PHASE_BODY, PHASE_WRITE, PHASE_KEEPALIVE};
+
     public:
-        http_conn() {}
-        ~http_conn() {}
+        http_conn() : m_epollfd(-1), m_sockfd(-1), m_read_buf(NULL), m_read_buf_size(0), m_write_buf(NULL), m_write_buf_size(0), m_body_handler(NULL), m_route(NULL), m_shed(false), m_accept_encoding(0), m_file(NULL), m_out_index(0), m_requests(0), m_busy(false), m_queued_at(0), m_enqueued_ns(0), m_timer_phase(PHASE_NONE) { m_timer.data = this; }
+        ~http_conn() { release_buffers(); delete m_body_handler; }
 
     public:
-        // 初始化新接受的连接
-        void init(int sockfd, const sockaddr_in& addr);
+        // 初始化新接受的连接，epollfd 是负责这个连接的 reactor 的 epoll 内核事件表
+        void init(int sockfd, const sockaddr_in& addr, int epollfd);
         // 关闭连接
         void close_conn(bool real_close = true);
         // 处理客户请求
         void process();
+        // 过载时代替 process()：照常解析读缓冲区里的请求，但不执行，每个都回 503，连接保持。返回应答的请求数
+        int shed();
         // 非阻塞读操作
         bool read();
-        // 非阻塞写操作
+        // 非阻塞写操作。返回false时调用者应关闭连接；
+        // 返回true且 has_pending_input() 为真时，读缓冲区里还有未处理的请求，调用者应再次调度 process()
         bool write();
+
+        // 下面几个函数给 io_uring 用：数据由内核收好、应答由内核异步发送，连接自己不做系统调用
+        // 把收到的一段数据放进读缓冲区，代替 read()。返回放进去的字节数，和 read() 一样有背压：
+        // 小于 len 时要先 process() 消费读缓冲区，再交剩下的部分；返回-1表示取不到缓冲区，应关闭连接
+        int feed(const char* data, int len);
+        // 按发送队列填写最多 max 个内存块，返回0表示队首的段要用 sendfile 发送，这时调用 write()
+        int prepare_write(struct iovec* iov, int max) const;
+        // 已经发出 bytes 字节；返回值和 write() 相同
+        bool complete_write(long bytes);
+        // 还有应答没有发出
+        bool has_pending_output() const { return !m_out.empty(); }
+        // 应答已经全部发出，读缓冲区中还有未处理的数据
+        bool has_pending_input() const { return m_out.empty() && m_read_idx > 0; }
+        // 当前请求已经解析出的头部字段，按出现的顺序排列，指向读缓冲区
+        const std::vector<http_header>& headers() const { return m_headers; }
+        // 查找头部字段(名字大小写无关)，没有时返回空
+        std::string_view header(std::string_view name) const;
+
+        // 下面这组函数只在 reactor 线程中、连接不在线程池里处理时调用
+        // 连接已经关闭
+        bool closed() const { return m_sockfd == -1; }
+        int sockfd() const { return m_sockfd; }
+        // 根据连接当前的状态判断在等什么
+        TIMER_PHASE timer_phase() const;
+        static int phase_timeout(TIMER_PHASE phase);
+        // 连接的超时定时器，由 reactor 的时间轮管理
+        timer_wheel::node* timer() { return &m_timer; }
+        // 上一次设置定时器时的阶段
+        TIMER_PHASE scheduled_phase() const { return m_timer_phase; }
+        void set_scheduled_phase(TIMER_PHASE phase) { m_timer_phase = phase; }
+
+        // 交给线程池之前标记为正在处理，process() 返回前清除；超时时正在处理的连接不能关闭。
+        // 同时记下开始排队的时间
+        void set_busy()
+        {
+            m_queued_at = metrics::start(metrics::STAGE_QUEUE);
+            m_enqueued_ns = admission::now_ns();
+            m_busy.store(true, std::memory_order_relaxed);
+        }
+        // 线程池没有接收时撤销 set_busy()
+        void cancel_busy() { m_queued_at = 0; m_enqueued_ns = 0; m_busy.store(false, std::memory_order_relaxed); }
+        bool busy() const { return m_busy.load(std::memory_order_acquire); }
     
     private:
         // 初始化连接
         void init();
+        // 处理完一批请求之后连接要等的事件，或者要关闭
+        enum NEXT_STEP {NEXT_READ, NEXT_WRITE, NEXT_CLOSE};
+        // 解析并处理读缓冲区中的请求，返回处理的请求数；不重新注册事件，由调用者按 next 注册
+        int process_requests(NEXT_STEP& next);
+        // 从缓冲区池取得更大的读缓冲区，并把已读入的数据搬过去
+        bool grow_read_buf();
+        // 把读写缓冲区归还给缓冲区池
+        void release_buffers();
+        // 为解析下一个请求重置状态机和请求字段，不改变读缓冲区
+        void reset_request();
+        // 一个请求处理完毕，记录下一个请求的起始位置
+        void finish_request();
+        // 把读缓冲区中未处理的数据搬到开头
+        void compact_read_buf();
+        // 读缓冲区换址或者数据搬动之后，平移指向读缓冲区的指针
+        void shift_read_pointers(char* old_base, char* new_base);
+        // 从缓冲区池取得更大的写缓冲区
+        bool grow_write_buf();
+        // 发出了 bytes 字节，跳过已经发完的段
+        void advance_write(long bytes);
+        // 发送队列已经发完，释放应答占用的资源；返回值和 write() 相同
+        bool finish_write();
+        // 往发送队列追加一段数据
+        void queue_segment(file_cache::entry* file, long offset, long length,
+                           compressor::ENCODING encoding = compressor::IDENTITY);
         // 解析HTTP请求
         HTTP_CODE process_read();
         // 填充HTTP应答
         bool process_write(HTTP_CODE ret);
 
         // 下面这一组函数被process_read调用以分析HTTP请求
-        HTTP_CODE parse_request_line(char* text);
-        HTTP_CODE parse_headers(char* text);
-        HTTP_CODE parse_content(char* text);
+        HTTP_CODE parse_request_line(char* text, int len);
+        HTTP_CODE parse_headers(char* text, int len);
+        HTTP_CODE parse_content();
+        // 请求头解析完毕，准备接收消息体
+        HTTP_CODE start_body();
+        // 消息体接收完毕
+        HTTP_CODE finish_body();
+        // 把一段消息体交给处理器
+        bool deliver_body(const char* data, long len);
         HTTP_CODE do_request();
+        // 用于路由查找的路径：m_real_file 中 doc_root 之后的 URL，不含查询字符串
+        std::string_view route_path() const;
         char* get_line() { return m_read_buf + m_start_line; };
         LINE_STATUS parse_line();
 
         // 下面这一组函数被process_write调用以填充HTPP应答
         void unmap();
         bool add_response(const char* format, ...);
+        bool add_bytes(const char* data, int len);
         bool add_content(const char* content);
         bool add_status_line(int status, const char* title);
         bool add_headers(int content_length);
+        // 压缩的应答多出来的 Content-Encoding 和 Vary 字段
+        bool add_encoding(compressor::ENCODING encoding);
+        bool add_vary();
+        // 把应答体用 gzip 压缩后按分块传输写进写缓冲区，包括应答头的其余部分
+        bool add_gzip_chunked(const char* data, int len);
         bool add_content_length(int content_length);
         bool add_linger();
+        bool add_date();
         bool add_blank_line();
     
     public:
-        // 所有socket上的事件都被注册到同一个epoll内核事件表中，所以将epoll文件描述符设置为静态
-        static int m_epollfd;
-        // 统计用户数量
-        static int m_user_count;
+        // 统计用户数量，多个 reactor 线程同时修改
+        static std::atomic<int> m_user_count;
+
+        // 设置 POST 请求的消息体处理器，启动时调用；没有设置时消息体被丢弃
+        static void set_body_handler_factory(body_handler_factory factory) { m_body_handler_factory = factory; }
+        // 设置动态请求的路由，启动时调用；匹配的请求交给路由的处理函数，其余的照常返回文件
+        static void set_router(const router* r) { m_router = r; }
     
     private:
+        // 这个连接注册在哪个epoll内核事件表中。多 reactor 模式下每个 reactor 有自己的事件表；-1 表示由 io_uring 驱动
+        int m_epollfd;
         // 读HTTP连接的socket和对方socket地址
         int m_sockfd;
         sockaddr_in m_address;
 
-        // 读缓冲区
-        char m_read_buf[READ_BUFFER_SIZE];
+        // 读缓冲区，第一次读数据时从缓冲区池取得，连接空闲时归还
+        char* m_read_buf;
+        int m_read_buf_size;
         // 标识读缓冲区中已经读入的客户数据的最后一个字节的下一个位置
         int m_read_idx;
         // 当前正在分析的字符在读缓冲区中的位置
         int m_checked_idx;
         // 当前正在解析的行的起始位置
         int m_start_line;
-        // 写缓冲区
-        char m_write_buf[WRITE_BUFFER_SIZE];
-        // 写缓冲区中待发送的字节数
+        // 当前正在解析的请求在读缓冲区中的起始位置，之前的数据都已经处理完
+        int m_request_start;
+        // 写缓冲区，填充应答时从缓冲区池取得，应答发送完毕后归还
+        char* m_write_buf;
+        int m_write_buf_size;
+        // 写缓冲区中已经写入的字节数
         int m_write_idx;
 
         // 主状态机当前所处的状态
@@ -120,18 +264,60 @@ class http_conn
         char* m_version;
         // 主机名
         char* m_host;
+        // 头部字段索引，连接空闲时释放
+        std::vector<http_header> m_headers;
         // HTTP请求的消息体的长度
-        int m_content_length;
+        long m_content_length;
+        // 消息体是否分块传输
+        bool m_chunked;
+        // 客户端是否在等待 100 Continue
+        bool m_expect_continue;
+        CHUNK_STATE m_chunk_state;
+        // 当前这个块(或者整个 Content-Length 消息体)还没有收到的字节数
+        long m_body_remaining;
+        // 已经收到的消息体字节数
+        long m_body_received;
+        // POST 请求的消息体处理器
+        body_handler* m_body_handler;
+        // 请求匹配的路由，NULL 表示请求的是文件
+        const route* m_route;
+        // 正在 shed() 里，请求一律回 503
+        bool m_shed;
+        // 客户端接受的内容编码，compressor::accepted() 的结果
+        int m_accept_encoding;
         // HTTP请求是否要求保持连接
         bool m_linger;
 
-        // 客户请求的目标文件被mmap到内存中的起始位置
-        char* m_file_address;
-        // 目标文件的状态。通过它我么可以判断文件是否存在，是否为目录，是否可读，并获取文件大小等
-        struct stat m_file_stat;
-        // 我们将采用writev来执行写操作，所以定义下面两个成员，其中m_iv_count表示被写内存块的数量
-        struct iovev m_iv[2];
-        int m_iv_count;
+        // 客户请求的目标文件，从文件缓存取得，排进发送队列之前由这里持有引用
+        file_cache::entry* m_file;
+        // 发送队列中的一段数据。file 为 NULL 时 offset 是写缓冲区内的偏移(写缓冲区可能增长换址)，
+        // 否则是文件(encoding 不是 IDENTITY 时是文件的压缩版本)内的偏移：文件有映射或者是压缩版本时直接 writev，
+        // 没有映射(大文件)时用 sendfile。段持有文件的一个引用
+        struct out_segment
+        {
+            file_cache::entry* file;
+            long offset;
+            long length;
+            compressor::ENCODING encoding;
+        };
+        // 我们将采用writev来执行写操作，一批流水线请求的应答按顺序排在发送队列里
+        std::vector<out_segment> m_out;
+        // 下一个待发送的段
+        size_t m_out_index;
+
+        static body_handler_factory m_body_handler_factory;
+        static const router* m_router;
+
+        // 这个连接上已经处理的请求数
+        int m_requests;
+        // 是否正在线程池中处理
+        std::atomic<bool> m_busy;
+        // 交给线程池时的时间戳计数器，0 表示没有排队或者这一次不计时
+        uint64_t m_queued_at;
+        // 交给线程池时的单调时钟，用于准入控制，0 表示没有排队
+        int64_t m_enqueued_ns;
+        timer_wheel::node m_timer;
+        TIMER_PHASE m_timer_phase;
 };
 
 #endif
\ No newline at end of file
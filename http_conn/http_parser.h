@@ -0,0 +1,231 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_PARSER_X86 1
+#endif
+
+// 请求头索引中的一项，name 和 value 都指向读缓冲区，不拷贝
+struct http_header
+{
+    std::string_view name;
+    std::string_view value;
+};
+
+/**
+ * HTTP请求解析用到的扫描函数
+ * 找行尾是解析中最热的循环：x86 上用 SSE2 每次比较16字节、AVX2 每次比较32字节，
+ * 运行时按CPU支持的指令集选择，其他平台以及不足一个向量宽度的尾部逐字节扫描
+ */
+class http_parser
+{
+    public:
+        typedef const char* (*scan_fn)(const char* begin, const char* end);
+
+        // 返回 [begin, end) 中第一个 '\r' 或 '\n' 的位置，没有则返回 end
+        static const char* find_line_end(const char* begin, const char* end) { return m_find_line_end(begin, end); }
+
+        static const char* find_line_end_scalar(const char* begin, const char* end);
+#ifdef HTTP_PARSER_X86
+        static const char* find_line_end_sse2(const char* begin, const char* end);
+        static const char* find_line_end_avx2(const char* begin, const char* end);
+#endif
+        // 当前使用的实现
+        static const char* implementation();
+
+        // 返回 [begin, end) 中第一个空格或制表符的位置，没有则返回 end
+        static const char* find_space(const char* begin, const char* end);
+        // 跳过空格和制表符
+        static const char* skip_space(const char* begin, const char* end);
+        // ASCII 大小写无关的比较
+        static bool iequals(std::string_view a, std::string_view b);
+
+        // 把一行请求头(不含行尾)拆成名字和值，值去掉两端的空白；没有冒号或者名字为空时返回 false
+        static bool split_header(const char* line, size_t len, http_header* header);
+        // 解析 Content-Length 的值：只接受十进制数字(不允许符号、空白)，太长或者为空时返回 false
+        static bool parse_length(std::string_view value, long* length);
+        // 解析分块传输的块大小行(不含行尾)：1到16位十六进制数字，不允许符号、空白和 0x 前缀，
+        // 后面只能是行尾或者(可以有空白)以 ';' 开始的扩展；超出 long 的范围时返回 false
+        static bool parse_chunk_size(std::string_view line, long* size);
+
+    private:
+        static scan_fn select();
+        // 程序启动时选定一次
+        static inline const scan_fn m_find_line_end = select();
+};
+
+inline const char* http_parser::find_line_end_scalar(const char* begin, const char* end)
+{
+    for (; begin < end; ++begin) {
+        if (*begin == '\r' || *begin == '\n') {
+            break;
+        }
+    }
+    return begin;
+}
+
+#ifdef HTTP_PARSER_X86
+inline const char* http_parser::find_line_end_sse2(const char* begin, const char* end)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    for (; end - begin >= 16; begin += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)begin);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, cr), _mm_cmpeq_epi8(chunk, lf)));
+        if (mask) {
+            return begin + __builtin_ctz(mask);
+        }
+    }
+    return find_line_end_scalar(begin, end);
+}
+
+__attribute__((target("avx2")))
+inline const char* http_parser::find_line_end_avx2(const char* begin, const char* end)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    for (; end - begin >= 32; begin += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)begin);
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, cr), _mm256_cmpeq_epi8(chunk, lf)));
+        if (mask) {
+            return begin + __builtin_ctz(mask);
+        }
+    }
+    return find_line_end_sse2(begin, end);
+}
+#endif
+
+inline http_parser::scan_fn http_parser::select()
+{
+#ifdef HTTP_PARSER_X86
+    // 静态初始化阶段调用，此时CPU特性还不一定已经检测过
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return find_line_end_avx2;
+    }
+    return find_line_end_sse2;
+#else
+    return find_line_end_scalar;
+#endif
+}
+
+inline const char* http_parser::implementation()
+{
+#ifdef HTTP_PARSER_X86
+    if (m_find_line_end == find_line_end_avx2) {
+        return "avx2";
+    }
+    if (m_find_line_end == find_line_end_sse2) {
+        return "sse2";
+    }
+#endif
+    return "scalar";
+}
+
+inline const char* http_parser::find_space(const char* begin, const char* end)
+{
+    while (begin < end && *begin != ' ' && *begin != '\t') {
+        ++begin;
+    }
+    return begin;
+}
+
+inline const char* http_parser::skip_space(const char* begin, const char* end)
+{
+    while (begin < end && (*begin == ' ' || *begin == '\t')) {
+        ++begin;
+    }
+    return begin;
+}
+
+inline bool http_parser::iequals(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        // | 0x20 把大写字母转成小写；只有字母允许大小写不同，其他字符必须完全相等
+        char x = a[i], y = b[i];
+        if (x != y && ((x | 0x20) != (y | 0x20) || (unsigned)((x | 0x20) - 'a') > 'z' - 'a')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool http_parser::split_header(const char* line, size_t len, http_header* header)
+{
+    const char* end = line + len;
+    const char* colon = (const char*)memchr(line, ':', len);
+    if (!colon || colon == line) {
+        return false;
+    }
+
+    const char* value = skip_space(colon + 1, end);
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) {
+        --end;
+    }
+    header->name = std::string_view(line, colon - line);
+    header->value = std::string_view(value, end - value);
+    return true;
+}
+
+inline bool http_parser::parse_length(std::string_view value, long* length)
+{
+    // 18位十进制数不会超过 long 的范围
+    if (value.empty() || value.size() > 18) {
+        return false;
+    }
+    long result = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+        if ((unsigned)(value[i] - '0') > 9) {
+            return false;
+        }
+        result = result * 10 + (value[i] - '0');
+    }
+    *length = result;
+    return true;
+}
+
+inline bool http_parser::parse_chunk_size(std::string_view line, long* size)
+{
+    size_t digits = 0;
+    long result = 0;
+    for (; digits < line.size(); ++digits) {
+        char c = line[digits];
+        int value;
+        if ((unsigned)(c - '0') <= 9) {
+            value = c - '0';
+        } else if ((unsigned)((c | 0x20) - 'a') <= 'f' - 'a') {
+            value = (c | 0x20) - 'a' + 10;
+        } else {
+            break;
+        }
+        // 16位十六进制数可能超过 long 的范围，左移之前检查
+        if (digits == 16 || result > (LONG_MAX >> 4)) {
+            return false;
+        }
+        result = (result << 4) | value;
+    }
+    if (digits == 0) {
+        return false;
+    }
+    // 扩展的内容不解析
+    std::string_view rest = line.substr(digits);
+    if (!rest.empty()) {
+        const char* ext = skip_space(rest.data(), rest.data() + rest.size());
+        if (ext == rest.data() + rest.size() || *ext != ';') {
+            return false;
+        }
+    }
+    *size = result;
+    return true;
+}
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef HTTP_RESPONSE_H
+#define HTTP_RESPONSE_H
+
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * 填充HTTP应答用到的预先生成好的片段
+ * 状态行、Connection 字段都是固定的字符串，直接拷贝；Content-Length 用查表的整数转十进制；
+ * Date 字段每个线程缓存一份，每秒只重新格式化一次。整个应答头的生成不需要 vsnprintf
+ */
+class http_response
+{
+    public:
+        // 一个预先生成的片段
+        struct chunk
+        {
+            const char* data;
+            int len;
+        };
+
+        // 状态码对应的完整状态行(含 "\r\n")，没有预先生成的返回 NULL
+        static const chunk* status_line(int status);
+        // 状态码的描述，用于没有预先生成状态行的状态码
+        static const char* reason(int status);
+        static const chunk& connection(bool keep_alive);
+        // 当前时间的 "Date: ...\r\n"
+        static const chunk& date();
+
+        // 把 value 转换成十进制写入 out，返回写入的字节数，out 至少要有20字节
+        static int format_uint(char* out, unsigned long value);
+};
+
+#define HTTP_CHUNK(s) { s, sizeof(s) - 1 }
+
+inline const http_response::chunk* http_response::status_line(int status)
+{
+    static const chunk ok = HTTP_CHUNK("HTTP/1.1 200 OK\r\n");
+    static const chunk bad_request = HTTP_CHUNK("HTTP/1.1 400 Bad Request\r\n");
+    static const chunk forbidden = HTTP_CHUNK("HTTP/1.1 403 Forbidden\r\n");
+    static const chunk not_found = HTTP_CHUNK("HTTP/1.1 404 Not Found\r\n");
+    static const chunk internal_error = HTTP_CHUNK("HTTP/1.1 500 Internal Error\r\n");
+    static const chunk unavailable = HTTP_CHUNK("HTTP/1.1 503 Service Unavailable\r\n");
+    switch (status) {
+        case 200: return &ok;
+        case 400: return &bad_request;
+        case 403: return &forbidden;
+        case 404: return &not_found;
+        case 500: return &internal_error;
+        case 503: return &unavailable;
+        default: return NULL;
+    }
+}
+
+inline const http_response::chunk& http_response::connection(bool keep_alive)
+{
+    static const chunk keep = HTTP_CHUNK("Connection: keep-alive\r\n");
+    static const chunk close = HTTP_CHUNK("Connection: close\r\n");
+    return keep_alive ? keep : close;
+}
+
+#undef HTTP_CHUNK
+
+inline const char* http_response::reason(int status)
+{
+    switch (status) {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 409: return "Conflict";
+        case 413: return "Payload Too Large";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+    }
+}
+
+inline const http_response::chunk& http_response::date()
+{
+    // 每个线程一份，不需要加锁；秒数没变时直接返回上次的结果
+    static thread_local time_t cached_second = -1;
+    static thread_local char buf[64];
+    static thread_local chunk cached = { buf, 0 };
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    if (ts.tv_sec != cached_second) {
+        struct tm tm;
+        gmtime_r(&ts.tv_sec, &tm);
+        cached.len = strftime(buf, sizeof(buf), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        cached_second = ts.tv_sec;
+    }
+    return cached;
+}
+
+inline int http_response::format_uint(char* out, unsigned long value)
+{
+    static const char digits[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+    // 从低位往高位每次写两位，先写到临时缓冲区的末尾
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+    while (value >= 100) {
+        int pair = (value % 100) * 2;
+        value /= 100;
+        *--p = digits[pair + 1];
+        *--p = digits[pair];
+    }
+    if (value >= 10) {
+        int pair = value * 2;
+        *--p = digits[pair + 1];
+        *--p = digits[pair];
+    } else {
+        *--p = '0' + value;
+    }
+
+    int len = tmp + sizeof(tmp) - p;
+    memcpy(out, p, len);
+    return len;
+}
+
+#endif
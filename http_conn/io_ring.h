@@ -0,0 +1,325 @@
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include <deque>
+
+/**
+ * io_uring 的一个提交/完成队列对，直接用 io_uring_setup/io_uring_enter/io_uring_register 系统调用，不依赖 liburing
+ * 只给一个线程用：SQE 在本线程填写，完成事件在本线程收割(IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN，
+ * 内核不会在任意时刻打断本线程去处理完成事件，只在 io_uring_enter 等事件时集中处理)，这要求 6.1 以上的内核。
+ * 可以注册一个提供缓冲区的环(provided buffer ring)，多次触发的 recv 由内核从里面挑缓冲区，用完之后还回去
+ */
+class io_ring
+{
+    public:
+        io_ring();
+        ~io_ring();
+
+        // 创建队列，entries 是提交队列的大小；失败时返回 false 并设置 errno(比如内核不支持或者被禁用)
+        bool init(unsigned entries);
+        // 取得一个空的 SQE。提交队列满时放进用户态的积压队列，下次 submit_and_wait 时再搬进提交队列，
+        // 所以总能取到；这里不进内核，处理完成事件的途中调用也不会收割新的完成事件
+        io_uring_sqe* get_sqe();
+        // 接下来要填写 n 个用 IOSQE_IO_LINK 链接的 SQE：提交队列放不下时整条链都进积压队列，不拆到两次提交里
+        void reserve(unsigned n);
+        // 提交所有已经填写的 SQE，并等待至少 wait_nr 个完成事件，timeout_ms 为 -1 时一直等待；返回提交的个数或者 -errno
+        int submit_and_wait(unsigned wait_nr, int timeout_ms);
+        // 依次处理已经到达的完成事件，返回处理的个数
+        template <typename F>
+        int for_each_cqe(F on_cqe);
+
+        // 提供 count 个 size 字节的缓冲区给 group 组，count 必须是2的幂，用缓冲区环提供(5.19)
+        bool setup_buffers(unsigned short group, unsigned count, unsigned size);
+        char* buffer(unsigned short id) { return m_buffers + (size_t)id * m_buffer_size; }
+        // 把用完的缓冲区还给内核
+        void recycle_buffer(unsigned short id);
+
+        // 调用 io_uring_enter 的次数
+        unsigned long enters() const { return m_enters; }
+
+    private:
+        io_ring(const io_ring&);
+        io_ring& operator=(const io_ring&);
+
+        int enter(unsigned to_submit, unsigned min_complete, unsigned flags, const void* arg, size_t arg_size);
+        // 提交队列的空位
+        unsigned sq_space() const { return m_sq_entries - (m_sq_local_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE)); }
+        // 把积压的 SQE 按整条链搬进提交队列，搬到放不下为止
+        void flush_backlog();
+        // 注册缓冲区环
+        bool register_buffer_ring(unsigned short group, unsigned count);
+
+        int m_fd;
+        void* m_sq_ring;
+        size_t m_sq_ring_size;
+        void* m_cq_ring;
+        size_t m_cq_ring_size;
+        io_uring_sqe* m_sqes;
+        size_t m_sqes_size;
+
+        unsigned* m_sq_head;
+        unsigned* m_sq_tail;
+        unsigned m_sq_mask;
+        unsigned m_sq_entries;
+        // 已经填写但还没有发布给内核的 SQE 的尾部
+        unsigned m_sq_local_tail;
+        // 提交队列满时填写的 SQE，按顺序排在提交队列里的 SQE 后面；deque 追加时不移动已有的元素
+        std::deque<io_uring_sqe> m_backlog;
+        // reserve() 发现放不下一整条链，之后的 SQE 都进积压队列
+        bool m_spill;
+        unsigned* m_cq_head;
+        unsigned* m_cq_tail;
+        unsigned m_cq_mask;
+        io_uring_cqe* m_cqes;
+
+        io_uring_buf_ring* m_buf_ring;
+        size_t m_buf_ring_size;
+        unsigned m_buf_mask;
+        unsigned short m_buf_tail;
+        char* m_buffers;
+        unsigned m_buffer_size;
+        unsigned m_buffer_count;
+
+        unsigned long m_enters;
+};
+
+inline io_ring::io_ring()
+    : m_fd(-1), m_sq_ring(MAP_FAILED), m_sq_ring_size(0), m_cq_ring(MAP_FAILED), m_cq_ring_size(0),
+      m_sqes((io_uring_sqe*)MAP_FAILED), m_sqes_size(0), m_sq_local_tail(0), m_spill(false), m_buf_ring(NULL), m_buf_ring_size(0),
+      m_buf_mask(0), m_buf_tail(0), m_buffers(NULL), m_buffer_size(0), m_buffer_count(0), m_enters(0)
+{
+}
+
+inline io_ring::~io_ring()
+{
+    if (m_buf_ring) {
+        munmap(m_buf_ring, m_buf_ring_size);
+    }
+    if (m_buffers) {
+        munmap(m_buffers, (size_t)m_buffer_count * m_buffer_size);
+    }
+    if (m_sqes != MAP_FAILED) {
+        munmap(m_sqes, m_sqes_size);
+    }
+    if (m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring) {
+        munmap(m_cq_ring, m_cq_ring_size);
+    }
+    if (m_sq_ring != MAP_FAILED) {
+        munmap(m_sq_ring, m_sq_ring_size);
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+inline bool io_ring::init(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // 完成队列开大一些：多次触发的 accept 和 recv 会连续产生完成事件
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = entries * 4;
+    m_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (m_fd < 0) {
+        return false;
+    }
+    // 等待时的超时要用 IORING_ENTER_EXT_ARG(5.11)；6.1 之前的内核在 setup 时就因为 DEFER_TASKRUN 失败了
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        errno = ENOSYS;
+        return false;
+    }
+
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (m_cq_ring_size > m_sq_ring_size) {
+        m_sq_ring_size = m_cq_ring_size;
+    }
+    m_cq_ring_size = m_sq_ring_size;
+    m_sq_ring = mmap(0, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ring == MAP_FAILED) {
+        return false;
+    }
+    m_cq_ring = m_sq_ring;
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe*)mmap(0, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED) {
+        return false;
+    }
+
+    char* sq = (char*)m_sq_ring;
+    m_sq_head = (unsigned*)(sq + params.sq_off.head);
+    m_sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    m_sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+    m_sq_local_tail = *m_sq_tail;
+    // SQE 按顺序使用，索引数组固定为 i -> i
+    unsigned* array = (unsigned*)(sq + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; ++i) {
+        array[i] = i;
+    }
+    char* cq = (char*)m_cq_ring;
+    m_cq_head = (unsigned*)(cq + params.cq_off.head);
+    m_cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    m_cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    return true;
+}
+
+inline int io_ring::enter(unsigned to_submit, unsigned min_complete, unsigned flags, const void* arg, size_t arg_size)
+{
+    ++m_enters;
+    int ret = syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete, flags, arg, arg_size);
+    return ret < 0 ? -errno : ret;
+}
+
+inline io_uring_sqe* io_ring::get_sqe()
+{
+    io_uring_sqe* sqe;
+    if (m_backlog.empty() && !m_spill && sq_space() > 0) {
+        sqe = &m_sqes[m_sq_local_tail & m_sq_mask];
+        ++m_sq_local_tail;
+    } else {
+        m_backlog.emplace_back();
+        sqe = &m_backlog.back();
+    }
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+inline void io_ring::reserve(unsigned n)
+{
+    if (m_backlog.empty() && sq_space() < n) {
+        m_spill = true;
+    }
+}
+
+inline void io_ring::flush_backlog()
+{
+    while (!m_backlog.empty()) {
+        size_t len = 1;
+        while (len < m_backlog.size() && (m_backlog[len - 1].flags & IOSQE_IO_LINK)) {
+            ++len;
+        }
+        if (sq_space() < len) {
+            return;
+        }
+        for (size_t i = 0; i < len; ++i) {
+            m_sqes[m_sq_local_tail & m_sq_mask] = m_backlog.front();
+            ++m_sq_local_tail;
+            m_backlog.pop_front();
+        }
+    }
+    m_spill = false;
+}
+
+inline int io_ring::submit_and_wait(unsigned wait_nr, int timeout_ms)
+{
+    flush_backlog();
+    while (!m_backlog.empty()) {
+        // 积压的 SQE 放不进提交队列：先只提交不等待，腾出位置再搬；内核一个也没有接收时留到下一轮
+        unsigned to_submit = m_sq_local_tail - *m_sq_tail;
+        __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+        if (to_submit == 0 || enter(to_submit, 0, 0, NULL, 0) <= 0) {
+            break;
+        }
+        flush_backlog();
+    }
+
+    unsigned to_submit = m_sq_local_tail - *m_sq_tail;
+    __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+
+    // DEFER_TASKRUN 下完成事件只在带 GETEVENTS 进入内核时才处理，所以总是带上
+    unsigned flags = IORING_ENTER_GETEVENTS;
+    if (wait_nr == 0 || timeout_ms < 0) {
+        return enter(to_submit, wait_nr, flags, NULL, 0);
+    }
+    __kernel_timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+    int ret = enter(to_submit, wait_nr, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    // 超时没有等到事件不算错误
+    return ret == -ETIME ? 0 : ret;
+}
+
+template <typename F>
+int io_ring::for_each_cqe(F on_cqe)
+{
+    unsigned head = *m_cq_head;
+    unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    int count = 0;
+    while (head != tail) {
+        on_cqe(m_cqes[head & m_cq_mask]);
+        ++head;
+        ++count;
+        // 处理过程中可能又有新的完成事件
+        if (head == tail) {
+            __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+            tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+        }
+    }
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+inline bool io_ring::setup_buffers(unsigned short group, unsigned count, unsigned size)
+{
+    void* buffers = mmap(0, (size_t)count * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED) {
+        return false;
+    }
+    m_buffers = (char*)buffers;
+    m_buffer_size = size;
+    m_buffer_count = count;
+    return register_buffer_ring(group, count);
+}
+
+inline bool io_ring::register_buffer_ring(unsigned short group, unsigned count)
+{
+    m_buf_ring_size = count * sizeof(io_uring_buf);
+    void* ring = mmap(0, m_buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        return false;
+    }
+    m_buf_ring = (io_uring_buf_ring*)ring;
+    m_buf_mask = count - 1;
+    m_buf_tail = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        recycle_buffer(i);
+    }
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        munmap(ring, m_buf_ring_size);
+        m_buf_ring = NULL;
+        return false;
+    }
+    return true;
+}
+
+inline void io_ring::recycle_buffer(unsigned short id)
+{
+    io_uring_buf* buf = (io_uring_buf*)m_buf_ring + (m_buf_tail & m_buf_mask);
+    buf->addr = (uint64_t)(uintptr_t)buffer(id);
+    buf->len = m_buffer_size;
+    buf->bid = id;
+    ++m_buf_tail;
+    // 尾部和第一个缓冲区的 resv 字段重叠，发布之前缓冲区的内容要先写好
+    __atomic_store_n(&m_buf_ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+}
+
+#endif
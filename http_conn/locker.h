@@ -75,7 +75,7 @@ class locker
         // 销毁互斥锁
         ~locker()
         {
-            phtread_mutex_destory(&m_mutex);
+            pthread_mutex_destroy(&m_mutex);
         }
 
         // 获取互斥锁
@@ -107,7 +107,7 @@ class cond
 
             if (pthread_cond_init(&m_cond, NULL) != 0) {
                 // 构造函数中一旦出现问题，就应该立即释放已经成功分配的资源
-                pthread_mutex_destory(&m_mutex);
+                pthread_mutex_destroy(&m_mutex);
                 throw std::exception();
             }
         }
@@ -115,17 +115,17 @@ class cond
         // 销毁条件变量
         ~cond()
         {
-            pthread_mutex_destory(&m_mutex);
-            pthread_cond_destory(&m_cond);
+            pthread_mutex_destroy(&m_mutex);
+            pthread_cond_destroy(&m_cond);
         }
 
         // 等待条件变量
         bool wait()
         {
             int ret = 0;
-            pthread_mutext_lock(&m_mutex);
+            pthread_mutex_lock(&m_mutex);
             ret = pthread_cond_wait(&m_cond, &m_mutex);
-            pthread_mutext_unlock(&m_mutex);
+            pthread_mutex_unlock(&m_mutex);
             return ret == 0;
         }
 
@@ -7,18 +7,23 @@
 #include <string.h>
 #include <fcntl.h>
 #include <stdlib.h>
-#include <cassert.h>
+#include <cassert>
+#include <signal.h>
 #include <sys/epoll.h>
 
+#include <vector>
+
 #include "locker.h"
-#include "threadpool.h"
+#include "work_stealing_pool.h"
 #include "http_conn.h"
+#include "file_cache.h"
+#include "reactor.h"
+#include "uring_reactor.h"
+#include "router.h"
+#include "metrics.h"
+#include "admission.h"
 
-#define MAX_FD 65536
-#define MAX_EVENT_NUMBER 10000
-
-extern int addfd(int epollfd, int fd, bool one_shot);
-extern int removefd(int epollfd, int fd);
+extern const char* doc_root;
 
 void addsig(int sig, void(handler)(int), bool restart = true)
 {
@@ -33,108 +38,158 @@ void addsig(int sig, void(handler)(int), bool restart = true)
     assert(sigaction(sig, &sa, NULL) != -1);
 }
 
-void show_error(int connfd, const char* info)
+// 动态请求的示例：GET /api/hello/:name 返回 "hello, <name>"
+static int hello_route(const route_match& match, std::string& body)
+{
+    body = "hello, ";
+    body.append(match.param("name"));
+    body += '\n';
+    return 200;
+}
+
+// GET /metrics 以 Prometheus 文本格式输出服务器内部的指标
+static int metrics_route(const route_match&, std::string& body)
 {
-    printf("%s", info);
-    send(connfd, info, strlen(info), 0);
-    close(connfd);
+    metrics::instance()->render(body);
+    return 200;
+}
+
+// 创建所有事件循环，第一个在主线程运行，其余的各自一个线程；正常情况下不返回
+template <typename LOOP, typename MAKE>
+static int run_loops(int count, const char* ip, int port, bool pin, MAKE make)
+{
+    std::vector<LOOP*> loops;
+    for (int i = 0; i < count; ++i) {
+        int listenfd = open_listenfd(ip, port, count > 1);
+        assert(listenfd >= 0);
+        loops.push_back(make(listenfd));
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i < count; ++i) {
+        if (!loops[i]->start(pin ? (int)(i % cpus) : -1)) {
+            return 1;
+        }
+    }
+    if (pin) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(0, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    loops[0]->loop();
+    return 0;
+}
+
+void usage(const char* prog)
+{
+    printf("usage: %s [-b backend] [-r reactors] [-t threads] [-c files] [-q ms] [-l conns] [-p] ip_address port_number [doc_root]\n", prog);
+    printf("  -b B  event backend: epoll (default) or uring; uring handles requests on the reactor threads (-t is ignored)\n");
+    printf("        and falls back to epoll when the kernel lacks the io_uring features it needs\n");
+    printf("  -r N  run N reactors with SO_REUSEPORT listeners, each handling its connections end-to-end\n");
+    printf("        (default 1: a single reactor handing requests to the thread pool)\n");
+    printf("  -t N  thread pool size in single-reactor mode (default 8, 0 handles requests on the reactor thread)\n");
+    printf("  -c N  cache up to N open files (default %d, 0 opens the file on every request)\n", file_cache::DEFAULT_MAX_ENTRIES);
+    printf("  -q N  queue time target in ms: when requests keep waiting longer than this in the thread pool,\n");
+    printf("        answer new ones with 503 (default %d, 0 disables)\n", admission::DEFAULT_TARGET_MS);
+    printf("  -l N  allow at most N concurrent connections per client IP (default 0: no limit)\n");
+    printf("  -p    pin reactor/worker threads to CPUs\n");
 }
 
 int main(int argc, char* argv[])
 {
-    if (argc <= 2) {
-        printf("usage: %s ip_address port_number\n", argv[0]);
+    int reactors = 1;
+    int threads = 8;
+    int cached_files = file_cache::DEFAULT_MAX_ENTRIES;
+    int queue_target = admission::DEFAULT_TARGET_MS;
+    int client_limit = 0;
+    bool pin = false;
+    bool uring = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:r:t:c:q:l:p")) != -1) {
+        switch (opt) {
+            case 'b':
+                if (strcmp(optarg, "uring") != 0 && strcmp(optarg, "epoll") != 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                uring = strcmp(optarg, "uring") == 0;
+                break;
+            case 'r': reactors = atoi(optarg); break;
+            case 't': threads = atoi(optarg); break;
+            case 'c': cached_files = atoi(optarg); break;
+            case 'q': queue_target = atoi(optarg); break;
+            case 'l': client_limit = atoi(optarg); break;
+            case 'p': pin = true; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (argc - optind < 2 || reactors <= 0 || threads < 0 || cached_files < 0 || queue_target < 0 || client_limit < 0) {
+        usage(argv[0]);
         return 1;
     }
 
-    const char* ip = argv[1];
-    int port = atoi(argv[2]);
+    const char* ip = argv[optind];
+    int port = atoi(argv[optind + 1]);
+    if (argc - optind > 2) {
+        doc_root = argv[optind + 2];
+    }
 
     // 忽略SIGPIPE信号
     addsig(SIGPIPE, SIG_IGN);
 
-    // 创建线程池
-    threadpool<http_conn>* pool = NULL;
-    try {
-        pool = new threadpool<http_conn>;
-    } catch(...){
-        return 1;
-    }
+    file_cache::instance()->set_max_entries(cached_files);
+    admission::instance()->set_queue_target(queue_target);
+    admission::instance()->set_client_limit(client_limit);
 
-    // 预先为每个可能的客户连接分配一个http_conn对象
-    http_conn* users = new http_conn[MAX_FD];
-    assert(users);
-    int user_count = 0;
-
-    int listenfd = socket(PF_INET, SOCK_STREAM, 0);
-    assert(listenfd >= 0);
-    struct linger tmp = {1, 0};
-    setsocket(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
-
-    int ret = 0;
-    struct sockaddr_in address;
-    bzero(&address, sizeof(address));
-    address.sin_family = AF_INET;
-    inet_pton(AF_INET, ip, &address.sin_addr);
-    address.sin_port = htons(port);
-
-    ret = bind(listenfd, (struct sockaddr*)&address, sizeof(address));
-    assert(ret >= 0);
-
-    ret = listen(listenfd, 5);
-    assert(ret >= 0);
-
-    epoll_event events[MAX_EVENT_NUMBER];
-
-    int epollfd = epoll_create(5);
-    assert(epollfd != -1);
-    addfd(epollfd, listenfd, false);
-    http_conn::m_epollfd = epollfd;
-
-    while (true) {
-        int number = epoll_wait(epollfd, events, MAX_EVENT_NUMBER, -1);
-        if ((number < 0) && (errno != EINTR)) {
-            printf("epoll failure\n");
-            break;
-        }
+    router routes;
+    routes.add(http_conn::GET, "/api/hello/:name", hello_route);
+    routes.add(http_conn::GET, "/metrics", metrics_route);
+    routes.compile();
+    http_conn::set_router(&routes);
 
-        for (int i = 0; i < number; i++) {
-            int sockfd = events[i].data.fd;
-            if (sockfd == listenfd) {
-                struct sockaddr_in client_address;
-                socklen_t client_addrlength = sizeof(client_address);
-                int connfd = accept(listenfd, (struct sockaddr*)&client_address, &client_addrlength);
-
-                if (connfd < 0) {
-                    printf("errno is: %d\n", errno);
-                    continue;
-                }
+    if (uring && !uring_reactor::supported()) {
+        printf("io_uring is not available (%s), falling back to epoll\n", strerror(errno));
+        uring = false;
+    }
 
-                if (http_conn::m_user_count >= MAX_FD) {
-                    show_error(connfd, "Internal server busy");
-                    continue;
-                }
+    // 单 reactor 模式下创建线程池；io_uring 的提交只能在 reactor 线程里做，请求总是在 reactor 线程处理
+    work_stealing_pool<http_conn>* pool = NULL;
+    if (!uring && reactors == 1 && threads > 0) {
+        try {
+            pool = new work_stealing_pool<http_conn>(threads, 10000, pin);
+        } catch(...){
+            return 1;
+        }
+    }
 
-                // 初始化客户连接
-                users[connfd].init(connfd, client_address);
-            } else if (events[i].events & EPOLLIN) {
-                // 根据读的结果，决定是将任务添加到线程池，还是关闭连接
-                if (users[sockfd].read()) {
-                    pool->append(users + sockfd);
-                } else {
-                    users[sockfd].close_conn();
-                }
-            } else if (events[i].events & EPOLLOUT) {
-                // 根据写的结果，决定是否关闭连接
-                if (!users[sockfd].write()) {
-                    users[sockfd].close_conn();
-                }
-            } else {}
+    metrics* stats = metrics::instance();
+    stats->add_gauge("http_connections", "Open client connections.", NULL, [] { return (long)http_conn::m_user_count.load(); });
+    if (pool) {
+        stats->add_gauge("http_pool_queued", "Requests waiting in the thread pool.", NULL, [pool] { return (long)pool->queued(); });
+        stats->add_gauge("http_overloaded", "1 while the thread pool queue is in the overloaded (shedding) state.", NULL,
+                         [] { return (long)admission::instance()->overloaded(); });
+        stats->add_gauge("http_pool_queue_depth", "Requests waiting in each thread pool queue.", "queue=\"injection\"",
+                         [pool] { return (long)pool->injection_queued(); });
+        for (int i = 0; i < pool->thread_number(); ++i) {
+            std::string label = "queue=\"worker" + std::to_string(i) + "\"";
+            stats->add_gauge("http_pool_queue_depth", "Requests waiting in each thread pool queue.", label.c_str(),
+                             [pool, i] { return (long)pool->local_queued(i); });
         }
     }
-    close(epollfd);
-    close(listenfd);
-    delete [] users;
+
+    // 连接表在各个事件循环里，每个事件循环只访问自己 accept 的连接
+    int ret;
+    if (uring) {
+        ret = run_loops<uring_reactor>(reactors, ip, port, pin, [](int listenfd) {
+            return new uring_reactor(listenfd);
+        });
+    } else {
+        ret = run_loops<reactor>(reactors, ip, port, pin, [pool](int listenfd) {
+            return new reactor(listenfd, pool);
+        });
+    }
+
     delete pool;
-    return 0;
-}
\ No newline at end of file
+    return ret;
+}
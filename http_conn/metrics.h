@@ -0,0 +1,302 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "locker.h"
+#include "hdr_histogram.h"
+
+/**
+ * 服务器内部的运行指标，以 Prometheus 文本格式输出
+ * 每个线程第一次记录时创建自己的一组直方图和计数器，之后的记录只改本线程的数据，不加锁、没有原子操作；
+ * 耗时用 rdtsc 读时间戳计数器，记录的是原始的 tick 数，输出时才换算成秒。
+ * 虚拟机里一次 rdtsc 要二十几纳秒，流水线请求每个只要一微秒左右，每个阶段都计时开销太大：
+ * 每个线程的每个阶段每 SAMPLE_EVERY 次只计时一次，按 SAMPLE_EVERY 的权重记进直方图，
+ * 所以直方图的 count 和 sum 是估计值，分布不受影响；计数器是精确的。
+ * 抓取时把所有线程的数据合并：计数器只由所属线程写，x86 上对齐的64位读不会撕裂，读到的是一个近似的快照。
+ * 定义 HTTP_CONN_NO_METRICS 时所有记录都编译成空操作，用来测量开销
+ */
+class metrics
+{
+    public:
+        // 请求处理的各个阶段
+        enum STAGE {
+            STAGE_EPOLL_WAIT = 0,   // reactor 阻塞在 epoll_wait 里(空闲)
+            STAGE_QUEUE,            // 交给线程池到开始处理之间的排队
+            STAGE_READ,             // read() 从 socket 读数据
+            STAGE_PROCESS_READ,     // 解析一个请求，包括 do_request
+            STAGE_DO_REQUEST,       // 查找文件缓存
+            STAGE_PROCESS_WRITE,    // 填充应答
+            STAGE_WRITE,            // write() 往 socket 写应答
+            STAGE_COUNT
+        };
+        enum COUNTER {
+            COUNTER_REQUESTS = 0,
+            COUNTER_ACCEPTS,
+            COUNTER_TIMEOUTS,
+            COUNTER_SHED_QUEUE_TIMEOUT,     // 在线程池里排队太久被拒绝
+            COUNTER_SHED_OVERLOAD,          // 过载时被 reactor 拒绝
+            COUNTER_SHED_POOL_FULL,         // 线程池的队列满了被拒绝
+            COUNTER_SHED_CLIENT_LIMIT,      // 客户端的连接数超过上限被拒绝
+            COUNTER_COUNT
+        };
+
+        // 每个阶段每隔多少次计时一次
+        static const int SAMPLE_EVERY = 64;
+
+        // 记录一个作用域的耗时(被采样时)
+        class scope
+        {
+            public:
+                explicit scope(STAGE stage) : m_stage(stage), m_start(start(stage)) {}
+                ~scope() { finish(m_stage, m_start); }
+
+            private:
+                STAGE m_stage;
+                uint64_t m_start;
+        };
+
+    public:
+        static metrics* instance();
+
+        // 时间戳计数器，不是 x86 时退化为单调时钟的纳秒数
+        static uint64_t ticks();
+        // 这一次要计时时返回开始的时间戳计数器，不计时返回0
+        static uint64_t start(STAGE stage);
+        // start 不为0时记录从 start 到现在的耗时
+        static void finish(STAGE stage, uint64_t start);
+        static void count(COUNTER counter, uint64_t n = 1);
+
+        // 注册一个抓取时取值的仪表，labels 形如 worker="0"，可以为空；同名的仪表要连续注册
+        void add_gauge(const char* name, const char* help, const char* labels, std::function<long()> value);
+
+        // 把所有指标按 Prometheus 文本格式追加到 out
+        void render(std::string& out);
+
+    private:
+        metrics();
+        metrics(const metrics&);
+        metrics& operator=(const metrics&);
+
+        // 一个线程的数据
+        struct thread_data
+        {
+            thread_data()
+            {
+                // 有用户定义的构造函数时 new thread_data() 不会清零成员
+                for (int i = 0; i < COUNTER_COUNT; ++i) {
+                    counters[i] = 0;
+                }
+                for (int i = 0; i < STAGE_COUNT; ++i) {
+                    countdown[i] = 1;
+                }
+            }
+
+            hdr_histogram stages[STAGE_COUNT];
+            uint64_t counters[COUNTER_COUNT];
+            // 各阶段距离下一次计时还差几次
+            int countdown[STAGE_COUNT];
+        };
+
+        struct gauge
+        {
+            std::string name;
+            std::string help;
+            std::string labels;
+            std::function<long()> value;
+        };
+
+        static thread_data* local();
+        thread_data* create_local();
+        // 每纳秒的 tick 数，用启动以来的时间戳计数器和单调时钟的增量计算
+        double ticks_per_ns();
+        static uint64_t monotonic_ns();
+
+        locker m_lock;
+        std::vector<thread_data*> m_threads;
+        std::vector<gauge> m_gauges;
+        uint64_t m_start_ticks;
+        uint64_t m_start_ns;
+
+        static thread_local thread_data* tls_data;
+};
+
+inline thread_local metrics::thread_data* metrics::tls_data = NULL;
+
+inline metrics* metrics::instance()
+{
+    static metrics m;
+    return &m;
+}
+
+inline metrics::metrics() : m_start_ticks(ticks()), m_start_ns(monotonic_ns())
+{
+}
+
+inline uint64_t metrics::monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+inline uint64_t metrics::ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return monotonic_ns();
+#endif
+}
+
+inline metrics::thread_data* metrics::local()
+{
+    thread_data* data = tls_data;
+    if (!data) {
+        data = instance()->create_local();
+    }
+    return data;
+}
+
+// 线程退出之后它的数据仍然保留，已经记录的值不会丢失
+inline metrics::thread_data* metrics::create_local()
+{
+    thread_data* data = new thread_data();
+    m_lock.lock();
+    m_threads.push_back(data);
+    m_lock.unlock();
+    tls_data = data;
+    return data;
+}
+
+inline uint64_t metrics::start(STAGE stage)
+{
+#ifndef HTTP_CONN_NO_METRICS
+    thread_data* data = local();
+    if (--data->countdown[stage] == 0) {
+        data->countdown[stage] = SAMPLE_EVERY;
+        return ticks();
+    }
+#endif
+    return 0;
+}
+
+inline void metrics::finish(STAGE stage, uint64_t start)
+{
+#ifndef HTTP_CONN_NO_METRICS
+    if (start) {
+        local()->stages[stage].record(ticks() - start, SAMPLE_EVERY);
+    }
+#endif
+}
+
+inline void metrics::count(COUNTER counter, uint64_t n)
+{
+#ifndef HTTP_CONN_NO_METRICS
+    local()->counters[counter] += n;
+#endif
+}
+
+inline void metrics::add_gauge(const char* name, const char* help, const char* labels, std::function<long()> value)
+{
+    gauge g;
+    g.name = name;
+    g.help = help;
+    g.labels = labels ? labels : "";
+    g.value = value;
+    m_lock.lock();
+    m_gauges.push_back(g);
+    m_lock.unlock();
+}
+
+inline double metrics::ticks_per_ns()
+{
+    uint64_t elapsed_ns = monotonic_ns() - m_start_ns;
+    uint64_t elapsed_ticks = ticks() - m_start_ticks;
+    return elapsed_ns > 0 && elapsed_ticks > 0 ? (double)elapsed_ticks / elapsed_ns : 1.0;
+}
+
+inline void metrics::render(std::string& out)
+{
+    static const char* stage_names[STAGE_COUNT] = {
+        "epoll_wait", "queue", "read", "process_read", "do_request", "process_write", "write"
+    };
+    static const char* counter_names[COUNTER_COUNT] = {
+        "http_requests_total", "http_accepted_connections_total", "http_timeouts_total",
+        "http_shed_queue_timeout_total", "http_shed_overload_total", "http_shed_pool_full_total",
+        "http_shed_client_limit_total"
+    };
+    static const char* counter_helps[COUNTER_COUNT] = {
+        "Requests answered.", "Connections accepted.", "Connections closed by a timeout.",
+        "Requests answered with 503 after waiting too long in the thread pool queue.",
+        "Requests answered with 503 by the reactor while the queue is overloaded.",
+        "Requests answered with 503 by the reactor because the thread pool queue was full.",
+        "Connections rejected with 503 by the per-client connection limit."
+    };
+    // 直方图的桶边界(秒)
+    static const double bounds[] = {
+        1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3,
+        1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+    };
+
+    // 合并的直方图很大，放在堆上，只在抓取时分配
+    std::vector<hdr_histogram> stages(STAGE_COUNT);
+    uint64_t counters[COUNTER_COUNT] = {0};
+    m_lock.lock();
+    for (size_t t = 0; t < m_threads.size(); ++t) {
+        for (int i = 0; i < STAGE_COUNT; ++i) {
+            stages[i].add(m_threads[t]->stages[i]);
+        }
+        for (int i = 0; i < COUNTER_COUNT; ++i) {
+            counters[i] += m_threads[t]->counters[i];
+        }
+    }
+    std::vector<gauge> gauges = m_gauges;
+    m_lock.unlock();
+
+    double tick_seconds = 1e-9 / ticks_per_ns();
+    char line[256];
+    out += "# HELP http_stage_seconds Time spent in each request processing stage.\n";
+    out += "# TYPE http_stage_seconds histogram\n";
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+        const hdr_histogram& h = stages[i];
+        for (size_t b = 0; b < sizeof(bounds) / sizeof(bounds[0]); ++b) {
+            snprintf(line, sizeof(line), "http_stage_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n", stage_names[i],
+                     bounds[b], (unsigned long long)h.count_at_or_below((uint64_t)(bounds[b] / tick_seconds)));
+            out += line;
+        }
+        snprintf(line, sizeof(line), "http_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n"
+                 "http_stage_seconds_sum{stage=\"%s\"} %.9f\nhttp_stage_seconds_count{stage=\"%s\"} %llu\n",
+                 stage_names[i], (unsigned long long)h.count(), stage_names[i], h.sum() * tick_seconds,
+                 stage_names[i], (unsigned long long)h.count());
+        out += line;
+    }
+
+    for (int i = 0; i < COUNTER_COUNT; ++i) {
+        snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", counter_names[i], counter_helps[i],
+                 counter_names[i], counter_names[i], (unsigned long long)counters[i]);
+        out += line;
+    }
+
+    // 同名的仪表只输出一次 HELP/TYPE
+    for (size_t i = 0; i < gauges.size(); ++i) {
+        const gauge& g = gauges[i];
+        if (i == 0 || gauges[i - 1].name != g.name) {
+            out += "# HELP " + g.name + " " + g.help + "\n# TYPE " + g.name + " gauge\n";
+        }
+        snprintf(line, sizeof(line), "%s%s%s%s %ld\n", g.name.c_str(), g.labels.empty() ? "" : "{",
+                 g.labels.c_str(), g.labels.empty() ? "" : "}", g.value());
+        out += line;
+    }
+}
+
+#endif
@@ -0,0 +1,221 @@
+#include "reactor.h"
+
+extern void addfd(int epollfd, int fd, bool one_shot);
+
+void show_error(int connfd, const char* info)
+{
+    printf("%s", info);
+    send(connfd, info, strlen(info), 0);
+    close(connfd);
+}
+
+int open_listenfd(const char* ip, int port, bool reuse_port)
+{
+    int listenfd = socket(PF_INET, SOCK_STREAM, 0);
+    if (listenfd < 0) {
+        return -1;
+    }
+
+    // 不设置 SO_LINGER{1, 0}：连接会继承这个选项，close 时发送 RST 并丢弃发送缓冲区里
+    // 还没发出去的应答，Connection: close 的流水线请求会收不到完整的最后一个应答
+    int on = 1;
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (reuse_port) {
+        setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    }
+
+    struct sockaddr_in address;
+    bzero(&address, sizeof(address));
+    address.sin_family = AF_INET;
+    inet_pton(AF_INET, ip, &address.sin_addr);
+    address.sin_port = htons(port);
+
+    if (bind(listenfd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listenfd, 1024) < 0) {
+        close(listenfd);
+        return -1;
+    }
+    return listenfd;
+}
+
+reactor::reactor(int listenfd, work_stealing_pool<http_conn>* pool)
+    : m_epollfd(-1), m_listenfd(listenfd), m_users(MAX_FD), m_pool(pool), m_thread(0), m_now(0)
+{
+    m_epollfd = epoll_create(5);
+    if (m_epollfd == -1) {
+        throw std::exception();
+    }
+    addfd(m_epollfd, m_listenfd, false);
+}
+
+reactor::~reactor()
+{
+    for (size_t i = 0; i < m_users.size(); ++i) {
+        delete m_users[i];
+    }
+    close(m_epollfd);
+}
+
+bool reactor::start(int cpu)
+{
+    if (pthread_create(&m_thread, NULL, thread_entry, this) != 0) {
+        return false;
+    }
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(m_thread, sizeof(set), &set);
+    }
+    return true;
+}
+
+void* reactor::thread_entry(void* arg)
+{
+    reactor* self = (reactor*)arg;
+    self->loop();
+    return self;
+}
+
+void reactor::loop()
+{
+    epoll_event events[MAX_EVENT_NUMBER];
+    while (true) {
+        uint64_t wait_start = metrics::start(metrics::STAGE_EPOLL_WAIT);
+        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, m_timers.next_timeout(timer_wheel::now_ms()));
+        metrics::finish(metrics::STAGE_EPOLL_WAIT, wait_start);
+        if ((number < 0) && (errno != EINTR)) {
+            printf("epoll failure\n");
+            break;
+        }
+
+        m_now = timer_wheel::now_ms();
+        m_timers.expire(m_now, [this](timer_wheel::node* timer) { on_timeout(timer); });
+        for (int i = 0; i < number; i++) {
+            if (events[i].data.fd == m_listenfd) {
+                handle_accept();
+            } else {
+                handle_event(events[i]);
+            }
+        }
+    }
+}
+
+void reactor::handle_accept()
+{
+    while (true) {
+        struct sockaddr_in client_address;
+        socklen_t client_addrlength = sizeof(client_address);
+        int connfd = accept(m_listenfd, (struct sockaddr*)&client_address, &client_addrlength);
+
+        if (connfd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                printf("errno is: %d\n", errno);
+            }
+            break;
+        }
+
+        if (connfd >= MAX_FD || http_conn::m_user_count >= MAX_FD) {
+            show_error(connfd, "Internal server busy");
+            continue;
+        }
+        // 这个客户端打开的连接太多
+        if (!admission::instance()->acquire_client(client_address)) {
+            admission::reject(connfd);
+            close(connfd);
+            metrics::count(metrics::COUNTER_SHED_CLIENT_LIMIT);
+            continue;
+        }
+
+        // 初始化客户连接
+        if (!m_users[connfd]) {
+            m_users[connfd] = new http_conn;
+        }
+        m_users[connfd]->init(connfd, client_address, m_epollfd);
+        metrics::count(metrics::COUNTER_ACCEPTS);
+        refresh_timer(m_users[connfd]);
+    }
+}
+
+void reactor::dispatch(http_conn* conn)
+{
+    if (!m_pool) {
+        conn->process();
+    } else {
+        // 过载时新请求不进队列，在 reactor 里当场拒绝，不占用工作线程
+        admission* gate = admission::instance();
+        if (gate->overloaded() && !gate->admit(m_pool->queued())) {
+            shed(conn, metrics::COUNTER_SHED_OVERLOAD);
+            return;
+        }
+        // 状态要在交出去之前看：交给线程池之后这个连接就不归 reactor 线程访问了
+        refresh_timer(conn);
+        conn->set_busy();
+        if (!m_pool->append(conn)) {
+            conn->cancel_busy();
+            shed(conn, metrics::COUNTER_SHED_POOL_FULL);
+        }
+    }
+}
+
+void reactor::shed(http_conn* conn, metrics::COUNTER reason)
+{
+    metrics::count(reason, conn->shed());
+    refresh_timer(conn);
+}
+
+void reactor::refresh_timer(http_conn* conn)
+{
+    http_conn::TIMER_PHASE phase = conn->timer_phase();
+    if (phase == http_conn::PHASE_NONE) {
+        m_timers.cancel(conn->timer());
+    } else if (phase != http_conn::PHASE_HEADER || conn->scheduled_phase() != http_conn::PHASE_HEADER || !conn->timer()->linked()) {
+        // 请求头阶段的截止时间从请求开始算，中途收到数据不延长；其他阶段每次有进展都重新计时
+        m_timers.schedule(conn->timer(), m_now, http_conn::phase_timeout(phase));
+    }
+    conn->set_scheduled_phase(phase);
+}
+
+void reactor::on_timeout(timer_wheel::node* timer)
+{
+    http_conn* conn = (http_conn*)timer->data;
+    if (conn->busy()) {
+        // 线程池正在处理，处理完会产生新的事件，到时再按新状态计时
+        m_timers.schedule(timer, m_now, http_conn::phase_timeout(conn->scheduled_phase()));
+        return;
+    }
+    if (!conn->closed()) {
+        metrics::count(metrics::COUNTER_TIMEOUTS);
+        conn->close_conn();
+    }
+    conn->set_scheduled_phase(http_conn::PHASE_NONE);
+}
+
+void reactor::handle_event(const epoll_event& event)
+{
+    http_conn* conn = m_users[event.data.fd];
+    if (event.events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        // 如果有异常，直接关闭客户连接
+        conn->close_conn();
+    } else if (event.events & EPOLLIN) {
+        // 根据读的结果，决定是将任务添加到线程池(或者直接处理)，还是关闭连接
+        if (!conn->read()) {
+            conn->close_conn();
+        } else {
+            dispatch(conn);
+            if (m_pool) {
+                return;
+            }
+        }
+    } else if (event.events & EPOLLOUT) {
+        // 根据写的结果，决定是否关闭连接；读缓冲区里还有流水线请求时继续处理
+        if (!conn->write()) {
+            conn->close_conn();
+        } else if (conn->has_pending_input()) {
+            dispatch(conn);
+            if (m_pool) {
+                return;
+            }
+        }
+    }
+    refresh_timer(conn);
+}
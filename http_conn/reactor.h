@@ -0,0 +1,67 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <sys/epoll.h>
+
+#include <vector>
+
+#include "http_conn.h"
+#include "work_stealing_pool.h"
+#include "timer_wheel.h"
+
+#define MAX_FD 65536
+#define MAX_EVENT_NUMBER 10000
+
+/**
+ * 一个 epoll 事件循环，负责 accept 以及所管理连接上的读写
+ * pool 不为NULL时，读完数据后把请求交给线程池解析(单 reactor + 线程池)；
+ * pool 为NULL时，在本线程直接解析并填充应答，连接从 accept 到关闭都只由这一个线程处理(多 reactor 模式)
+ * 多 reactor 模式下每个 reactor 有一个自己的 SO_REUSEPORT 监听socket，由内核把新连接分散到各个 reactor
+ * 每个 reactor 用一个时间轮管理自己的连接的超时：等请求头、等消息体、发送应答、keep-alive 空闲，
+ * 到期的连接被关闭，epoll_wait 的超时时间取到下一个 tick 为止
+ */
+class reactor
+{
+    public:
+        reactor(int listenfd, work_stealing_pool<http_conn>* pool);
+        ~reactor();
+
+        // 运行事件循环，不会返回
+        void loop();
+
+        // 在新线程中运行事件循环，cpu 不小于0时把线程绑定到该CPU上
+        bool start(int cpu = -1);
+
+    private:
+        reactor(const reactor&);
+        reactor& operator=(const reactor&);
+
+        static void* thread_entry(void* arg);
+        // 监听socket是边缘触发的，一次事件要把已完成的连接全部accept出来
+        void handle_accept();
+        void handle_event(const epoll_event& event);
+        // 交给线程池或者在本线程处理请求
+        void dispatch(http_conn* conn);
+        // 过载时在本线程解析连接上的请求，每个都回 503，不交给线程池
+        void shed(http_conn* conn, metrics::COUNTER reason);
+        // 处理完一个事件之后，按连接的新状态设置定时器
+        void refresh_timer(http_conn* conn);
+        void on_timeout(timer_wheel::node* timer);
+
+        int m_epollfd;
+        int m_listenfd;
+        // 以文件描述符为下标的连接表，每个 reactor 一个，第一次用到某个描述符时才分配http_conn对象，之后复用
+        // 不能在 reactor 之间共享：一个连接 close 之后，它的描述符号马上可能被另一个 reactor accept 到，
+        // 而这边还在拆除这个连接、取消它的定时器
+        std::vector<http_conn*> m_users;
+        work_stealing_pool<http_conn>* m_pool;
+        pthread_t m_thread;
+        timer_wheel m_timers;
+        // 本轮事件循环开始时的时间
+        long m_now;
+};
+
+// 创建一个非阻塞的监听socket，reuse_port 为 true 时允许多个socket绑定同一个端口；失败时返回-1
+int open_listenfd(const char* ip, int port, bool reuse_port);
+
+#endif
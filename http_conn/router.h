@@ -0,0 +1,385 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class body_handler;
+// 为一个 POST 请求创建消息体处理器，content_length 为 -1 表示分块传输、长度未知；返回NULL时应答403
+typedef body_handler* (*body_handler_factory)(const char* url, long content_length);
+
+// 一次路由查找的结果，路径参数以视图的形式指向被查找的路径，不拷贝
+struct route_match
+{
+    static const int MAX_PARAMS = 8;
+
+    route_match() : route(NULL), param_count(0) {}
+
+    // 参数名对应的值，没有时返回空
+    std::string_view param(std::string_view name) const
+    {
+        for (int i = 0; i < param_count; ++i) {
+            if (names[i] == name) {
+                return values[i];
+            }
+        }
+        return std::string_view();
+    }
+
+    const struct route* route;
+    int param_count;
+    std::string_view names[MAX_PARAMS];
+    std::string_view values[MAX_PARAMS];
+};
+
+// 动态请求的处理函数：把应答的消息体写入 body，返回状态码
+typedef int (*route_handler)(const route_match& match, std::string& body);
+
+struct route
+{
+    std::string pattern;
+    route_handler handler;
+    // POST 请求的消息体处理器，为NULL时使用全局的
+    body_handler_factory factory;
+};
+
+/**
+ * 按请求方法和路径模式分发动态请求
+ * 模式由 '/' 分隔，":name" 匹配一段非空的路径并作为参数，"*name" 只能出现在末尾，匹配剩下的全部路径(可以为空)。
+ * 所有模式编译成一棵基数树(radix trie)：静态部分按公共前缀合并，每个节点最多一个参数子节点和一个通配子节点。
+ * 注册完之后调用 compile()，把树按深度优先的顺序压平到几个连续的数组里：节点、前缀和子节点索引字符、
+ * 子节点编号、各请求方法的路由，查找时只访问这几个数组。
+ * 查找时沿着路径走，优先匹配静态子节点，其次参数，最后通配，走不通时回溯；耗时与路径长度成正比，
+ * 与路由数量基本无关，并且不分配内存。
+ * 路由在启动时注册、编译，之后只读，多个线程可以同时查找
+ */
+class router
+{
+    public:
+        // 与 http_conn::METHOD 的取值一致
+        static const int METHOD_COUNT = 9;
+
+    public:
+        router() : m_root(new node) {}
+        ~router();
+
+        // 注册路由，模式不合法或者与已有的路由冲突时返回 false
+        bool add(int method, const char* pattern, route_handler handler, body_handler_factory factory = NULL);
+        // 把注册的路由编译成查找用的数组，注册完所有路由之后调用
+        void compile();
+        // 查找路由，找到时填充 match 并返回 true；没有编译过的路由不参与查找
+        bool find(int method, std::string_view path, route_match* match) const;
+
+        size_t size() const { return m_routes.size(); }
+
+    private:
+        router(const router&);
+        router& operator=(const router&);
+
+        struct node
+        {
+            node() : param_child(NULL), wildcard_child(NULL)
+            {
+                for (int i = 0; i < METHOD_COUNT; ++i) {
+                    routes[i] = NULL;
+                }
+            }
+            ~node();
+
+            // 静态前缀
+            std::string prefix;
+            // 静态子节点，indices[i] 是 children[i] 前缀的第一个字符
+            std::string indices;
+            std::vector<node*> children;
+            // 参数子节点和它的参数名
+            node* param_child;
+            std::string param_name;
+            // 通配子节点，它的 routes 就是通配路由
+            node* wildcard_child;
+            std::string wildcard_name;
+            const route* routes[METHOD_COUNT];
+        };
+
+        // 编译之后的节点，字符串都是 m_bytes 中的偏移
+        struct compiled_node
+        {
+            uint32_t prefix;
+            uint16_t prefix_len;
+            // 静态子节点的个数，它们的首字符从 m_bytes[indices] 开始，编号从 m_child_ids[children] 开始
+            uint16_t child_count;
+            uint32_t indices;
+            uint32_t children;
+            // 参数子节点和通配子节点的编号，-1 表示没有
+            int32_t param_child;
+            int32_t wildcard_child;
+            uint32_t param_name;
+            uint16_t param_name_len;
+            uint16_t wildcard_name_len;
+            uint32_t wildcard_name;
+            // 这个节点上各请求方法的路由从 m_targets[targets] 开始，-1 表示没有
+            int32_t targets;
+        };
+
+        bool insert(node* n, std::string_view pattern, int method, const route* r);
+        int32_t flatten(const node* n);
+        uint32_t store(const std::string& bytes);
+        bool walk(int32_t id, std::string_view path, int method, route_match* match) const;
+
+        node* m_root;
+        std::vector<route*> m_routes;
+
+        std::vector<compiled_node> m_nodes;
+        std::string m_bytes;
+        std::vector<int32_t> m_child_ids;
+        std::vector<const route*> m_targets;
+};
+
+inline router::node::~node()
+{
+    for (size_t i = 0; i < children.size(); ++i) {
+        delete children[i];
+    }
+    delete param_child;
+    delete wildcard_child;
+}
+
+inline router::~router()
+{
+    delete m_root;
+    for (size_t i = 0; i < m_routes.size(); ++i) {
+        delete m_routes[i];
+    }
+}
+
+inline bool router::add(int method, const char* pattern, route_handler handler, body_handler_factory factory)
+{
+    if (method < 0 || method >= METHOD_COUNT || !pattern || pattern[0] != '/' || !handler) {
+        return false;
+    }
+
+    route* r = new route;
+    r->pattern = pattern;
+    r->handler = handler;
+    r->factory = factory;
+    if (!insert(m_root, r->pattern, method, r)) {
+        delete r;
+        return false;
+    }
+    m_routes.push_back(r);
+    return true;
+}
+
+// n 的前缀已经匹配，把 pattern 的剩余部分挂到 n 下面
+inline bool router::insert(node* n, std::string_view pattern, int method, const route* r)
+{
+    if (pattern.empty()) {
+        if (n->routes[method]) {
+            return false;
+        }
+        n->routes[method] = r;
+        return true;
+    }
+
+    if (pattern[0] == ':' || pattern[0] == '*') {
+        // 参数和通配符只能占据一整段
+        size_t end = pattern.find('/');
+        std::string_view name = pattern.substr(1, end == std::string_view::npos ? std::string_view::npos : end - 1);
+        if (name.empty() || name.find_first_of(":*") != std::string_view::npos) {
+            return false;
+        }
+
+        if (pattern[0] == '*') {
+            if (end != std::string_view::npos) {
+                return false;
+            }
+            if (!n->wildcard_child) {
+                n->wildcard_child = new node;
+                n->wildcard_name = name;
+            } else if (n->wildcard_name != name) {
+                return false;
+            }
+            return insert(n->wildcard_child, std::string_view(), method, r);
+        }
+
+        if (!n->param_child) {
+            n->param_child = new node;
+            n->param_name = name;
+        } else if (n->param_name != name) {
+            // 同一个位置的参数必须同名，否则查找结果有歧义
+            return false;
+        }
+        return insert(n->param_child, pattern.substr(1 + name.size()), method, r);
+    }
+
+    // 静态部分一直到下一个参数或者通配符
+    size_t run_len = pattern.find_first_of(":*");
+    if (run_len == std::string_view::npos) {
+        run_len = pattern.size();
+    }
+    if (run_len < pattern.size() && pattern[run_len - 1] != '/') {
+        return false;
+    }
+    std::string_view run = pattern.substr(0, run_len);
+
+    size_t index = n->indices.find(run[0]);
+    if (index == std::string::npos) {
+        node* child = new node;
+        child->prefix = run;
+        n->indices.push_back(run[0]);
+        n->children.push_back(child);
+        return insert(child, pattern.substr(run_len), method, r);
+    }
+
+    node* child = n->children[index];
+    size_t common = 0;
+    while (common < run.size() && common < child->prefix.size() && run[common] == child->prefix[common]) {
+        ++common;
+    }
+    if (common < child->prefix.size()) {
+        // 只有前面一部分相同，把子节点从公共前缀处劈开
+        node* mid = new node;
+        mid->prefix = child->prefix.substr(0, common);
+        child->prefix.erase(0, common);
+        mid->indices.push_back(child->prefix[0]);
+        mid->children.push_back(child);
+        n->children[index] = mid;
+        child = mid;
+    }
+    return insert(child, pattern.substr(common), method, r);
+}
+
+inline void router::compile()
+{
+    m_nodes.clear();
+    m_bytes.clear();
+    m_child_ids.clear();
+    m_targets.clear();
+    flatten(m_root);
+}
+
+inline uint32_t router::store(const std::string& bytes)
+{
+    uint32_t offset = m_bytes.size();
+    m_bytes += bytes;
+    return offset;
+}
+
+// 按深度优先的顺序编号，父节点和它最先被访问的子节点挨在一起
+inline int32_t router::flatten(const node* n)
+{
+    int32_t id = m_nodes.size();
+    m_nodes.push_back(compiled_node());
+    compiled_node c;
+    c.prefix = store(n->prefix);
+    c.prefix_len = n->prefix.size();
+    c.child_count = n->children.size();
+    c.indices = store(n->indices);
+    c.param_name = store(n->param_name);
+    c.param_name_len = n->param_name.size();
+    c.wildcard_name = store(n->wildcard_name);
+    c.wildcard_name_len = n->wildcard_name.size();
+
+    c.targets = -1;
+    for (int i = 0; i < METHOD_COUNT; ++i) {
+        if (n->routes[i]) {
+            c.targets = m_targets.size();
+            m_targets.insert(m_targets.end(), n->routes, n->routes + METHOD_COUNT);
+            break;
+        }
+    }
+
+    // 子节点的编号先占好位置，递归编译之后再填
+    c.children = m_child_ids.size();
+    m_child_ids.resize(m_child_ids.size() + n->children.size());
+    for (size_t i = 0; i < n->children.size(); ++i) {
+        int32_t child = flatten(n->children[i]);
+        m_child_ids[c.children + i] = child;
+    }
+    c.param_child = n->param_child ? flatten(n->param_child) : -1;
+    c.wildcard_child = n->wildcard_child ? flatten(n->wildcard_child) : -1;
+
+    m_nodes[id] = c;
+    return id;
+}
+
+inline bool router::find(int method, std::string_view path, route_match* match) const
+{
+    if (method < 0 || method >= METHOD_COUNT || m_nodes.empty()) {
+        return false;
+    }
+    match->route = NULL;
+    match->param_count = 0;
+    return walk(0, path, method, match);
+}
+
+// 从节点 id 开始匹配 path，节点的前缀还没有比较
+// 只有静态子节点的节点不需要回溯，直接在循环里往下走；有参数或者通配子节点时才递归
+inline bool router::walk(int32_t id, std::string_view path, int method, route_match* match) const
+{
+    const char* bytes = m_bytes.data();
+    while (true) {
+        const compiled_node& n = m_nodes[id];
+        if (path.size() < n.prefix_len || memcmp(path.data(), bytes + n.prefix, n.prefix_len) != 0) {
+            return false;
+        }
+        path.remove_prefix(n.prefix_len);
+
+        if (path.empty()) {
+            if (n.targets >= 0 && m_targets[n.targets + method]) {
+                match->route = m_targets[n.targets + method];
+                return true;
+            }
+        } else {
+            // 子节点通常很少，逐个比较首字符比调用 memchr 快
+            const char* indices = bytes + n.indices;
+            int child = -1;
+            for (int i = 0; i < n.child_count; ++i) {
+                if (indices[i] == path[0]) {
+                    child = m_child_ids[n.children + i];
+                    break;
+                }
+            }
+            if (child >= 0) {
+                if (n.param_child < 0 && n.wildcard_child < 0) {
+                    id = child;
+                    continue;
+                }
+                if (walk(child, path, method, match)) {
+                    return true;
+                }
+            }
+
+            if (n.param_child >= 0 && match->param_count < route_match::MAX_PARAMS) {
+                const char* end = (const char*)memchr(path.data(), '/', path.size());
+                std::string_view value = path.substr(0, end ? end - path.data() : path.size());
+                if (!value.empty()) {
+                    int slot = match->param_count++;
+                    match->names[slot] = std::string_view(bytes + n.param_name, n.param_name_len);
+                    match->values[slot] = value;
+                    if (walk(n.param_child, path.substr(value.size()), method, match)) {
+                        return true;
+                    }
+                    match->param_count = slot;
+                }
+            }
+        }
+
+        if (n.wildcard_child >= 0 && match->param_count < route_match::MAX_PARAMS) {
+            const compiled_node& w = m_nodes[n.wildcard_child];
+            if (w.targets >= 0 && m_targets[w.targets + method]) {
+                int slot = match->param_count++;
+                match->names[slot] = std::string_view(bytes + n.wildcard_name, n.wildcard_name_len);
+                match->values[slot] = path;
+                match->route = m_targets[w.targets + method];
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+#endif
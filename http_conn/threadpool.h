@@ -7,7 +7,7 @@
 #include <pthread.h>
 
 // 同步机制包装类
-#include "demo_locker_1.h"
+#include "locker.h"
 
 // 线程池类，将它定义为模板类是为了代码复用
 template<typename T>
@@ -36,7 +36,7 @@ class threadpool
 };
 
 template<typename T>
-threadpool<T>::threadpool(int thread_number, int max_requests): m_thread_number(thread_number), m_max_requests(max_requests), m_stop(false), m_threads(NULL) {
+threadpool<T>::threadpool(int thread_number, int max_requests): m_thread_number(thread_number), m_max_requests(max_requests), m_threads(NULL), m_stop(false) {
     if ((thread_number <= 0) || (max_requests <= 0)) {
         throw std::exception();
     }
@@ -71,14 +71,14 @@ template<typename T>
 bool threadpool<T>::append(T* request) {
     // 操作工作队列时一定要加锁，因为它被所有线程共享
     m_queuelocker.lock();
-    if (m_workqueue.size() > m_max_requests) {
+    if (m_workqueue.size() > (size_t)m_max_requests) {
         m_queuelocker.unlock();
         return false;
     }
 
     m_workqueue.push_back(request);
     m_queuelocker.unlock();
-    m_workqueue.post();
+    m_queuestat.post();
     return true;
 }
 
@@ -0,0 +1,178 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <time.h>
+#include <exception>
+
+/**
+ * 哈希时间轮，每个 reactor 一个，只在 reactor 线程中使用，不加锁
+ * 时间按 tick 离散化，到期 tick 为 t 的定时器挂在第 t % 槽数 个槽的双向链表上；
+ * 超过一圈的定时器和同一圈的定时器挂在同一个槽里，推进时只触发到期 tick 不晚于当前时间的那些。
+ * 定时器节点嵌在使用者的对象里(侵入式)，添加、取消、重新设置都是 O(1)，不分配内存
+ */
+class timer_wheel
+{
+    public:
+        struct node
+        {
+            node() : prev(NULL), next(NULL), expire(0), data(NULL) {}
+
+            bool linked() const { return prev != NULL; }
+
+            node* prev;
+            node* next;
+            // 到期的 tick
+            long expire;
+            // 使用者的对象
+            void* data;
+        };
+
+    public:
+        // slots 向上取整为2的幂
+        timer_wheel(int tick_ms = 100, int slots = 512);
+        ~timer_wheel();
+
+        // 单调时钟的毫秒数
+        static long now_ms();
+
+        // 设置(或者重新设置) timeout_ms 毫秒之后到期的定时器
+        void schedule(node* n, long now_ms, long timeout_ms);
+        void cancel(node* n);
+        size_t size() const { return m_size; }
+
+        // 触发所有已经到期的定时器，on_expire(node*) 调用前节点已经摘下，可以在回调里重新 schedule 这个节点
+        // (最早在 now_ms 之后的下一个 tick 到期，不会在这一次 expire 里再次触发)，但不能 cancel 其他节点。
+        // 返回触发的个数
+        template <typename F>
+        int expire(long now_ms, F on_expire);
+
+        // 距离下一个 tick 的毫秒数，作为 epoll_wait 的超时时间；没有定时器时返回 -1
+        int next_timeout(long now_ms) const;
+
+    private:
+        timer_wheel(const timer_wheel&);
+        timer_wheel& operator=(const timer_wheel&);
+
+        static void unlink(node* n);
+
+        int m_tick_ms;
+        long m_mask;
+        // 每个槽是一个带哨兵的循环链表
+        node* m_slots;
+        // 已经处理过的最后一个 tick
+        long m_current;
+        size_t m_size;
+};
+
+inline timer_wheel::timer_wheel(int tick_ms, int slots)
+    : m_tick_ms(tick_ms), m_mask(0), m_slots(NULL), m_current(0), m_size(0)
+{
+    if (tick_ms <= 0 || slots <= 0) {
+        throw std::exception();
+    }
+    long count = 1;
+    while (count < slots) {
+        count <<= 1;
+    }
+    m_mask = count - 1;
+    m_slots = new node[count];
+    for (long i = 0; i < count; ++i) {
+        m_slots[i].prev = m_slots[i].next = &m_slots[i];
+    }
+    m_current = now_ms() / m_tick_ms;
+}
+
+inline timer_wheel::~timer_wheel()
+{
+    delete [] m_slots;
+}
+
+inline long timer_wheel::now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+inline void timer_wheel::unlink(node* n)
+{
+    n->prev->next = n->next;
+    n->next->prev = n->prev;
+    n->prev = n->next = NULL;
+}
+
+inline void timer_wheel::schedule(node* n, long now_ms, long timeout_ms)
+{
+    if (n->linked()) {
+        unlink(n);
+    } else {
+        ++m_size;
+    }
+
+    // 向上取整，保证不会早于 timeout_ms 到期；已经处理过的 tick 不会再被扫描
+    n->expire = (now_ms + timeout_ms + m_tick_ms - 1) / m_tick_ms;
+    if (n->expire <= m_current) {
+        n->expire = m_current + 1;
+    }
+
+    // 插在哨兵之后，expire() 遍历时不会再遇到刚插入的节点
+    node* head = &m_slots[n->expire & m_mask];
+    n->prev = head;
+    n->next = head->next;
+    head->next->prev = n;
+    head->next = n;
+}
+
+inline void timer_wheel::cancel(node* n)
+{
+    if (n->linked()) {
+        unlink(n);
+        --m_size;
+    }
+}
+
+template <typename F>
+int timer_wheel::expire(long now_ms, F on_expire)
+{
+    long now = now_ms / m_tick_ms;
+    long tick = m_current + 1;
+    // 落后超过一圈时每个槽只需要扫一遍
+    if (now - tick > m_mask) {
+        tick = now - m_mask;
+    }
+
+    // 扫描之前先推进 m_current：回调里重新 schedule 的节点至少排到 now + 1，
+    // 否则可能落在这一次还没扫到的 tick 上，同一次 expire 里被触发两次
+    if (now > m_current) {
+        m_current = now;
+    }
+
+    int fired = 0;
+    for (; tick <= now; ++tick) {
+        node* head = &m_slots[tick & m_mask];
+        node* n = head->next;
+        while (n != head) {
+            node* next = n->next;
+            if (n->expire <= now) {
+                unlink(n);
+                --m_size;
+                ++fired;
+                on_expire(n);
+            }
+            n = next;
+        }
+    }
+    return fired;
+}
+
+inline int timer_wheel::next_timeout(long now_ms) const
+{
+    if (m_size == 0) {
+        return -1;
+    }
+    long next = (m_current + 1) * m_tick_ms - now_ms;
+    return next > 0 ? (int)next : 0;
+}
+
+#endif
@@ -0,0 +1,385 @@
+#include <poll.h>
+
+#include "uring_reactor.h"
+
+extern int setnonblocking(int fd);
+extern void show_error(int connfd, const char* info);
+
+bool uring_reactor::supported()
+{
+    io_ring ring;
+    return ring.init(RING_ENTRIES) && ring.setup_buffers(0, BUFFER_COUNT, BUFFER_SIZE);
+}
+
+uring_reactor::uring_reactor(int listenfd)
+    : m_listenfd(listenfd), m_users(MAX_FD), m_states(MAX_FD), m_thread(0), m_now(0)
+{
+    setnonblocking(m_listenfd);
+}
+
+uring_reactor::~uring_reactor()
+{
+    for (size_t i = 0; i < m_states.size(); ++i) {
+        delete m_users[i];
+        delete m_states[i];
+    }
+}
+
+bool uring_reactor::start(int cpu)
+{
+    if (pthread_create(&m_thread, NULL, thread_entry, this) != 0) {
+        return false;
+    }
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(m_thread, sizeof(set), &set);
+    }
+    return true;
+}
+
+void* uring_reactor::thread_entry(void* arg)
+{
+    uring_reactor* self = (uring_reactor*)arg;
+    self->loop();
+    return self;
+}
+
+uint64_t uring_reactor::user_data(const conn_state* st, int fd, OP op)
+{
+    return ((uint64_t)(st ? st->gen : 0) << 32) | ((uint64_t)fd << 8) | op;
+}
+
+void uring_reactor::loop()
+{
+    // IORING_SETUP_SINGLE_ISSUER 要求创建 io_uring 的线程就是提交请求的线程，所以在这里创建
+    if (!m_ring.init(RING_ENTRIES) || !m_ring.setup_buffers(0, BUFFER_COUNT, BUFFER_SIZE)) {
+        printf("io_uring setup failure: %s\n", strerror(errno));
+        return;
+    }
+    arm_accept();
+    while (true) {
+        // 上一轮产生的提交(新挂的 recv、应答的 sendmsg、取消)和这一轮的等待是同一次系统调用
+        uint64_t wait_start = metrics::start(metrics::STAGE_EPOLL_WAIT);
+        int ret = m_ring.submit_and_wait(1, m_timers.next_timeout(timer_wheel::now_ms()));
+        metrics::finish(metrics::STAGE_EPOLL_WAIT, wait_start);
+        if (ret < 0 && ret != -EINTR && ret != -EBUSY) {
+            printf("io_uring failure: %s\n", strerror(-ret));
+            break;
+        }
+
+        m_now = timer_wheel::now_ms();
+        m_timers.expire(m_now, [this](timer_wheel::node* timer) { on_timeout(timer); });
+        m_ring.for_each_cqe([this](const io_uring_cqe& cqe) { handle_cqe(cqe); });
+    }
+}
+
+void uring_reactor::handle_cqe(const io_uring_cqe& cqe)
+{
+    OP op = (OP)(cqe.user_data & 0xff);
+    int fd = (int)((cqe.user_data >> 8) & 0xffffff);
+    if (op == OP_ACCEPT) {
+        handle_accept(cqe);
+        return;
+    }
+    if (op == OP_CANCEL) {
+        return;
+    }
+
+    conn_state* st = m_states[fd];
+    if (!st || st->gen != (uint32_t)(cqe.user_data >> 32)) {
+        // 已经关闭的连接迟到的完成事件，收到的数据丢掉，缓冲区还回去
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            m_ring.recycle_buffer(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+        return;
+    }
+    if (op == OP_RECV) {
+        handle_recv(fd, cqe);
+    } else if (op == OP_SEND) {
+        handle_send(fd, cqe);
+    } else if (op == OP_POLL) {
+        st->polling = false;
+        if (st->close_pending) {
+            close(fd);
+        } else {
+            service(fd, false);
+        }
+    }
+    refresh_timer(m_users[fd]);
+}
+
+void uring_reactor::handle_accept(const io_uring_cqe& cqe)
+{
+    // 多次触发的 accept 因为出错等原因结束时重新挂上
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        arm_accept();
+    }
+    int connfd = cqe.res;
+    if (connfd < 0) {
+        printf("errno is: %d\n", -connfd);
+        return;
+    }
+    if (connfd >= MAX_FD || http_conn::m_user_count >= MAX_FD) {
+        show_error(connfd, "Internal server busy");
+        return;
+    }
+
+    // 多次触发的 accept 不返回对方的地址，只有限制每个 IP 的连接数时才需要查
+    admission* gate = admission::instance();
+    struct sockaddr_in client_address;
+    memset(&client_address, 0, sizeof(client_address));
+    if (gate->client_limit() > 0) {
+        socklen_t client_addrlength = sizeof(client_address);
+        getpeername(connfd, (struct sockaddr*)&client_address, &client_addrlength);
+    }
+    if (!gate->acquire_client(client_address)) {
+        admission::reject(connfd);
+        ::close(connfd);
+        metrics::count(metrics::COUNTER_SHED_CLIENT_LIMIT);
+        return;
+    }
+
+    if (!m_users[connfd]) {
+        m_users[connfd] = new http_conn;
+    }
+    if (!m_states[connfd]) {
+        m_states[connfd] = new conn_state();
+    }
+    m_users[connfd]->init(connfd, client_address, -1);
+    metrics::count(metrics::COUNTER_ACCEPTS);
+    arm_recv(connfd);
+    refresh_timer(m_users[connfd]);
+}
+
+void uring_reactor::handle_recv(int fd, const io_uring_cqe& cqe)
+{
+    http_conn* conn = m_users[fd];
+    conn_state* st = m_states[fd];
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        st->recv = RECV_IDLE;
+    }
+
+    if (cqe.res > 0) {
+        unsigned short id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        const char* data = m_ring.buffer(id);
+        int fed = 0;
+        if (!st->close_pending) {
+            // 前面还有没交给连接的数据时，新数据排在它们后面
+            if (st->overflow.empty()) {
+                fed = conn->feed(data, cqe.res);
+            }
+            if (fed >= 0 && fed < cqe.res) {
+                st->overflow.append(data + fed, cqe.res - fed);
+            }
+        }
+        m_ring.recycle_buffer(id);
+        if (fed < 0) {
+            close(fd);
+        } else if (!st->close_pending) {
+            service(fd, fed > 0);
+        }
+    } else if (cqe.res == 0 || (cqe.res != -ENOBUFS && cqe.res != -ECANCELED)) {
+        // 对方关闭了连接或者出错
+        close(fd);
+    } else {
+        // 提供的缓冲区暂时用完了，或者背压时被取消：处理完手上的数据之后重新挂 recv
+        service(fd, false);
+    }
+}
+
+void uring_reactor::handle_send(int fd, const io_uring_cqe& cqe)
+{
+    http_conn* conn = m_users[fd];
+    conn_state* st = m_states[fd];
+    --st->sends;
+    if (cqe.res >= 0 && !st->send_failed && !st->close_pending) {
+        if (!conn->complete_write(cqe.res)) {
+            st->send_failed = true;
+        }
+    } else if (cqe.res < 0 && cqe.res != -ECANCELED) {
+        // 链接的 sendmsg 里前一个出错时，后面的以 ECANCELED 结束，不用重复处理
+        st->send_failed = true;
+    }
+    if (st->sends > 0) {
+        return;
+    }
+    if (st->send_failed || st->close_pending) {
+        close(fd);
+    } else {
+        // 应答发完了就接着处理读缓冲区里剩下的流水线请求；没发完(中途断开的链接)就继续发
+        service(fd, conn->has_pending_input());
+    }
+}
+
+void uring_reactor::arm_accept()
+{
+    io_uring_sqe* sqe = m_ring.get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = m_listenfd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->user_data = user_data(NULL, m_listenfd, OP_ACCEPT);
+}
+
+void uring_reactor::arm_recv(int fd)
+{
+    conn_state* st = m_states[fd];
+    io_uring_sqe* sqe = m_ring.get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = user_data(st, fd, OP_RECV);
+    st->recv = RECV_ARMED;
+}
+
+void uring_reactor::cancel(uint64_t target)
+{
+    io_uring_sqe* sqe = m_ring.get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = OP_CANCEL;
+}
+
+void uring_reactor::service(int fd, bool fresh)
+{
+    http_conn* conn = m_users[fd];
+    conn_state* st = m_states[fd];
+    while (!conn->closed() && st->sends == 0 && !st->polling) {
+        if (conn->has_pending_output()) {
+            send(fd);
+            // 同步发完时(sendfile)接着处理流水线请求
+            fresh = conn->has_pending_input();
+            continue;
+        }
+        if (!st->overflow.empty()) {
+            int fed = conn->feed(st->overflow.data(), st->overflow.size());
+            if (fed < 0) {
+                close(fd);
+                return;
+            }
+            st->overflow.erase(0, fed);
+            fresh = fresh || fed > 0;
+        }
+        if (!fresh) {
+            break;
+        }
+        fresh = false;
+        conn->process();
+    }
+
+    if (conn->closed()) {
+        close(fd);
+        return;
+    }
+    if (st->close_pending) {
+        return;
+    }
+    // 读缓冲区满了，暂停接收，等连接消费掉已经收到的数据(背压)
+    if (st->overflow.empty()) {
+        if (st->recv == RECV_IDLE) {
+            arm_recv(fd);
+        }
+    } else if (st->recv == RECV_ARMED) {
+        cancel(user_data(st, fd, OP_RECV));
+        st->recv = RECV_CANCELING;
+    }
+}
+
+void uring_reactor::send(int fd)
+{
+    http_conn* conn = m_users[fd];
+    conn_state* st = m_states[fd];
+    int count = conn->prepare_write(st->iov, LINKED_SENDS * http_conn::MAX_IOVEC);
+    if (count == 0) {
+        // 队首是没有映射的大文件，用 sendfile 同步发送，发不动时等 POLLOUT
+        if (!conn->write()) {
+            // 由 service() 收尾
+            conn->close_conn();
+        } else if (conn->has_pending_output()) {
+            io_uring_sqe* sqe = m_ring.get_sqe();
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = fd;
+            sqe->poll32_events = POLLOUT;
+            sqe->user_data = user_data(st, fd, OP_POLL);
+            st->polling = true;
+        }
+        return;
+    }
+
+    // 每个 sendmsg 最多 MAX_IOVEC 段，多个按顺序链接；MSG_WAITALL 让内核把一个发完再开始下一个
+    int links = (count + http_conn::MAX_IOVEC - 1) / http_conn::MAX_IOVEC;
+    m_ring.reserve(links);
+    st->send_failed = false;
+    for (int i = 0; i < links; ++i) {
+        struct msghdr& msg = st->msgs[i];
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = st->iov + i * http_conn::MAX_IOVEC;
+        msg.msg_iovlen = std::min(http_conn::MAX_IOVEC, count - i * http_conn::MAX_IOVEC);
+        io_uring_sqe* sqe = m_ring.get_sqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)&msg;
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        sqe->user_data = user_data(st, fd, OP_SEND);
+        if (i + 1 < links) {
+            // 后面还有数据，MSG_MORE 让内核攒成满的报文段，不然 Nagle 会和对端的延迟确认互相等
+            sqe->flags = IOSQE_IO_LINK;
+            sqe->msg_flags |= MSG_MORE;
+        }
+    }
+    st->sends = links;
+}
+
+void uring_reactor::close(int fd)
+{
+    http_conn* conn = m_users[fd];
+    conn_state* st = m_states[fd];
+    // sendmsg 引用着连接的写缓冲区和文件，要等它们结束才能释放
+    if (st->sends > 0 || st->polling) {
+        if (!st->close_pending) {
+            st->close_pending = true;
+            cancel(user_data(st, fd, st->sends > 0 ? OP_SEND : OP_POLL));
+        }
+        return;
+    }
+    // 内核里的 recv 持有 socket 的引用，取消之后 socket 才真正关闭
+    if (st->recv != RECV_IDLE) {
+        cancel(user_data(st, fd, OP_RECV));
+    }
+    ++st->gen;
+    st->recv = RECV_IDLE;
+    st->close_pending = false;
+    st->send_failed = false;
+    std::string().swap(st->overflow);
+    m_timers.cancel(conn->timer());
+    // 描述符最后关闭，之后同一个描述符号可能马上被重新 accept
+    conn->close_conn();
+}
+
+void uring_reactor::refresh_timer(http_conn* conn)
+{
+    http_conn::TIMER_PHASE phase = conn->timer_phase();
+    if (phase == http_conn::PHASE_NONE) {
+        m_timers.cancel(conn->timer());
+    } else if (phase != http_conn::PHASE_HEADER || conn->scheduled_phase() != http_conn::PHASE_HEADER || !conn->timer()->linked()) {
+        // 请求头阶段的截止时间从请求开始算，中途收到数据不延长；其他阶段每次有进展都重新计时
+        m_timers.schedule(conn->timer(), m_now, http_conn::phase_timeout(phase));
+    }
+    conn->set_scheduled_phase(phase);
+}
+
+void uring_reactor::on_timeout(timer_wheel::node* timer)
+{
+    http_conn* conn = (http_conn*)timer->data;
+    if (!conn->closed()) {
+        metrics::count(metrics::COUNTER_TIMEOUTS);
+        close(conn->sockfd());
+    }
+    conn->set_scheduled_phase(http_conn::PHASE_NONE);
+}
@@ -0,0 +1,102 @@
+#ifndef URING_REACTOR_H
+#define URING_REACTOR_H
+
+#include <string>
+#include <vector>
+
+#include "http_conn.h"
+#include "io_ring.h"
+#include "reactor.h"
+#include "timer_wheel.h"
+
+/**
+ * 用 io_uring 代替 epoll 的事件循环，对外和 reactor 一样：负责 accept 以及所管理连接上的读写，
+ * 请求在本线程直接处理(不用线程池)，多个时各自有一个 SO_REUSEPORT 监听socket
+ * 监听socket上挂一个多次触发的 accept，每个连接上挂一个多次触发的 recv，数据由内核放进提供的缓冲区，
+ * 拷进连接的读缓冲区后马上还回去；应答用 sendmsg 异步发送，超过 MAX_IOVEC 段时拆成几个链接起来的 sendmsg。
+ * 收发都不需要每个请求重新注册事件，一轮循环的所有提交和等待合并成一次 io_uring_enter
+ * 没有映射的大文件仍然用 sendfile 同步发送，发不动时挂一个 POLLOUT 等待
+ */
+class uring_reactor
+{
+    public:
+        // 提交队列的大小
+        static const unsigned RING_ENTRIES = 1024;
+        // 提供给 recv 的缓冲区个数和大小
+        static const unsigned BUFFER_COUNT = 512;
+        static const unsigned BUFFER_SIZE = 4096;
+        // 一次最多链接几个 sendmsg
+        static const int LINKED_SENDS = 4;
+
+        // 内核是否支持这里用到的 io_uring 功能(6.1 以上：DEFER_TASKRUN、多次触发的 recv、缓冲区环)；不支持时设置 errno
+        static bool supported();
+
+        explicit uring_reactor(int listenfd);
+        ~uring_reactor();
+
+        // 运行事件循环，不会返回(io_uring 创建失败时返回)
+        void loop();
+
+        // 在新线程中运行事件循环，cpu 不小于0时把线程绑定到该CPU上
+        bool start(int cpu = -1);
+
+    private:
+        uring_reactor(const uring_reactor&);
+        uring_reactor& operator=(const uring_reactor&);
+
+        // 完成事件对应的操作，和连接的代数、描述符一起编码在 user_data 里
+        enum OP {OP_ACCEPT = 1, OP_RECV, OP_SEND, OP_POLL, OP_CANCEL};
+        // 连接上 recv 的状态：没有挂、挂着、已经请求取消但还没有收到最后一个完成事件
+        enum RECV_STATE {RECV_IDLE = 0, RECV_ARMED, RECV_CANCELING};
+
+        // 每个描述符在 io_uring 这边的状态，第一次用到时分配，之后复用
+        struct conn_state
+        {
+            // 连接关闭时加1，旧连接迟到的完成事件按代数丢弃
+            uint32_t gen;
+            RECV_STATE recv;
+            // 还没有完成的 sendmsg 个数
+            int sends;
+            bool polling;
+            // 有 sendmsg 或者 POLLOUT 还在内核里时要关闭连接，等它们取消完再关
+            bool close_pending;
+            // sendmsg 没有全部成功，剩下的应答不再发送
+            bool send_failed;
+            // 读缓冲区放不下的数据(背压)，先处理读缓冲区再交给连接
+            std::string overflow;
+            struct msghdr msgs[LINKED_SENDS];
+            struct iovec iov[LINKED_SENDS * http_conn::MAX_IOVEC];
+        };
+
+        static void* thread_entry(void* arg);
+        static uint64_t user_data(const conn_state* st, int fd, OP op);
+
+        void handle_cqe(const io_uring_cqe& cqe);
+        void handle_accept(const io_uring_cqe& cqe);
+        void handle_recv(int fd, const io_uring_cqe& cqe);
+        void handle_send(int fd, const io_uring_cqe& cqe);
+        void arm_accept();
+        void arm_recv(int fd);
+        // 取消所有 user_data 等于 target 的请求
+        void cancel(uint64_t target);
+        // 处理连接上已经收到的数据，发送应答，按需要重新挂或者取消 recv；fresh 表示有新的输入要处理
+        void service(int fd, bool fresh);
+        // 发送发送队列中的应答
+        void send(int fd);
+        // 关闭连接；还有 sendmsg 在内核里时先取消，等它们的完成事件到了再关
+        void close(int fd);
+        void refresh_timer(http_conn* conn);
+        void on_timeout(timer_wheel::node* timer);
+
+        io_ring m_ring;
+        int m_listenfd;
+        // 以文件描述符为下标的连接表，和 reactor 一样每个事件循环一个，不在事件循环之间共享
+        std::vector<http_conn*> m_users;
+        std::vector<conn_state*> m_states;
+        pthread_t m_thread;
+        timer_wheel m_timers;
+        // 本轮事件循环开始时的时间
+        long m_now;
+};
+
+#endif
@@ -0,0 +1,455 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <cstdio>
+#include <exception>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <unistd.h>
+
+// 同步机制包装类
+#include "locker.h"
+
+/**
+ * 工作线程自己的任务队列(Chase-Lev 双端队列)
+ * 只有所属的工作线程在 bottom 一端 push/pop，其他线程在 top 一端用 CAS 窃取，
+ * 所属线程在没有竞争时不需要任何原子读-改-写操作
+ */
+template<typename T>
+class work_stealing_deque
+{
+    public:
+        // 容量必须是2的幂
+        explicit work_stealing_deque(int capacity = 256);
+        ~work_stealing_deque() { delete [] m_buffer; }
+
+        // 只能由所属线程调用，队列满时返回false
+        bool push(T* item);
+        // 只能由所属线程调用，队列空时返回NULL
+        T* pop();
+        // 任意线程调用，队列空或者与其他线程竞争失败时返回NULL
+        T* steal();
+
+        int capacity() const { return m_mask + 1; }
+        // 并发时只是一个近似值
+        int size() const;
+
+    private:
+        work_stealing_deque(const work_stealing_deque&);
+        work_stealing_deque& operator=(const work_stealing_deque&);
+
+        std::atomic<T*>* m_buffer;
+        int64_t m_mask;
+        alignas(64) std::atomic<int64_t> m_top;
+        alignas(64) std::atomic<int64_t> m_bottom;
+};
+
+template<typename T>
+work_stealing_deque<T>::work_stealing_deque(int capacity) : m_mask(capacity - 1), m_top(0), m_bottom(0)
+{
+    if (capacity <= 0 || (capacity & (capacity - 1)) != 0) {
+        throw std::exception();
+    }
+    m_buffer = new std::atomic<T*>[capacity];
+}
+
+template<typename T>
+bool work_stealing_deque<T>::push(T* item)
+{
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_acquire);
+    if (b - t > m_mask) {
+        return false;
+    }
+    m_buffer[b & m_mask].store(item, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+template<typename T>
+T* work_stealing_deque<T>::pop()
+{
+    int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        // 队列为空
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return NULL;
+    }
+
+    T* item = m_buffer[b & m_mask].load(std::memory_order_relaxed);
+    if (t == b) {
+        // 只剩最后一个任务，与窃取者竞争
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            item = NULL;
+        }
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+}
+
+template<typename T>
+T* work_stealing_deque<T>::steal()
+{
+    int64_t t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = m_bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+        return NULL;
+    }
+
+    T* item = m_buffer[t & m_mask].load(std::memory_order_relaxed);
+    if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return NULL;
+    }
+    return item;
+}
+
+template<typename T>
+int work_stealing_deque<T>::size() const
+{
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    return b > t ? (int)(b - t) : 0;
+}
+
+/**
+ * 有界多生产者/多消费者队列，作为工作窃取线程池的公共注入队列
+ * 每个槽位带一个序号，生产者/消费者用 CAS 抢占位置后只和该槽位同步
+ */
+template<typename T>
+class injection_queue
+{
+    public:
+        // 容量向上取整为2的幂
+        explicit injection_queue(int capacity);
+        ~injection_queue() { delete [] m_cells; }
+
+        bool push(T* item);
+        T* pop();
+        // 并发时只是一个近似值
+        int size() const;
+
+    private:
+        injection_queue(const injection_queue&);
+        injection_queue& operator=(const injection_queue&);
+
+        struct cell
+        {
+            std::atomic<uint64_t> sequence;
+            T* item;
+        };
+
+        cell* m_cells;
+        uint64_t m_mask;
+        alignas(64) std::atomic<uint64_t> m_enqueue_pos;
+        alignas(64) std::atomic<uint64_t> m_dequeue_pos;
+};
+
+template<typename T>
+injection_queue<T>::injection_queue(int capacity) : m_enqueue_pos(0), m_dequeue_pos(0)
+{
+    uint64_t size = 2;
+    while (size < (uint64_t)capacity) {
+        size <<= 1;
+    }
+    m_mask = size - 1;
+    m_cells = new cell[size];
+    for (uint64_t i = 0; i < size; ++i) {
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+template<typename T>
+bool injection_queue<T>::push(T* item)
+{
+    uint64_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    cell* c;
+    while (true) {
+        c = &m_cells[pos & m_mask];
+        int64_t dif = (int64_t)c->sequence.load(std::memory_order_acquire) - (int64_t)pos;
+        if (dif == 0) {
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            return false;       // 队列已满
+        } else {
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    c->item = item;
+    c->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+T* injection_queue<T>::pop()
+{
+    uint64_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    cell* c;
+    while (true) {
+        c = &m_cells[pos & m_mask];
+        int64_t dif = (int64_t)c->sequence.load(std::memory_order_acquire) - (int64_t)(pos + 1);
+        if (dif == 0) {
+            if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            return NULL;        // 队列为空
+        } else {
+            pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    T* item = c->item;
+    c->sequence.store(pos + m_mask + 1, std::memory_order_release);
+    return item;
+}
+
+template<typename T>
+int injection_queue<T>::size() const
+{
+    uint64_t head = m_dequeue_pos.load(std::memory_order_relaxed);
+    uint64_t tail = m_enqueue_pos.load(std::memory_order_relaxed);
+    return tail > head ? (int)(tail - head) : 0;
+}
+
+/**
+ * 工作窃取线程池，接口与 threadpool<T> 相同
+ * 外部线程(比如主线程)提交的任务进入公共注入队列；工作线程提交的任务直接放进自己的双端队列。
+ * 工作线程先处理自己队列里的任务，空了就从注入队列成批搬一些过来，再没有就去别的线程那里窃取；
+ * 都找不到任务时先自旋一会儿，仍然没有才在信号量上睡眠，避免每个任务都经过一次 futex 唤醒
+ */
+template<typename T>
+class work_stealing_pool
+{
+    public:
+        // thread_number 是工作线程数，max_requests 是注入队列的容量，pin_threads 为 true 时把第i个线程绑定到第i个CPU上
+        work_stealing_pool(int thread_number = 8, int max_requests = 10000, bool pin_threads = false);
+        ~work_stealing_pool();
+
+        // 往线程池添加任务，注入队列已满时返回false
+        bool append(T* request);
+
+        // 排队中的任务数，只是一个近似值
+        int queued() const;
+        // 公共注入队列和第 i 个工作线程本地队列中的任务数，也是近似值
+        int injection_queued() const { return m_injection.size(); }
+        int local_queued(int i) const { return m_workers[i]->deque.size(); }
+        int thread_number() const { return m_thread_number; }
+
+    private:
+        // 从注入队列一次搬到本地队列的最大任务数
+        static const int BATCH_SIZE = 32;
+        // 睡眠之前的自旋轮数
+        static const int SPIN_ROUNDS = 64;
+
+        struct worker_context
+        {
+            work_stealing_pool* pool;
+            int index;
+            work_stealing_deque<T> deque;
+        };
+
+        static void* worker(void* arg);
+        void run(worker_context* self);
+        // 依次尝试本地队列、注入队列、其他线程的队列
+        T* find_task(worker_context* self);
+        // 有线程在睡眠时唤醒其中一个
+        void wake_one();
+
+        int m_thread_number;
+        pthread_t* m_threads;
+        worker_context** m_workers;
+        injection_queue<T> m_injection;
+        sem m_wakeup;                       // 睡眠中的线程在这个信号量上等待
+        std::atomic<int> m_sleepers;        // 准备睡眠或正在睡眠的线程数
+        std::atomic<bool> m_stop;
+
+        // 当前线程作为工作线程所属的上下文，不是本线程池的工作线程时为NULL
+        static thread_local worker_context* tls_self;
+};
+
+template<typename T>
+thread_local typename work_stealing_pool<T>::worker_context* work_stealing_pool<T>::tls_self = NULL;
+
+template<typename T>
+work_stealing_pool<T>::work_stealing_pool(int thread_number, int max_requests, bool pin_threads)
+    : m_thread_number(thread_number), m_threads(NULL), m_workers(NULL), m_injection(max_requests > 0 ? max_requests : 1),
+      m_sleepers(0), m_stop(false)
+{
+    if ((thread_number <= 0) || (max_requests <= 0)) {
+        throw std::exception();
+    }
+
+    m_threads = new pthread_t[m_thread_number];
+    m_workers = new worker_context*[m_thread_number];
+    for (int i = 0; i < m_thread_number; ++i) {
+        m_workers[i] = new worker_context{this, i, work_stealing_deque<T>()};
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 0; i < thread_number; ++i) {
+        if (pthread_create(m_threads + i, NULL, worker, m_workers[i]) != 0) {
+            // 已经创建的线程需要先退出，才能释放它们用到的资源
+            m_stop.store(true);
+            for (int j = 0; j < i; ++j) m_wakeup.post();
+            for (int j = 0; j < i; ++j) pthread_join(m_threads[j], NULL);
+            for (int j = 0; j < m_thread_number; ++j) delete m_workers[j];
+            delete [] m_workers;
+            delete [] m_threads;
+            throw std::exception();
+        }
+
+        if (pin_threads && cpus > 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(i % cpus, &set);
+            pthread_setaffinity_np(m_threads[i], sizeof(set), &set);
+        }
+    }
+}
+
+template<typename T>
+work_stealing_pool<T>::~work_stealing_pool()
+{
+    m_stop.store(true);
+    for (int i = 0; i < m_thread_number; ++i) {
+        m_wakeup.post();
+    }
+    for (int i = 0; i < m_thread_number; ++i) {
+        pthread_join(m_threads[i], NULL);
+    }
+    for (int i = 0; i < m_thread_number; ++i) {
+        delete m_workers[i];
+    }
+    delete [] m_workers;
+    delete [] m_threads;
+}
+
+template<typename T>
+bool work_stealing_pool<T>::append(T* request)
+{
+    worker_context* self = tls_self;
+    if (!(self && self->pool == this && self->deque.push(request))) {
+        if (!m_injection.push(request)) {
+            return false;
+        }
+    }
+    wake_one();
+    return true;
+}
+
+template<typename T>
+int work_stealing_pool<T>::queued() const
+{
+    int total = m_injection.size();
+    for (int i = 0; i < m_thread_number; ++i) {
+        total += m_workers[i]->deque.size();
+    }
+    return total;
+}
+
+template<typename T>
+void work_stealing_pool<T>::wake_one()
+{
+    // 与 run() 里的栅栏配对：要么睡眠者在睡眠前看到新任务，要么这里看到睡眠者
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int sleepers = m_sleepers.load(std::memory_order_relaxed);
+    while (sleepers > 0) {
+        if (m_sleepers.compare_exchange_weak(sleepers, sleepers - 1, std::memory_order_relaxed)) {
+            m_wakeup.post();
+            return;
+        }
+    }
+}
+
+template<typename T>
+void* work_stealing_pool<T>::worker(void* arg)
+{
+    worker_context* self = (worker_context*)arg;
+    tls_self = self;
+    self->pool->run(self);
+    return self->pool;
+}
+
+template<typename T>
+T* work_stealing_pool<T>::find_task(worker_context* self)
+{
+    T* task = self->deque.pop();
+    if (task) {
+        return task;
+    }
+
+    // 从注入队列成批搬运，第一个直接执行，其余的放进本地队列供自己和其他线程使用
+    task = m_injection.pop();
+    if (task) {
+        for (int i = 1; i < BATCH_SIZE; ++i) {
+            T* next = m_injection.pop();
+            if (!next) {
+                break;
+            }
+            if (!self->deque.push(next)) {
+                m_injection.push(next);
+                break;
+            }
+        }
+        // 本地队列里有多余的任务，叫醒一个线程来窃取
+        if (self->deque.size() > 0) {
+            wake_one();
+        }
+        return task;
+    }
+
+    for (int i = 1; i < m_thread_number; ++i) {
+        worker_context* victim = m_workers[(self->index + i) % m_thread_number];
+        task = victim->deque.steal();
+        if (task) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+template<typename T>
+void work_stealing_pool<T>::run(worker_context* self)
+{
+    while (!m_stop.load(std::memory_order_relaxed)) {
+        T* task = NULL;
+        for (int spin = 0; spin < SPIN_ROUNDS && !task; ++spin) {
+            task = find_task(self);
+            if (!task) {
+                sched_yield();
+            }
+        }
+
+        if (!task) {
+            // 先登记为睡眠者再检查一次，避免在检查和睡眠之间提交的任务没人处理
+            m_sleepers.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            task = find_task(self);
+            if (task || m_stop.load(std::memory_order_relaxed)) {
+                // 撤销登记；如果已经被别人撤销，说明有一个唤醒信号是发给自己的，需要把它消耗掉
+                int sleepers = m_sleepers.load(std::memory_order_relaxed);
+                bool cancelled = false;
+                while (sleepers > 0 && !cancelled) {
+                    cancelled = m_sleepers.compare_exchange_weak(sleepers, sleepers - 1, std::memory_order_relaxed);
+                }
+                if (!cancelled) {
+                    m_wakeup.wait();
+                }
+            } else {
+                m_wakeup.wait();
+                continue;
+            }
+        }
+
+        if (task) {
+            task->process();
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,405 @@
+#include "mvcc.hpp"
+#include "persistent_map.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+using namespace mvcc11;
+
+namespace
+{
+    // 统计全局分配器上分配的字节数和次数
+    atomic<size_t> g_alloc_bytes{0};
+    atomic<size_t> g_alloc_count{0};
+
+    struct alloc_counter
+    {
+        size_t bytes;
+        size_t count;
+
+        alloc_counter() : bytes{g_alloc_bytes.load()}, count{g_alloc_count.load()} {}
+
+        size_t bytes_since() const { return g_alloc_bytes.load() - bytes; }
+        size_t count_since() const { return g_alloc_count.load() - count; }
+    };
+
+    auto hr_now() -> decltype(high_resolution_clock::now())
+    {
+        return high_resolution_clock::now();
+    }
+
+    // 一条基准测试结果：名字加若干数值字段，最后统一按文本或 JSON 输出，便于做回归对比
+    struct bench_result
+    {
+        string name;
+        vector<pair<string, double>> fields;
+    };
+
+    vector<bench_result> g_results;
+
+    void report(bench_result result)
+    {
+        g_results.push_back(std::move(result));
+    }
+
+    void print_text()
+    {
+        for (auto const &r : g_results) {
+            printf("%-24s", r.name.c_str());
+            for (auto const &f : r.fields) {
+                printf(" %s=%.6g", f.first.c_str(), f.second);
+            }
+            printf("\n");
+        }
+    }
+
+    void print_json()
+    {
+        printf("[\n");
+        for (size_t i = 0; i < g_results.size(); ++i) {
+            auto const &r = g_results[i];
+            printf("  {\"name\": \"%s\"", r.name.c_str());
+            for (auto const &f : r.fields) {
+                printf(", \"%s\": %.6g", f.first.c_str(), f.second);
+            }
+            printf("}%s\n", i + 1 == g_results.size() ? "" : ",");
+        }
+        printf("]\n");
+    }
+};
+
+// 替换全局的分配函数统计分配次数和字节数；普通、数组、对齐、nothrow 的 new 和对应的(带大小的) delete 全部替换，
+// 每种分配都由配对的释放函数回收。实际的分配和释放在下面两个不内联的函数里：
+// operator delete 内联成 free 之后，GCC 会把它和调用方看到的 operator new 当成不配对的一对(-Wmismatched-new-delete)
+namespace
+{
+    __attribute__((noinline)) void* counted_alloc(size_t size, size_t alignment) noexcept
+    {
+        g_alloc_bytes.fetch_add(size, memory_order_relaxed);
+        g_alloc_count.fetch_add(1, memory_order_relaxed);
+        if (size == 0) {
+            size = 1;
+        }
+        if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            return malloc(size);
+        }
+        // aligned_alloc 要求大小是对齐的整数倍
+        return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    }
+
+    __attribute__((noinline)) void counted_free(void *p) noexcept
+    {
+        free(p);
+    }
+
+    void* counted_new(size_t size, size_t alignment)
+    {
+        if (void *p = counted_alloc(size, alignment)) {
+            return p;
+        }
+        throw bad_alloc{};
+    }
+};
+
+void* operator new(size_t size) { return counted_new(size, 0); }
+void* operator new[](size_t size) { return counted_new(size, 0); }
+void* operator new(size_t size, align_val_t al) { return counted_new(size, static_cast<size_t>(al)); }
+void* operator new[](size_t size, align_val_t al) { return counted_new(size, static_cast<size_t>(al)); }
+void* operator new(size_t size, nothrow_t const &) noexcept { return counted_alloc(size, 0); }
+void* operator new[](size_t size, nothrow_t const &) noexcept { return counted_alloc(size, 0); }
+void* operator new(size_t size, align_val_t al, nothrow_t const &) noexcept { return counted_alloc(size, static_cast<size_t>(al)); }
+void* operator new[](size_t size, align_val_t al, nothrow_t const &) noexcept { return counted_alloc(size, static_cast<size_t>(al)); }
+
+void operator delete(void *p) noexcept { counted_free(p); }
+void operator delete[](void *p) noexcept { counted_free(p); }
+void operator delete(void *p, size_t) noexcept { counted_free(p); }
+void operator delete[](void *p, size_t) noexcept { counted_free(p); }
+void operator delete(void *p, align_val_t) noexcept { counted_free(p); }
+void operator delete[](void *p, align_val_t) noexcept { counted_free(p); }
+void operator delete(void *p, size_t, align_val_t) noexcept { counted_free(p); }
+void operator delete[](void *p, size_t, align_val_t) noexcept { counted_free(p); }
+void operator delete(void *p, nothrow_t const &) noexcept { counted_free(p); }
+void operator delete[](void *p, nothrow_t const &) noexcept { counted_free(p); }
+void operator delete(void *p, align_val_t, nothrow_t const &) noexcept { counted_free(p); }
+void operator delete[](void *p, align_val_t, nothrow_t const &) noexcept { counted_free(p); }
+
+// 更新一个有 entries 个元素的映射中的一项，保留 retained 个历史版本(模拟仍在读旧快照的读者)，
+// 统计每次更新的耗时和新分配的内存
+template <class Map, class Updater>
+void bench_update(char const *name, Map initial, size_t entries, int updates, size_t retained, Updater updater)
+{
+    mvcc<Map> x{std::move(initial)};
+    vector<typename mvcc<Map>::const_snapshot_ptr> readers;
+
+    for (int i = 0; i < 4; ++i) {
+        x.update([&](size_t, Map const &m) { return updater(m, i, i); });
+    }
+
+    alloc_counter counter;
+    auto start = hr_now();
+
+    for (int i = 0; i < updates; ++i) {
+        x.update([&](size_t, Map const &m) { return updater(m, i % entries, i); });
+        if (readers.size() < retained) {
+            readers.push_back(x.current());
+        }
+    }
+
+    auto elapsed = duration_cast<nanoseconds>(hr_now() - start).count();
+    report({name, {
+        {"entries", double(entries)},
+        {"ns_per_update", double(elapsed) / updates},
+        {"bytes_per_update", double(counter.bytes_since()) / updates},
+        {"allocs_per_update", double(counter.count_since()) / updates},
+    }});
+}
+
+void bench_persistent_vs_copy()
+{
+    for (size_t entries : {1000, 100000, 1000000}) {
+        int const updates = entries >= 1000000 ? 20 : 200;
+        size_t const retained = 16;
+
+        unordered_map<int, int> full;
+        persistent_map<int, int> shared;
+        for (size_t i = 0; i < entries; ++i) {
+            full[int(i)] = int(i);
+            shared = shared.set(int(i), int(i));
+        }
+
+        // 先跑 persistent_map：释放大块 unordered_map 之后的堆整理会干扰后续小对象分配的计时
+        bench_update("persistent_map", std::move(shared), entries, updates, retained,
+                [](persistent_map<int, int> const &m, size_t key, int value) {
+                    return m.set(int(key), value);
+                });
+
+        bench_update("full_copy_unordered_map", std::move(full), entries, updates, retained,
+                [](unordered_map<int, int> const &m, size_t key, int value) {
+                    auto copy = m;
+                    copy[int(key)] = value;
+                    return copy;
+                });
+    }
+}
+
+// 多个写者争用同一个对象：对比 update() 的 CAS 重试循环与 combine_update() 的合并写路径。
+// updater 调用次数减去成功次数即为白做的工作(每次都伴随一次值拷贝和一次快照分配)
+template <class Update>
+void bench_contended(char const *name, int threads, Update do_update)
+{
+    mvcc<vector<int>> x{vector<int>(256)};
+    atomic<size_t> updater_calls{0};
+    atomic<size_t> successes{0};
+    atomic<bool> stop{false};
+
+    alloc_counter counter;
+    auto start = hr_now();
+
+    vector<thread> writers;
+    for (int t = 0; t < threads; ++t) {
+        writers.emplace_back([&] {
+            size_t local = 0;
+            while (!stop.load(memory_order_relaxed)) {
+                do_update(x, [&](size_t, vector<int> const &value) {
+                    updater_calls.fetch_add(1, memory_order_relaxed);
+                    auto copy = value;
+                    ++copy[0];
+                    return copy;
+                });
+                ++local;
+            }
+            successes.fetch_add(local);
+        });
+    }
+
+    this_thread::sleep_for(milliseconds(300));
+    stop = true;
+    for (auto &w : writers) {
+        w.join();
+    }
+
+    auto elapsed = duration_cast<duration<double>>(hr_now() - start).count();
+    auto const done = successes.load();
+    report({name, {
+        {"threads", double(threads)},
+        {"updates_per_sec", done / elapsed},
+        {"updater_calls_per_update", double(updater_calls.load()) / done},
+        {"allocs_per_update", double(counter.count_since()) / done},
+    }});
+}
+
+void bench_combining_vs_cas()
+{
+    for (int threads : {1, 2, 4, 8, 16}) {
+        bench_contended("cas_update", threads, [](mvcc<vector<int>> &x, auto updater) {
+            x.update(updater);
+        });
+        bench_contended("combine_update", threads, [](mvcc<vector<int>> &x, auto updater) {
+            x.combine_update(updater);
+        });
+    }
+}
+
+// readers 个读线程不停地取快照并读取值，一个写线程不停地 update，分别统计读写吞吐
+void bench_read_update(int readers, size_t value_size)
+{
+    mvcc<string> x{string(value_size, 'x')};
+    atomic<size_t> reads{0};
+    atomic<size_t> updates{0};
+    atomic<size_t> checksum{0};
+    atomic<bool> stop{false};
+
+    auto start = hr_now();
+
+    vector<thread> threads;
+    for (int t = 0; t < readers; ++t) {
+        threads.emplace_back([&] {
+            size_t local = 0;
+            size_t sum = 0;
+            while (!stop.load(memory_order_relaxed)) {
+                auto snapshot = x.current();
+                sum += snapshot->version + static_cast<unsigned char>(snapshot->value.back());
+                ++local;
+            }
+            reads.fetch_add(local);
+            checksum.fetch_add(sum);
+        });
+    }
+
+    threads.emplace_back([&] {
+        size_t local = 0;
+        while (!stop.load(memory_order_relaxed)) {
+            x.update([](size_t version, string const &value) {
+                auto copy = value;
+                copy.back() = char('a' + version % 26);
+                return copy;
+            });
+            ++local;
+        }
+        updates.fetch_add(local);
+    });
+
+    this_thread::sleep_for(milliseconds(200));
+    stop = true;
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    auto elapsed = duration_cast<duration<double>>(hr_now() - start).count();
+    report({"read_update", {
+        {"readers", double(readers)},
+        {"value_size", double(value_size)},
+        {"reads_per_sec", reads.load() / elapsed},
+        {"updates_per_sec", updates.load() / elapsed},
+    }});
+}
+
+void bench_read_update_matrix()
+{
+    for (size_t value_size : {16, 1024, 65536}) {
+        for (int readers : {1, 2, 4, 8}) {
+            bench_read_update(readers, value_size);
+        }
+    }
+}
+
+#ifdef MVCC11_USES_SNAPSHOT_POOL
+double const snapshot_pool = 1;
+#else
+double const snapshot_pool = 0;
+#endif // MVCC11_USES_SNAPSHOT_POOL
+
+// 单线程连续 update：每次分配一个新快照并释放上一个，主要衡量快照分配/释放本身的开销
+void bench_snapshot_alloc()
+{
+    int const updates = 2000000;
+    mvcc<int> x{0};
+
+    alloc_counter counter;
+    auto start = hr_now();
+    for (int i = 0; i < updates; ++i) {
+        x.update([](size_t, int value) { return value + 1; });
+    }
+    auto elapsed = duration_cast<nanoseconds>(hr_now() - start).count();
+
+    report({"snapshot_alloc", {
+        {"snapshot_pool", snapshot_pool},
+        {"ns_per_update", double(elapsed) / updates},
+        {"global_allocs_per_update", double(counter.count_since()) / updates},
+    }});
+}
+
+// 写线程不停 update，读线程持有最近的若干快照，旧快照的最后一次释放发生在读线程上(跨线程释放)
+void bench_cross_thread_release()
+{
+    mvcc<int> x{0};
+    atomic<size_t> updates{0};
+    atomic<bool> stop{false};
+
+    auto start = hr_now();
+
+    thread reader([&] {
+        vector<mvcc<int>::const_snapshot_ptr> held(64);
+        size_t i = 0;
+        while (!stop.load(memory_order_relaxed)) {
+            held[i++ % held.size()] = x.current();
+        }
+    });
+
+    thread writer([&] {
+        size_t local = 0;
+        while (!stop.load(memory_order_relaxed)) {
+            x.update([](size_t, int value) { return value + 1; });
+            ++local;
+        }
+        updates.fetch_add(local);
+    });
+
+    this_thread::sleep_for(milliseconds(300));
+    stop = true;
+    reader.join();
+    writer.join();
+
+    auto elapsed = duration_cast<duration<double>>(hr_now() - start).count();
+    report({"cross_thread_release", {
+        {"snapshot_pool", snapshot_pool},
+        {"updates_per_sec", updates.load() / elapsed},
+    }});
+}
+
+int main(int argc, char *argv[])
+{
+    bool json = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else {
+            fprintf(stderr, "usage: %s [--json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    bench_snapshot_alloc();
+    bench_cross_thread_release();
+    bench_read_update_matrix();
+    bench_persistent_vs_copy();
+    bench_combining_vs_cas();
+
+    if (json) {
+        print_json();
+    } else {
+        print_text();
+    }
+    return 0;
+}
@@ -1,11 +1,16 @@
 #include "mvcc.hpp"
+#include "persistent_map.hpp"
+#include "persistent_vector.hpp"
 #include <atomic>
 #include <string>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <future>
+#include <algorithm>
 #include <cassert>
+#include <stdexcept>
+#include <vector>
 
 using namespace std;
 using namespace chrono;
@@ -13,15 +18,15 @@ using namespace mvcc11;
 
 namespace
 {
-    // auto hr_now() -> decltype(high_resolution_clock::now())
-    // {
-    //     return high_resolution_clock::now();
-    // }
+    auto hr_now() -> decltype(high_resolution_clock::now())
+    {
+        return high_resolution_clock::now();
+    }
 
     auto INIT = "init";
-    // auto OVERWRITTEN = "overwritten";
-    // auto UPDATED = "updated";
-    // auto DISTURBED = "disturbed";
+    auto OVERWRITTEN = "overwritten";
+    auto UPDATED = "updated";
+    auto DISTURBED = "disturbed";
 };
 
 template <class Mutex>
@@ -68,9 +73,374 @@ void test_case_2()
     assert(snapshot->value == INIT);
 }
 
+void test_case_overwrite()
+{
+    mvcc<string> x{INIT};
+    auto before = x.current();
+
+    auto overwritten = x.overwrite(OVERWRITTEN);
+    assert(overwritten == x.current());
+    assert(overwritten->version == 1);
+    assert(overwritten->value == OVERWRITTEN);
+
+    assert(before->version == 0);
+    assert(before->value == INIT);
+}
+
+void test_case_update()
+{
+    mvcc<string> x{INIT};
+
+    auto updated = x.update([](size_t version, string const &value) {
+        assert(version == 0);
+        assert(value == INIT);
+        return UPDATED;
+    });
+
+    assert(updated == x.current());
+    assert(updated->version == 1);
+    assert(updated->value == UPDATED);
+}
+
+void test_case_try_update_disturbed()
+{
+    mvcc<string> x{INIT};
+
+    // updater 执行期间被其他写者抢先提交，try_update 必须失败且不能覆盖对方的结果
+    auto updated = x.try_update([&x](size_t, string const &) {
+        x.overwrite(DISTURBED);
+        return UPDATED;
+    });
+
+    assert(updated == nullptr);
+    assert(x->version == 1);
+    assert(x->value == DISTURBED);
+}
+
+void test_case_try_update_for_timeout()
+{
+    mvcc<string> x{INIT};
+    auto const timeout = milliseconds(100);
+
+    auto start = hr_now();
+    auto updated = x.try_update_for([&x](size_t, string const &) {
+        x.overwrite(DISTURBED);
+        return UPDATED;
+    }, timeout);
+    auto elapsed = hr_now() - start;
+
+    assert(updated == nullptr);
+    assert(elapsed >= timeout);
+    assert(x->value == DISTURBED);
+}
+
+void test_case_copy_and_assign()
+{
+    mvcc<string> x{INIT};
+    mvcc<string> y{x};
+    assert(y.current() == x.current());
+
+    mvcc<string> z;
+    z = x;
+    assert(z.current() == x.current());
+
+    x.overwrite(OVERWRITTEN);
+    assert(y->value == INIT);
+    assert(z->value == INIT);
+
+    mvcc<string> w{std::move(x)};
+    assert(w->value == OVERWRITTEN);
+}
+
+// 多个写者并发 update (value + 1)，多个读者并发读取：
+// 1. 任何被观察到的快照都满足 value == version (每个版本恰好由一次 update 产生)
+// 2. 每个读者看到的版本号单调不减
+// 3. 所有写者拿到的返回快照版本恰好是 1..N，不重不漏，即所有更新存在一个全序
+void test_case_concurrent_update_linearizable()
+{
+    int const writers = 4;
+    int const readers = 4;
+    int const updates_per_writer = 2000;
+
+    mvcc<size_t> x{size_t{0}};
+    atomic<bool> done{false};
+    atomic<bool> violated{false};
+    mutex versions_mtx;
+    vector<size_t> versions;
+
+    vector<thread> threads;
+    for (int r = 0; r < readers; ++r) {
+        threads.emplace_back([&] {
+            size_t last = 0;
+            while (!done.load()) {
+                auto snapshot = x.current();
+                if (snapshot->value != snapshot->version || snapshot->version < last) {
+                    violated = true;
+                }
+                last = snapshot->version;
+            }
+        });
+    }
+
+    vector<thread> writer_threads;
+    for (int w = 0; w < writers; ++w) {
+        writer_threads.emplace_back([&] {
+            vector<size_t> local;
+            for (int i = 0; i < updates_per_writer; ++i) {
+                auto snapshot = x.update([](size_t, size_t value) { return value + 1; });
+                local.push_back(snapshot->version);
+            }
+            locked(versions_mtx, [&] {
+                versions.insert(versions.end(), local.begin(), local.end());
+            });
+        });
+    }
+
+    for (auto &t : writer_threads) {
+        t.join();
+    }
+    done = true;
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    size_t const total = writers * updates_per_writer;
+    assert(!violated);
+    assert(x->version == total);
+    assert(x->value == total);
+
+    sort(versions.begin(), versions.end());
+    assert(versions.size() == total);
+    for (size_t i = 0; i < total; ++i) {
+        assert(versions[i] == i + 1);
+    }
+}
+
+// overwrite 与 update 混合并发：update 写入 version + 1，overwrite 写入 -1 作为标记，
+// 读者看到的每个快照只能是这两种之一；每次写操作恰好产生一个版本
+void test_case_concurrent_mixed_linearizable()
+{
+    int const overwriters = 2;
+    int const updaters = 2;
+    int const ops_per_writer = 2000;
+    long const marker = -1;
+
+    mvcc<long> x{0L};
+    atomic<bool> done{false};
+    atomic<bool> violated{false};
+    mutex versions_mtx;
+    vector<size_t> versions;
+
+    thread reader([&] {
+        size_t last = 0;
+        while (!done.load()) {
+            auto snapshot = x.current();
+            if ((snapshot->value != long(snapshot->version) && snapshot->value != marker) || snapshot->version < last) {
+                violated = true;
+            }
+            last = snapshot->version;
+        }
+    });
+
+    auto collect = [&](vector<size_t> const &local) {
+        locked(versions_mtx, [&] {
+            versions.insert(versions.end(), local.begin(), local.end());
+        });
+    };
+
+    vector<thread> writers;
+    for (int w = 0; w < overwriters; ++w) {
+        writers.emplace_back([&] {
+            vector<size_t> local;
+            for (int i = 0; i < ops_per_writer; ++i) {
+                local.push_back(x.overwrite(marker)->version);
+            }
+            collect(local);
+        });
+    }
+    for (int w = 0; w < updaters; ++w) {
+        writers.emplace_back([&] {
+            vector<size_t> local;
+            for (int i = 0; i < ops_per_writer; ++i) {
+                auto snapshot = x.update([](size_t version, long) { return long(version + 1); });
+                if (snapshot->value != long(snapshot->version)) {
+                    violated = true;
+                }
+                local.push_back(snapshot->version);
+            }
+            collect(local);
+        });
+    }
+
+    for (auto &t : writers) {
+        t.join();
+    }
+    done = true;
+    reader.join();
+
+    size_t const total = (overwriters + updaters) * ops_per_writer;
+    assert(!violated);
+    assert(x->version == total);
+
+    sort(versions.begin(), versions.end());
+    assert(versions.size() == total);
+    for (size_t i = 0; i < total; ++i) {
+        assert(versions[i] == i + 1);
+    }
+}
+
+void test_case_persistent_map()
+{
+    persistent_map<int, string> m0;
+    auto m1 = m0.set(1, "one");
+    auto m2 = m1.set(2, "two").set(1, "uno");
+
+    assert(m0.empty());
+    assert(m1.size() == 1 && *m1.find(1) == "one");
+    assert(m2.size() == 2 && *m2.find(1) == "uno" && *m2.find(2) == "two");
+
+    auto big = m0;
+    for (int i = 0; i < 10000; ++i) {
+        big = big.set(i, to_string(i));
+    }
+    auto smaller = big;
+    for (int i = 0; i < 10000; i += 2) {
+        smaller = smaller.erase(i);
+    }
+
+    assert(big.size() == 10000);
+    assert(smaller.size() == 5000);
+    for (int i = 0; i < 10000; ++i) {
+        assert(*big.find(i) == to_string(i));
+        assert((smaller.find(i) != nullptr) == (i % 2 == 1));
+    }
+}
+
+void test_case_persistent_vector()
+{
+    persistent_vector<int> v0;
+    auto v = v0;
+    for (int i = 0; i < 5000; ++i) {
+        v = v.push_back(i);
+    }
+    auto w = v.set(0, -1).set(4999, -2).set(1234, -3);
+
+    assert(v0.empty());
+    assert(v.size() == 5000 && w.size() == 5000);
+    for (int i = 0; i < 5000; ++i) {
+        assert(v[i] == i);
+    }
+    assert(w[0] == -1 && w[4999] == -2 && w[1234] == -3 && w[1233] == 1233);
+
+    int sum = 0;
+    v.for_each([&](int x) { sum += x; });
+    assert(sum == 4999 * 5000 / 2);
+}
+
+void test_case_persistent_update()
+{
+    mvcc<persistent_map<int, int>> x;
+    auto before = x.current();
+
+    for (int i = 0; i < 100; ++i) {
+        x.update([i](size_t, persistent_map<int, int> const &m) {
+            return m.set(i, i * i);
+        });
+    }
+
+    auto after = x.current();
+    assert(before->value.empty());
+    assert(after->version == 100);
+    assert(after->value.size() == 100);
+    assert(*after->value.find(9) == 81);
+}
+
+void test_case_combine_update()
+{
+    int const threads = 4;
+    int const updates_per_thread = 2000;
+
+    mvcc<int> x{0};
+    vector<thread> writers;
+    for (int t = 0; t < threads; ++t) {
+        writers.emplace_back([&x] {
+            for (int i = 0; i < updates_per_thread; ++i) {
+                auto snapshot = x.combine_update([](size_t, int value) { return value + 1; });
+                assert(snapshot != nullptr);
+            }
+        });
+    }
+    for (auto &w : writers) {
+        w.join();
+    }
+
+    auto snapshot = x.current();
+    assert(snapshot->value == threads * updates_per_thread);
+    assert(snapshot->version == size_t(threads * updates_per_thread));
+
+    bool thrown = false;
+    try {
+        x.combine_update([](size_t, int) -> int { throw runtime_error("updater failed"); });
+    } catch (runtime_error const &) {
+        thrown = true;
+    }
+    assert(thrown);
+    assert(x.current() == snapshot);
+}
+
+// 不能默认构造的值；值为负时第二次移动(进入快照)抛出异常，模拟分配快照失败
+struct fragile_value
+{
+    explicit fragile_value(int v) : value{v}, moves{0} {}
+    fragile_value(fragile_value const &) = default;
+    fragile_value(fragile_value &&other) : value{other.value}, moves{other.moves + 1}
+    {
+        if (value < 0 && moves == 2) {
+            throw runtime_error("snapshot failed");
+        }
+    }
+
+    int value;
+    int moves;
+};
+
+void test_case_combine_update_failure()
+{
+    mvcc<fragile_value> x{fragile_value{1}};
+    auto snapshot = x.combine_update([](size_t, fragile_value const &v) { return fragile_value{v.value + 1}; });
+    assert(snapshot->value.value == 2);
+
+    // 合并者发布快照时抛出异常：写者收到异常，合并锁被释放
+    bool thrown = false;
+    try {
+        x.combine_update([](size_t, fragile_value const &) { return fragile_value{-1}; });
+    } catch (runtime_error const &) {
+        thrown = true;
+    }
+    assert(thrown);
+    assert(x.current() == snapshot);
+
+    snapshot = x.combine_update([](size_t, fragile_value const &v) { return fragile_value{v.value + 1}; });
+    assert(snapshot->value.value == 3);
+    assert(snapshot->version == 2);
+}
+
 int main() {
     
     test_case_1();
+    test_case_2();
+    test_case_overwrite();
+    test_case_update();
+    test_case_try_update_disturbed();
+    test_case_try_update_for_timeout();
+    test_case_copy_and_assign();
+    test_case_concurrent_update_linearizable();
+    test_case_concurrent_mixed_linearizable();
+    test_case_persistent_map();
+    test_case_persistent_vector();
+    test_case_persistent_update();
+    test_case_combine_update();
+    test_case_combine_update_failure();
     return 0;
 }
         
\ No newline at end of file
@@ -5,6 +5,10 @@
 #define MVCC11_CONTENSION_BACKOFF_SLEEP_MS 50
 #endif // MVCC11_CONTENSION_BACKOFF_SLEEP_MS
 
+#ifndef MVCC11_COMBINING_SLOTS
+#define MVCC11_COMBINING_SLOTS 32
+#endif // MVCC11_COMBINING_SLOTS
+
 #ifdef MVCC11_USES_STD_SHARED_PTR
 
 #include <memory>
@@ -15,9 +19,10 @@ namespace smart_ptr
 {
     using std::shared_ptr;
     using std::make_shared;
+    using std::allocate_shared;
     using std::atomic_load;
     using std::atomic_store;
-    using std::atomic_compare_exchange_strong
+    using std::atomic_compare_exchange_strong;
 };
 };
 
@@ -31,6 +36,7 @@ namespace smart_ptr
 {
     using boost::shared_ptr;
     using boost::make_shared;
+    using boost::allocate_shared;
     using boost::atomic_load;
     using boost::atomic_store;
 
@@ -44,6 +50,14 @@ namespace smart_ptr
 
 #endif // MVCC11_USES_STD_SHARED_PTR
 
+#ifdef MVCC11_USES_SNAPSHOT_POOL
+#include "snapshot_pool.hpp"
+#endif // MVCC11_USES_SNAPSHOT_POOL
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <optional>
 #include <utility>
 #include <chrono>
 #include <thread>
@@ -88,7 +102,7 @@ namespace mvcc11
             mvcc(mvcc const &other) MVCC11_NOEXCEPT(true);
             mvcc(mvcc &&other) MVCC11_NOEXCEPT(true);
 
-            ~mvcc() = default;
+            ~mvcc();
 
             mvcc& operator = (mvcc const &other) MVCC11_NOEXCEPT(true);
             mvcc& operator =( mvcc &&other) MVCC11_NOEXCEPT(true);
@@ -111,8 +125,47 @@ namespace mvcc11
 
             template <class Updater, class Rep, class Period>
             const_snapshot_ptr try_update_for(Updater updater, std::chrono::duration<Rep, Period> const &timeout_duration);
+
+            // flat combining 写路径：写者把 updater 发布到对象的槽位数组中，由抢到合并锁的线程
+            // 依次执行一批 updater，只分配并 CAS 发布一个新快照。每个 updater 看到的版本号与值
+            // 与串行执行一致，返回的是包含本次更新的那个(合并后的)快照
+            template <class Updater>
+            const_snapshot_ptr combine_update(Updater updater);
         
         private:
+            enum slot_state { slot_free, slot_owned, slot_pending, slot_done };
+
+            struct alignas(64) combining_slot
+            {
+                std::atomic<int> state{slot_free};
+                void *updater = nullptr;
+                value_type (*apply)(void *updater, size_t version, value_type const &value) = nullptr;
+                const_snapshot_ptr result;
+                std::exception_ptr error;
+            };
+
+            struct combiner
+            {
+                std::atomic_flag lock = ATOMIC_FLAG_INIT;
+                combining_slot slots[MVCC11_COMBINING_SLOTS];
+            };
+
+            // 持有合并锁期间抛出异常时也要释放锁，否则其他合并写者会一直等下去
+            struct combiner_lock_guard
+            {
+                std::atomic_flag &lock;
+                ~combiner_lock_guard() { lock.clear(std::memory_order_release); }
+            };
+
+            template <class Updater>
+            static value_type apply_updater(void *updater, size_t version, value_type const &value);
+
+            template <class... Args>
+            static mutable_snapshot_ptr make_snapshot(Args&&... args);
+
+            combiner& get_combiner();
+            void combine();
+
             template <class U>
             const_snapshot_ptr overwrite_impl(U &&value);
 
@@ -123,6 +176,7 @@ namespace mvcc11
             const_snapshot_ptr try_update_until_impl (Updater &updater, std::chrono::time_point<Clock, Duration> const &timeout_time);
 
             mutable_snapshot_ptr mutable_current_;
+            std::atomic<combiner*> combiner_{nullptr};
     };
 
     template <class ValueType>
@@ -142,38 +196,55 @@ namespace mvcc11
 
     template <class ValueType>
     mvcc<ValueType>::mvcc() MVCC11_NOEXCEPT(true)
-        : mutable_current_{smart_ptr::make_shared<snapshot_type>(0)}
+        : mutable_current_{make_snapshot(0)}
     {
 
     }
 
     template <class ValueType>
     mvcc<ValueType>::mvcc(value_type const &value)
-        : mutable_current_{smart_ptr::make_shared<snapshot_type>(0, value)}
+        : mutable_current_{make_snapshot(0, value)}
     {
     }
 
     template <class ValueType>
     mvcc<ValueType>::mvcc(value_type &&value)
-        : mutable_current_{smart_ptr::make_shared<snapshot_type>(0, std::move(value))}
+        : mutable_current_{make_snapshot(0, std::move(value))}
     {
 
     }
 
     template <class ValueType>
     mvcc<ValueType>::mvcc(mvcc const &other) MVCC11_NOEXCEPT(true)
-        : mutable_current_{smart_ptr::atomic_load(other)}
+        : mutable_current_{smart_ptr::atomic_load(&other.mutable_current_)}
     {
 
     }
 
     template <class ValueType>
     mvcc<ValueType>::mvcc(mvcc &&other) MVCC11_NOEXCEPT(true)
-        : mutable_current_{smart_ptr::atomic_load(other)}
+        : mutable_current_{smart_ptr::atomic_load(&other.mutable_current_)}
     {
 
     }
 
+    template <class ValueType>
+    template <class... Args>
+    auto mvcc<ValueType>::make_snapshot(Args&&... args) -> mutable_snapshot_ptr
+    {
+#ifdef MVCC11_USES_SNAPSHOT_POOL
+        return smart_ptr::allocate_shared<snapshot_type>(pool_allocator<snapshot_type>{}, std::forward<Args>(args)...);
+#else
+        return smart_ptr::make_shared<snapshot_type>(std::forward<Args>(args)...);
+#endif // MVCC11_USES_SNAPSHOT_POOL
+    }
+
+    template <class ValueType>
+    mvcc<ValueType>::~mvcc()
+    {
+        delete combiner_.load(std::memory_order_acquire);
+    }
+
     template <class ValueType>
     auto mvcc<ValueType>::operator = (mvcc const &other) MVCC11_NOEXCEPT(true) -> mvcc &
     {
@@ -225,7 +296,7 @@ namespace mvcc11
     template <class U>
     auto mvcc<ValueType>::overwrite_impl(U &&value) -> const_snapshot_ptr
     {
-        auto desired = smart_ptr::make_shared<snapshot_type>(0, std::forward<U>(value));
+        auto desired = make_snapshot(0, std::forward<U>(value));
 
         while (true) {
             auto expected = smart_ptr::atomic_load(&mutable_current_);
@@ -283,7 +354,7 @@ namespace mvcc11
         auto const const_expected_version = expected->version;
         auto const &const_expected_value = expected->value;
 
-        auto desired = smart_ptr::make_shared<snapshot_type>(const_expected_version + 1, updater(const_expected_version, const_expected_value));
+        auto desired = make_snapshot(const_expected_version + 1, updater(const_expected_version, const_expected_value));
 
         auto const updated = smart_ptr::atomic_compare_exchange_strong(&mutable_current_, &expected, desired);
 
@@ -311,6 +382,148 @@ namespace mvcc11
             std::this_thread::sleep_for(std::chrono::milliseconds(MVCC11_CONTENSION_BACKOFF_SLEEP_MS));
         }
     }
+
+    template <class ValueType>
+    template <class Updater>
+    auto mvcc<ValueType>::combine_update(Updater updater) -> const_snapshot_ptr
+    {
+        auto &c = this->get_combiner();
+
+        static thread_local size_t const hint = std::hash<std::thread::id>{}(std::this_thread::get_id());
+
+        combining_slot *slot = nullptr;
+        for (size_t i = 0; i < MVCC11_COMBINING_SLOTS; ++i) {
+            auto &candidate = c.slots[(hint + i) % MVCC11_COMBINING_SLOTS];
+            int expected = slot_free;
+            if (candidate.state.compare_exchange_strong(expected, slot_owned, std::memory_order_acquire)) {
+                slot = &candidate;
+                break;
+            }
+        }
+
+        // 槽位全部被占用时退回普通的 CAS 写路径
+        if (slot == nullptr) {
+            return this->update(std::move(updater));
+        }
+
+        slot->updater = &updater;
+        slot->apply = &mvcc::apply_updater<Updater>;
+        slot->state.store(slot_pending, std::memory_order_release);
+
+        while (slot->state.load(std::memory_order_acquire) != slot_done) {
+            if (!c.lock.test_and_set(std::memory_order_acquire)) {
+                combiner_lock_guard guard{c.lock};
+                this->combine();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+
+        auto result = std::move(slot->result);
+        auto error = std::move(slot->error);
+        slot->result = nullptr;
+        slot->error = nullptr;
+        slot->state.store(slot_free, std::memory_order_release);
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return result;
+    }
+
+    template <class ValueType>
+    template <class Updater>
+    auto mvcc<ValueType>::apply_updater(void *updater, size_t version, value_type const &value) -> value_type
+    {
+        return (*static_cast<Updater*>(updater))(version, value);
+    }
+
+    template <class ValueType>
+    auto mvcc<ValueType>::get_combiner() -> combiner &
+    {
+        auto *c = combiner_.load(std::memory_order_acquire);
+        if (c != nullptr) {
+            return *c;
+        }
+
+        auto *created = new combiner;
+        if (combiner_.compare_exchange_strong(c, created, std::memory_order_acq_rel)) {
+            return *created;
+        }
+
+        delete created;
+        return *c;
+    }
+
+    template <class ValueType>
+    void mvcc<ValueType>::combine()
+    {
+        auto &c = *combiner_.load(std::memory_order_acquire);
+
+        combining_slot *batch[MVCC11_COMBINING_SLOTS];
+        size_t batch_size = 0;
+        for (auto &slot : c.slots) {
+            if (slot.state.load(std::memory_order_acquire) == slot_pending) {
+                batch[batch_size++] = &slot;
+            }
+        }
+
+        if (batch_size == 0) {
+            return;
+        }
+
+        mutable_snapshot_ptr desired;
+        std::exception_ptr failure;
+        try {
+            while (true) {
+                auto expected = smart_ptr::atomic_load(&mutable_current_);
+                auto version = expected->version;
+
+                // 第一个 updater 直接读当前快照的值，之后的 updater 读上一个 updater 的结果；
+                // 用 optional 保存结果，和 update() 一样不要求 value_type 可以默认构造
+                std::optional<value_type> value;
+                value_type const *current = &expected->value;
+
+                for (size_t i = 0; i < batch_size; ++i) {
+                    auto *slot = batch[i];
+                    slot->error = nullptr;
+                    try {
+                        auto next = slot->apply(slot->updater, version, *current);
+                        value.emplace(std::move(next));
+                        current = &*value;
+                        ++version;
+                    } catch (...) {
+                        slot->error = std::current_exception();
+                    }
+                }
+
+                desired = nullptr;
+                if (value) {
+                    desired = make_snapshot(version, std::move(*value));
+                    // 与 overwrite/update 等非合并写者竞争失败时，整批重新执行
+                    if (!smart_ptr::atomic_compare_exchange_strong(&mutable_current_, &expected, desired)) {
+                        continue;
+                    }
+                }
+                break;
+            }
+        } catch (...) {
+            // 分配快照等失败时整批都没有发布，每个等待的写者都收到这个异常
+            desired = nullptr;
+            failure = std::current_exception();
+        }
+
+        for (size_t i = 0; i < batch_size; ++i) {
+            auto *slot = batch[i];
+            if (failure && !slot->error) {
+                slot->error = failure;
+            }
+            if (!slot->error) {
+                slot->result = desired;
+            }
+            slot->state.store(slot_done, std::memory_order_release);
+        }
+    }
 };
 
 #endif
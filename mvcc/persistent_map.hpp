@@ -0,0 +1,320 @@
+#ifndef MVCC11_PERSISTENT_MAP_HPP
+#define MVCC11_PERSISTENT_MAP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace mvcc11
+{
+    // 持久化(结构共享)的哈希映射，基于 HAMT(Hash Array Mapped Trie)
+    // set/erase 不修改原对象，而是返回新对象，只复制从根到目标叶子路径上的 O(log32 n) 个节点，
+    // 其余节点在新旧版本之间共享。作为 mvcc<T> 的 value_type 时，每次 update 不再整体拷贝整个映射
+    template <class Key, class T, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>>
+    class persistent_map
+    {
+        public:
+            using key_type = Key;
+            using mapped_type = T;
+            using value_type = std::pair<Key, T>;
+            using size_type = std::size_t;
+            using hasher = Hash;
+            using key_equal = KeyEqual;
+
+            persistent_map();
+
+            size_type size() const { return size_; }
+            bool empty() const { return size_ == 0; }
+
+            T const* find(Key const &key) const;
+            size_type count(Key const &key) const { return this->find(key) != nullptr ? 1 : 0; }
+
+            persistent_map set(Key const &key, T const &value) const;
+            persistent_map erase(Key const &key) const;
+
+            template <class Function>
+            void for_each(Function fn) const;
+
+        private:
+            static constexpr unsigned bits_per_level = 5;
+            static constexpr unsigned hash_bits = sizeof(std::size_t) * 8;
+
+            struct node;
+            using node_ptr = std::shared_ptr<node>;
+
+            // datamap 标记本层直接存放键值对的槽位，nodemap 标记指向子节点的槽位，
+            // values/children 按位图中的顺序紧凑存放。哈希位耗尽时(shift >= hash_bits)节点退化为冲突链，只用 values
+            struct node
+            {
+                std::uint32_t datamap = 0;
+                std::uint32_t nodemap = 0;
+                std::vector<value_type> values;
+                std::vector<node_ptr> children;
+            };
+
+            persistent_map(node_ptr root, size_type size);
+
+            static std::uint32_t bit_of(std::size_t hash, unsigned shift);
+            static unsigned index_of(std::uint32_t bitmap, std::uint32_t bit);
+
+            static node_ptr merge(value_type const &a, std::size_t ha, value_type const &b, std::size_t hb, unsigned shift);
+            static node_ptr set_impl(node_ptr const &n, unsigned shift, std::size_t hash, Key const &key, T const &value, bool &added);
+            static node_ptr erase_impl(node_ptr const &n, unsigned shift, std::size_t hash, Key const &key, bool &removed);
+
+            template <class Function>
+            static void for_each_impl(node const &n, Function &fn);
+
+            node_ptr root_;
+            size_type size_;
+    };
+
+    template <class Key, class T, class Hash, class KeyEqual>
+    persistent_map<Key, T, Hash, KeyEqual>::persistent_map()
+        : root_{std::make_shared<node>()}, size_{0}
+    {
+
+    }
+
+    template <class Key, class T, class Hash, class KeyEqual>
+    persistent_map<Key, T, Hash, KeyEqual>::persistent_map(node_ptr root, size_type size)
+        : root_{std::move(root)}, size_{size}
+    {
+
+    }
+
+    template <class Key, class T, class Hash, class KeyEqual>
+    std::uint32_t persistent_map<Key, T, Hash, KeyEqual>::bit_of(std::size_t hash, unsigned shift)
+    {
+        return std::uint32_t{1} << ((hash >> shift) & 0x1f);
+    }
+
+    template <class Key, class T, class Hash, class KeyEqual>
+    unsigned persistent_map<Key, T, Hash, KeyEqual>::index_of(std::uint32_t bitmap, std::uint32_t bit)
+    {
+        return static_cast<unsigned>(__builtin_popcount(bitmap & (bit - 1)));
+    }
+
+    template <class Key, class T, class Hash, class KeyEqual>
+    T const* persistent_map<Key, T, Hash, KeyEqual>::find(Key const &key) const
+    {
+        auto const hash = Hash{}(key);
+        node const *n = root_.get();
+
+        for (unsigned shift = 0; ; shift += bits_per_level) {
+            if (shift >= hash_bits) {
+                for (auto const &kv : n->values) {
+                    if (KeyEqual{}(kv.first, key)) {
+                        return &kv.second;
+                    }
+                }
+                return nullptr;
+            }
+
+            auto const bit = bit_of(hash, shift);
+            if (n->datamap & bit) {
+                auto const &kv = n->values[index_of(n->datamap, bit)];
+                return KeyEqual{}(kv.first, key) ? &kv.second : nullptr;
+            }
+
+            if (!(n->nodemap & bit)) {
+                return nullptr;
+            }
+
+            n = n->children[index_of(n->nodemap, bit)].get();
+        }
+    }
+
+    template <class Key, class T, class Hash, class KeyEqual>
+    auto persistent_map<Key, T, Hash, KeyEqual>::set(Key const &key, T const &value) const -> persistent_map
+    {
+        bool added = false;
+        auto root = set_impl(root_, 0, Hash{}(key), key, value, added);
+        return persistent_map{std::move(root), size_ + (added ? 1 : 0)};
+    }
+
+    template <class Key, class T, class Hash, class KeyEqual>
+    auto persistent_map<Key, T, Hash, KeyEqual>::erase(Key const &key) const -> persistent_map
+    {
+        bool removed = false;
+        auto root = erase_impl(root_, 0, Hash{}(key), key, removed);
+        if (!removed) {
+            return *this;
+        }
+        if (root == nullptr) {
+            root = std::make_shared<node>();
+        }
+        return persistent_map{std::move(root), size_ - 1};
+    }
+
+    template <class Key, class T, class Hash, class KeyEqual>
+    template <class Function>
+    void persistent_map<Key, T, Hash, KeyEqual>::for_each(Function fn) const
+    {
+        for_each_impl(*root_, fn);
+    }
+
+    template <class Key, class T, class Hash, class KeyEqual>
+    template <class Function>
+    void persistent_map<Key, T, Hash, KeyEqual>::for_each_impl(node const &n, Function &fn)
+    {
+        for (auto const &kv : n.values) {
+            fn(kv.first, kv.second);
+        }
+        for (auto const &child : n.children) {
+            for_each_impl(*child, fn);
+        }
+    }
+
+    template <class Key, class T, class Hash, class KeyEqual>
+    auto persistent_map<Key, T, Hash, KeyEqual>::merge(value_type const &a, std::size_t ha, value_type const &b, std::size_t hb, unsigned shift) -> node_ptr
+    {
+        auto n = std::make_shared<node>();
+
+        if (shift >= hash_bits) {
+            n->values.push_back(a);
+            n->values.push_back(b);
+            return n;
+        }
+
+        auto const bit_a = bit_of(ha, shift);
+        auto const bit_b = bit_of(hb, shift);
+
+        if (bit_a == bit_b) {
+            n->nodemap = bit_a;
+            n->children.push_back(merge(a, ha, b, hb, shift + bits_per_level));
+            return n;
+        }
+
+        n->datamap = bit_a | bit_b;
+        if (bit_a < bit_b) {
+            n->values.push_back(a);
+            n->values.push_back(b);
+        } else {
+            n->values.push_back(b);
+            n->values.push_back(a);
+        }
+        return n;
+    }
+
+    template <class Key, class T, class Hash, class KeyEqual>
+    auto persistent_map<Key, T, Hash, KeyEqual>::set_impl(node_ptr const &n, unsigned shift, std::size_t hash, Key const &key, T const &value, bool &added) -> node_ptr
+    {
+        auto copy = std::make_shared<node>(*n);
+
+        if (shift >= hash_bits) {
+            for (auto &kv : copy->values) {
+                if (KeyEqual{}(kv.first, key)) {
+                    kv.second = value;
+                    return copy;
+                }
+            }
+            copy->values.emplace_back(key, value);
+            added = true;
+            return copy;
+        }
+
+        auto const bit = bit_of(hash, shift);
+
+        if (n->datamap & bit) {
+            auto const idx = index_of(n->datamap, bit);
+            auto const &existing = n->values[idx];
+
+            if (KeyEqual{}(existing.first, key)) {
+                copy->values[idx].second = value;
+                return copy;
+            }
+
+            // 槽位被另一个键占用，下沉为子节点
+            auto child = merge(existing, Hash{}(existing.first), value_type{key, value}, hash, shift + bits_per_level);
+            copy->values.erase(copy->values.begin() + idx);
+            copy->datamap &= ~bit;
+            copy->nodemap |= bit;
+            copy->children.insert(copy->children.begin() + index_of(copy->nodemap, bit), std::move(child));
+            added = true;
+            return copy;
+        }
+
+        if (n->nodemap & bit) {
+            auto const idx = index_of(n->nodemap, bit);
+            copy->children[idx] = set_impl(n->children[idx], shift + bits_per_level, hash, key, value, added);
+            return copy;
+        }
+
+        copy->datamap |= bit;
+        copy->values.insert(copy->values.begin() + index_of(copy->datamap, bit), value_type{key, value});
+        added = true;
+        return copy;
+    }
+
+    template <class Key, class T, class Hash, class KeyEqual>
+    auto persistent_map<Key, T, Hash, KeyEqual>::erase_impl(node_ptr const &n, unsigned shift, std::size_t hash, Key const &key, bool &removed) -> node_ptr
+    {
+        if (shift >= hash_bits) {
+            for (std::size_t i = 0; i < n->values.size(); ++i) {
+                if (KeyEqual{}(n->values[i].first, key)) {
+                    removed = true;
+                    if (n->values.size() == 1) {
+                        return nullptr;
+                    }
+                    auto copy = std::make_shared<node>(*n);
+                    copy->values.erase(copy->values.begin() + i);
+                    return copy;
+                }
+            }
+            return n;
+        }
+
+        auto const bit = bit_of(hash, shift);
+
+        if (n->datamap & bit) {
+            auto const idx = index_of(n->datamap, bit);
+            if (!KeyEqual{}(n->values[idx].first, key)) {
+                return n;
+            }
+
+            removed = true;
+            if (n->values.size() == 1 && n->children.empty()) {
+                return nullptr;
+            }
+
+            auto copy = std::make_shared<node>(*n);
+            copy->values.erase(copy->values.begin() + idx);
+            copy->datamap &= ~bit;
+            return copy;
+        }
+
+        if (n->nodemap & bit) {
+            auto const idx = index_of(n->nodemap, bit);
+            auto child = erase_impl(n->children[idx], shift + bits_per_level, hash, key, removed);
+            if (!removed) {
+                return n;
+            }
+
+            auto copy = std::make_shared<node>(*n);
+
+            if (child == nullptr) {
+                copy->children.erase(copy->children.begin() + idx);
+                copy->nodemap &= ~bit;
+                if (copy->values.empty() && copy->children.empty()) {
+                    return nullptr;
+                }
+            } else if (child->children.empty() && child->values.size() == 1) {
+                // 子节点只剩一个键值对，上提到本层以保持树的紧凑
+                copy->children.erase(copy->children.begin() + idx);
+                copy->nodemap &= ~bit;
+                copy->datamap |= bit;
+                copy->values.insert(copy->values.begin() + index_of(copy->datamap, bit), child->values.front());
+            } else {
+                copy->children[idx] = std::move(child);
+            }
+            return copy;
+        }
+
+        return n;
+    }
+};
+
+#endif // MVCC11_PERSISTENT_MAP_HPP
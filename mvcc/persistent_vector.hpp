@@ -0,0 +1,219 @@
+#ifndef MVCC11_PERSISTENT_VECTOR_HPP
+#define MVCC11_PERSISTENT_VECTOR_HPP
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace mvcc11
+{
+    // 持久化(结构共享)的向量，基于 32 叉的基数平衡树(radix balanced tree)加尾部缓冲
+    // push_back/set 返回新对象，只复制根到叶子路径上的 O(log32 n) 个节点，其余节点在各版本间共享
+    template <class T>
+    class persistent_vector
+    {
+        public:
+            using value_type = T;
+            using size_type = std::size_t;
+
+            persistent_vector();
+
+            size_type size() const { return size_; }
+            bool empty() const { return size_ == 0; }
+
+            T const& operator[](size_type index) const;
+            T const& at(size_type index) const;
+
+            persistent_vector push_back(T const &value) const;
+            persistent_vector set(size_type index, T const &value) const;
+
+            template <class Function>
+            void for_each(Function fn) const;
+
+        private:
+            static constexpr unsigned bits_per_level = 5;
+            static constexpr size_type branching = size_type{1} << bits_per_level;
+            static constexpr size_type mask = branching - 1;
+
+            struct node;
+            using node_ptr = std::shared_ptr<node>;
+
+            // 内部节点只用 children，叶子节点只用 values
+            struct node
+            {
+                std::vector<node_ptr> children;
+                std::vector<T> values;
+            };
+
+            persistent_vector(size_type size, unsigned shift, node_ptr root, node_ptr tail);
+
+            size_type tail_offset() const;
+            node const* leaf_for(size_type index) const;
+
+            node_ptr push_tail(unsigned level, node_ptr const &parent, node_ptr const &tail) const;
+            static node_ptr new_path(unsigned level, node_ptr const &n);
+            static node_ptr assoc(unsigned level, node_ptr const &n, size_type index, T const &value);
+
+            size_type size_;
+            unsigned shift_;
+            node_ptr root_;
+            node_ptr tail_;
+    };
+
+    template <class T>
+    persistent_vector<T>::persistent_vector()
+        : size_{0}, shift_{bits_per_level}, root_{std::make_shared<node>()}, tail_{std::make_shared<node>()}
+    {
+
+    }
+
+    template <class T>
+    persistent_vector<T>::persistent_vector(size_type size, unsigned shift, node_ptr root, node_ptr tail)
+        : size_{size}, shift_{shift}, root_{std::move(root)}, tail_{std::move(tail)}
+    {
+
+    }
+
+    template <class T>
+    auto persistent_vector<T>::tail_offset() const -> size_type
+    {
+        return size_ < branching ? 0 : ((size_ - 1) >> bits_per_level) << bits_per_level;
+    }
+
+    template <class T>
+    auto persistent_vector<T>::leaf_for(size_type index) const -> node const*
+    {
+        if (index >= this->tail_offset()) {
+            return tail_.get();
+        }
+
+        node const *n = root_.get();
+        for (unsigned level = shift_; level > 0; level -= bits_per_level) {
+            n = n->children[(index >> level) & mask].get();
+        }
+        return n;
+    }
+
+    template <class T>
+    T const& persistent_vector<T>::operator[](size_type index) const
+    {
+        return this->leaf_for(index)->values[index & mask];
+    }
+
+    template <class T>
+    T const& persistent_vector<T>::at(size_type index) const
+    {
+        if (index >= size_) {
+            throw std::out_of_range("persistent_vector index out of range");
+        }
+        return (*this)[index];
+    }
+
+    template <class T>
+    auto persistent_vector<T>::push_back(T const &value) const -> persistent_vector
+    {
+        // 尾部缓冲未满，只复制尾部
+        if (size_ - this->tail_offset() < branching) {
+            auto tail = std::make_shared<node>(*tail_);
+            tail->values.push_back(value);
+            return persistent_vector{size_ + 1, shift_, root_, std::move(tail)};
+        }
+
+        // 尾部已满，将其挂入树中，必要时增加一层
+        node_ptr root;
+        unsigned shift = shift_;
+
+        if ((size_ >> bits_per_level) > (size_type{1} << shift_)) {
+            root = std::make_shared<node>();
+            root->children.push_back(root_);
+            root->children.push_back(new_path(shift_, tail_));
+            shift += bits_per_level;
+        } else {
+            root = this->push_tail(shift_, root_, tail_);
+        }
+
+        auto tail = std::make_shared<node>();
+        tail->values.reserve(branching);
+        tail->values.push_back(value);
+        return persistent_vector{size_ + 1, shift, std::move(root), std::move(tail)};
+    }
+
+    template <class T>
+    auto persistent_vector<T>::set(size_type index, T const &value) const -> persistent_vector
+    {
+        if (index >= size_) {
+            throw std::out_of_range("persistent_vector index out of range");
+        }
+
+        if (index >= this->tail_offset()) {
+            auto tail = std::make_shared<node>(*tail_);
+            tail->values[index & mask] = value;
+            return persistent_vector{size_, shift_, root_, std::move(tail)};
+        }
+
+        return persistent_vector{size_, shift_, assoc(shift_, root_, index, value), tail_};
+    }
+
+    template <class T>
+    template <class Function>
+    void persistent_vector<T>::for_each(Function fn) const
+    {
+        for (size_type i = 0; i < size_; i += branching) {
+            auto const *leaf = this->leaf_for(i);
+            for (auto const &value : leaf->values) {
+                fn(value);
+            }
+        }
+    }
+
+    template <class T>
+    auto persistent_vector<T>::push_tail(unsigned level, node_ptr const &parent, node_ptr const &tail) const -> node_ptr
+    {
+        auto copy = std::make_shared<node>(*parent);
+        auto const sub = ((size_ - 1) >> level) & mask;
+
+        node_ptr inserted;
+        if (level == bits_per_level) {
+            inserted = tail;
+        } else if (sub < parent->children.size()) {
+            inserted = this->push_tail(level - bits_per_level, parent->children[sub], tail);
+        } else {
+            inserted = new_path(level - bits_per_level, tail);
+        }
+
+        if (sub < copy->children.size()) {
+            copy->children[sub] = std::move(inserted);
+        } else {
+            copy->children.push_back(std::move(inserted));
+        }
+        return copy;
+    }
+
+    template <class T>
+    auto persistent_vector<T>::new_path(unsigned level, node_ptr const &n) -> node_ptr
+    {
+        if (level == 0) {
+            return n;
+        }
+        auto path = std::make_shared<node>();
+        path->children.push_back(new_path(level - bits_per_level, n));
+        return path;
+    }
+
+    template <class T>
+    auto persistent_vector<T>::assoc(unsigned level, node_ptr const &n, size_type index, T const &value) -> node_ptr
+    {
+        auto copy = std::make_shared<node>(*n);
+        if (level == 0) {
+            copy->values[index & mask] = value;
+        } else {
+            auto const sub = (index >> level) & mask;
+            copy->children[sub] = assoc(level - bits_per_level, n->children[sub], index, value);
+        }
+        return copy;
+    }
+};
+
+#endif // MVCC11_PERSISTENT_VECTOR_HPP
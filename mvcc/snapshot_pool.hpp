@@ -0,0 +1,204 @@
+#ifndef MVCC11_SNAPSHOT_POOL_HPP
+#define MVCC11_SNAPSHOT_POOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#ifndef MVCC11_SNAPSHOT_POOL_CHUNK_BLOCKS
+#define MVCC11_SNAPSHOT_POOL_CHUNK_BLOCKS 64
+#endif // MVCC11_SNAPSHOT_POOL_CHUNK_BLOCKS
+
+namespace mvcc11
+{
+namespace detail
+{
+    // 按块大小划分的线程本地内存池
+    // 每个线程对每种块大小拥有一个 heap：本线程分配/释放只操作本地空闲链表，不需要同步；
+    // 其他线程释放的块通过无锁栈(remote-free 队列)还给所属 heap，由所属线程在本地链表耗尽时一次性取回。
+    // 线程退出后 heap 不销毁，而是挂到孤儿链表上，留给之后新建的线程接管，
+    // 这样仍在外面的块归还时总能找到一个有效的 heap
+    template <std::size_t BlockSize>
+    class block_pool
+    {
+        private:
+            struct heap;
+
+            struct alignas(16) block_header
+            {
+                heap *owner;
+                block_header *next;
+            };
+
+            struct heap
+            {
+                block_header *local = nullptr;
+                std::atomic<block_header*> remote{nullptr};
+                std::vector<void*> chunks;
+            };
+
+            static constexpr std::size_t stride = (sizeof(block_header) + BlockSize + 15) & ~std::size_t{15};
+
+            // tls_heap 是平凡析构的，线程局部对象析构阶段仍可安全读取；holder 析构后将其置空，
+            // 之后本线程的释放一律走 remote-free，分配则临时借用一个孤儿 heap
+            static thread_local heap *tls_heap;
+
+            struct heap_holder
+            {
+                heap_holder() { tls_heap = adopt_or_create(); }
+                ~heap_holder() { orphan(tls_heap); tls_heap = nullptr; }
+            };
+
+            struct registry
+            {
+                std::mutex mtx;
+                std::vector<heap*> orphans;
+            };
+
+            static registry& get_registry()
+            {
+                // 有意泄漏：heap 需要比所有线程和静态对象都活得久
+                static registry *r = new registry;
+                return *r;
+            }
+
+            static heap* adopt_or_create()
+            {
+                auto &r = get_registry();
+                std::lock_guard<std::mutex> lock{r.mtx};
+                if (!r.orphans.empty()) {
+                    auto *h = r.orphans.back();
+                    r.orphans.pop_back();
+                    return h;
+                }
+                return new heap;
+            }
+
+            static void orphan(heap *h)
+            {
+                auto &r = get_registry();
+                std::lock_guard<std::mutex> lock{r.mtx};
+                r.orphans.push_back(h);
+            }
+
+            static heap* local_heap()
+            {
+                static thread_local heap_holder holder;
+                return tls_heap;
+            }
+
+            static void refill(heap &h)
+            {
+                h.local = h.remote.exchange(nullptr, std::memory_order_acquire);
+                if (h.local != nullptr) {
+                    return;
+                }
+
+                auto *chunk = static_cast<char*>(::operator new(stride * MVCC11_SNAPSHOT_POOL_CHUNK_BLOCKS));
+                h.chunks.push_back(chunk);
+                for (std::size_t i = 0; i < MVCC11_SNAPSHOT_POOL_CHUNK_BLOCKS; ++i) {
+                    auto *b = reinterpret_cast<block_header*>(chunk + i * stride);
+                    b->owner = &h;
+                    b->next = h.local;
+                    h.local = b;
+                }
+            }
+
+            static void* pop(heap &h)
+            {
+                if (h.local == nullptr) {
+                    refill(h);
+                }
+
+                auto *b = h.local;
+                h.local = b->next;
+                return b + 1;
+            }
+
+        public:
+            static void* allocate()
+            {
+                auto *h = local_heap();
+                if (h == nullptr) {
+                    h = adopt_or_create();
+                    auto *p = pop(*h);
+                    orphan(h);
+                    return p;
+                }
+                return pop(*h);
+            }
+
+            static void deallocate(void *p)
+            {
+                auto *b = static_cast<block_header*>(p) - 1;
+                auto *owner = b->owner;
+
+                if (owner == tls_heap) {
+                    b->next = owner->local;
+                    owner->local = b;
+                    return;
+                }
+
+                auto *head = owner->remote.load(std::memory_order_relaxed);
+                do {
+                    b->next = head;
+                } while (!owner->remote.compare_exchange_weak(head, b, std::memory_order_release, std::memory_order_relaxed));
+            }
+    };
+
+    template <std::size_t BlockSize>
+    thread_local typename block_pool<BlockSize>::heap *block_pool<BlockSize>::tls_heap = nullptr;
+};
+
+    // 供 allocate_shared 使用的分配器，快照对象和引用计数控制块在同一个池块中分配
+    template <class T>
+    class pool_allocator
+    {
+        public:
+            using value_type = T;
+
+            template <class U>
+            struct rebind
+            {
+                using other = pool_allocator<U>;
+            };
+
+            pool_allocator() noexcept = default;
+
+            template <class U>
+            pool_allocator(pool_allocator<U> const &) noexcept {}
+
+            T* allocate(std::size_t n)
+            {
+                if (n != 1 || alignof(T) > 16) {
+                    return static_cast<T*>(::operator new(n * sizeof(T)));
+                }
+                return static_cast<T*>(detail::block_pool<sizeof(T)>::allocate());
+            }
+
+            void deallocate(T *p, std::size_t n) noexcept
+            {
+                if (n != 1 || alignof(T) > 16) {
+                    ::operator delete(p);
+                    return;
+                }
+                detail::block_pool<sizeof(T)>::deallocate(p);
+            }
+    };
+
+    template <class T, class U>
+    bool operator == (pool_allocator<T> const &, pool_allocator<U> const &) noexcept
+    {
+        return true;
+    }
+
+    template <class T, class U>
+    bool operator != (pool_allocator<T> const &, pool_allocator<U> const &) noexcept
+    {
+        return false;
+    }
+};
+
+#endif // MVCC11_SNAPSHOT_POOL_HPP